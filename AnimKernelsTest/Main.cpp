@@ -0,0 +1,17 @@
+#include "AnimKernels.h"
+
+#include <iostream>
+
+// Compares batch animation kernels with scalar glm evaluation, exit code is non zero on mismatch
+int main()
+{
+	if (!AnimKernels::SelfTest())
+	{
+		std::cerr << "Animation kernels do not match scalar evaluation\n";
+		return 1;
+	}
+
+	std::cout << "Animation kernels match scalar evaluation\n";
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+// Fixed set of workers executing indexed jobs, the calling thread takes part in the work as well
+class ThreadPool
+{
+	std::vector<std::thread> workers;
+
+	std::mutex mux;
+	std::condition_variable workCV;
+	std::condition_variable doneCV;
+
+	const std::function<void(size_t)>* job = nullptr;
+	size_t jobAmount = 0;
+	std::atomic<size_t> nextJobIndex = 0;
+	// Incremented for each ParallelFor, so workers know there is new work
+	size_t generation = 0;
+	size_t busyWorkers = 0;
+	bool stopping = false;
+	std::exception_ptr jobException;
+
+	void ExecuteJobs()
+	{
+		for (size_t jobIndex = nextJobIndex++; jobIndex < jobAmount; jobIndex = nextJobIndex++)
+		{
+			try
+			{
+				(*job)(jobIndex);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mux);
+
+				if (!jobException)
+				{
+					jobException = std::current_exception();
+				}
+			}
+		}
+	}
+
+	void WorkerLoop()
+	{
+		size_t lastGeneration = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mux);
+				workCV.wait(lock, [this, lastGeneration]() { return stopping || generation != lastGeneration; });
+
+				if (stopping)
+				{
+					return;
+				}
+
+				lastGeneration = generation;
+			}
+
+			ExecuteJobs();
+
+			{
+				std::lock_guard<std::mutex> lock(mux);
+				--busyWorkers;
+			}
+
+			doneCV.notify_one();
+		}
+	}
+
+public:
+	// By default leaves one hardware thread to the caller
+	explicit ThreadPool(size_t workerAmount = std::max(std::thread::hardware_concurrency(), 1u) - 1)
+	{
+		workers.reserve(workerAmount);
+
+		for (size_t i = 0; i < workerAmount; ++i)
+		{
+			workers.emplace_back(&ThreadPool::WorkerLoop, this);
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mux);
+			stopping = true;
+		}
+
+		workCV.notify_all();
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t GetWorkerAmount() const
+	{
+		return workers.size();
+	}
+
+	// Calls func for every index in [0, amount) and returns once all calls are finished.
+	// Order of calls is unspecified, first exception thrown by func is rethrown to the caller
+	void ParallelFor(size_t amount, const std::function<void(size_t)>& func)
+	{
+		if (!amount)
+		{
+			return;
+		}
+
+		if (workers.empty() || amount == 1)
+		{
+			for (size_t i = 0; i < amount; ++i)
+			{
+				func(i);
+			}
+
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mux);
+
+			job = &func;
+			jobAmount = amount;
+			nextJobIndex = 0;
+			busyWorkers = workers.size();
+			jobException = nullptr;
+			++generation;
+		}
+
+		workCV.notify_all();
+
+		ExecuteJobs();
+
+		std::exception_ptr exception;
+
+		{
+			std::unique_lock<std::mutex> lock(mux);
+			doneCV.wait(lock, [this]() { return !busyWorkers; });
+
+			job = nullptr;
+			exception = jobException;
+		}
+
+		if (exception)
+		{
+			std::rethrow_exception(exception);
+		}
+	}
+};
@@ -1,153 +1,361 @@
 #pragma once
 
-#include <memory>
-#include <map>
+#include <deque>
 #include <vector>
+#include <unordered_map>
+#include <iterator>
+#include <cstdint>
+#include <cstddef>
 
+// Nodes are stored in an arena and linked by indices, they never move while the tree exists.
+// Siblings are kept in ascending order of their keys, keys are indexed so lookup does not traverse the tree
 template<typename KeyType, typename ValueType>
 class TreeManager
 {
+	constexpr static uint32_t noNode = UINT32_MAX;
+
 public:
+	class TreeManagerNode;
+
+	// Follows sibling links, so iteration over children allocates nothing
+	class ChildIterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = TreeManagerNode;
+		using difference_type = std::ptrdiff_t;
+		using pointer = TreeManagerNode*;
+		using reference = TreeManagerNode&;
+
+		ChildIterator(TreeManager* tree, uint32_t nodeIndex) : tree(tree), nodeIndex(nodeIndex) {}
+
+		TreeManagerNode& operator*() const { return tree->nodes[nodeIndex]; }
+		TreeManagerNode* operator->() const { return &tree->nodes[nodeIndex]; }
+
+		ChildIterator& operator++()
+		{
+			nodeIndex = tree->nodes[nodeIndex].nextSibling;
+
+			return *this;
+		}
+
+		ChildIterator operator++(int)
+		{
+			ChildIterator res = *this;
+			++(*this);
+
+			return res;
+		}
+
+		bool operator==(const ChildIterator& other) const { return nodeIndex == other.nodeIndex; }
+		bool operator!=(const ChildIterator& other) const { return nodeIndex != other.nodeIndex; }
+
+	private:
+		TreeManager* tree;
+		uint32_t nodeIndex;
+	};
+
+	class ChildRange
+	{
+	public:
+		ChildRange(TreeManager* tree, uint32_t firstIndex) : tree(tree), firstIndex(firstIndex) {}
+
+		ChildIterator begin() const { return ChildIterator(tree, firstIndex); }
+		ChildIterator end() const { return ChildIterator(tree, noNode); }
+		bool empty() const { return firstIndex == noNode; }
+
+	private:
+		TreeManager* tree;
+		uint32_t firstIndex;
+	};
+
 	class TreeManagerNode
 	{
 		friend TreeManager<KeyType, ValueType>;
 
 	public:
 		TreeManagerNode(
+			TreeManager* tree,
+			uint32_t index,
 			const KeyType& key,
 			const ValueType& value,
-			TreeManagerNode* previousNode
-		) : key(key), value(value), previousNode(previousNode) {}
+			uint32_t parentIndex
+		) : tree(tree), index(index), key(key), value(value), parentIndex(parentIndex) {}
 
-		void AddNode(const KeyType& key, const ValueType& value)
+		// Returns the added node, or the child which already has the key
+		TreeManagerNode* AddNode(const KeyType& key, const ValueType& value)
 		{
-			nextNodes.emplace(
-				key,
-				new TreeManagerNode(
-					key,
-					value,
-					this
-				)
-			);
+			return tree->AddNodeImpl(index, key, value);
 		}
 
+		// Searches the subtree of the node, the node itself included
 		TreeManagerNode* FindNodeBy(const KeyType& keyToFind)
 		{
-			if (key == keyToFind)
-			{
-				return this;
-			}
-
-			for (auto& node : nextNodes)
-			{
-				TreeManagerNode* currentNode = node.second->FindNodeBy(keyToFind);
-				if (currentNode)
-				{
-					return currentNode;
-				}
-			}
-
-			return nullptr;
+			return tree->FindNodeImpl(index, keyToFind);
 		}
 
 		void DeleteAllSubnodes()
 		{
-			for (auto& node : nextNodes)
-			{
-				TreeManagerNode* currentNode = node.second;
-				if (currentNode)
-				{
-					currentNode->DeleteAllSubnodes();
-					delete currentNode;
-				}
-			}
-
-			nextNodes.clear();
+			tree->DeleteSubnodesImpl(firstChild);
+			firstChild = noNode;
 		}
 
 		ValueType& GetValue() { return value; };
 		const KeyType& GetKey() { return key; };
 
+		// Copies children into a new vector, GetChildren iterates over them without allocation
 		std::vector<std::pair<KeyType, TreeManagerNode*>> GetChildNodes()
 		{
-			std::vector<std::pair<KeyType, TreeManagerNode*>> res;
+			return tree->CollectChildNodes(firstChild);
+		}
 
-			for (auto& node : nextNodes)
-			{
-				res.push_back(node);
-			}
-			
-			return res;
+		ChildRange GetChildren()
+		{
+			return ChildRange(tree, firstChild);
 		}
 
 		TreeManagerNode* GetParentNode()
 		{
-			return previousNode;
+			return parentIndex != noNode ? &tree->nodes[parentIndex] : nullptr;
 		}
 
 	private:
+		TreeManager* tree;
+		uint32_t index;
 		KeyType key;
 		ValueType value;
-		TreeManagerNode* previousNode;
-		std::map<KeyType, TreeManagerNode*> nextNodes;
+		uint32_t parentIndex;
+		uint32_t firstChild = noNode;
+		uint32_t nextSibling = noNode;
+		// Nodes with equal keys are chained in order of addition
+		uint32_t nextWithSameKey = noNode;
 	};
 
-	void AddRootNode(const KeyType& key, const ValueType& value)
+	TreeManager() = default;
+
+	TreeManager(const TreeManager& other)
+		: nodes(other.nodes), freeNodes(other.freeNodes), keyIndex(other.keyIndex), firstRoot(other.firstRoot)
 	{
-		rootNodes.emplace(
-			key,
-			new TreeManagerNode(key, value, nullptr)
-		);
+		RebindNodes();
 	}
-	
+
+	TreeManager(TreeManager&& other) noexcept
+		: nodes(std::move(other.nodes)), freeNodes(std::move(other.freeNodes)), keyIndex(std::move(other.keyIndex)), firstRoot(other.firstRoot)
+	{
+		other.firstRoot = noNode;
+		RebindNodes();
+	}
+
+	TreeManager& operator=(const TreeManager& other)
+	{
+		if (this != &other)
+		{
+			nodes = other.nodes;
+			freeNodes = other.freeNodes;
+			keyIndex = other.keyIndex;
+			firstRoot = other.firstRoot;
+
+			RebindNodes();
+		}
+
+		return *this;
+	}
+
+	TreeManager& operator=(TreeManager&& other) noexcept
+	{
+		if (this != &other)
+		{
+			nodes = std::move(other.nodes);
+			freeNodes = std::move(other.freeNodes);
+			keyIndex = std::move(other.keyIndex);
+			firstRoot = other.firstRoot;
+			other.firstRoot = noNode;
+
+			RebindNodes();
+		}
+
+		return *this;
+	}
+
+	// Returns the added node, or the root which already has the key
+	TreeManagerNode* AddRootNode(const KeyType& key, const ValueType& value)
+	{
+		return AddNodeImpl(noNode, key, value);
+	}
+
+	// If several nodes have the key, the first added one is returned
 	TreeManagerNode* FindNodeBy(const KeyType& key)
 	{
-		for (auto& node : rootNodes)
+		auto keyIter = keyIndex.find(key);
+
+		return keyIter != keyIndex.end() ? &nodes[keyIter->second] : nullptr;
+	}
+
+	std::vector<std::pair<KeyType, TreeManagerNode*>> GetChildNodes()
+	{
+		return CollectChildNodes(firstRoot);
+	}
+
+	ChildRange GetChildren()
+	{
+		return ChildRange(this, firstRoot);
+	}
+
+private:
+	// Deque grows in blocks and keeps its elements in place, so nodes can be referred to by pointers as well
+	std::deque<TreeManagerNode> nodes;
+	// Slots of deleted nodes, reused by added ones
+	std::vector<uint32_t> freeNodes;
+	// First node added with each key
+	std::unordered_map<KeyType, uint32_t> keyIndex;
+	uint32_t firstRoot = noNode;
+
+	void RebindNodes()
+	{
+		for (auto& node : nodes)
 		{
-			TreeManagerNode* currentNode = node.second->FindNodeBy(key);
-			if (currentNode)
+			node.tree = this;
+		}
+	}
+
+	TreeManagerNode* AddNodeImpl(uint32_t parentIndex, const KeyType& key, const ValueType& value)
+	{
+		uint32_t* link = parentIndex != noNode ? &nodes[parentIndex].firstChild : &firstRoot;
+
+		while (*link != noNode && nodes[*link].key < key)
+		{
+			link = &nodes[*link].nextSibling;
+		}
+
+		if (*link != noNode && !(key < nodes[*link].key))
+		{
+			return &nodes[*link];
+		}
+
+		uint32_t index;
+
+		// Adding to the deque does not move existing nodes, so the link stays valid
+		if (freeNodes.empty())
+		{
+			index = static_cast<uint32_t>(nodes.size());
+			nodes.emplace_back(this, index, key, value, parentIndex);
+		}
+		else
+		{
+			index = freeNodes.back();
+			freeNodes.pop_back();
+			nodes[index] = TreeManagerNode(this, index, key, value, parentIndex);
+		}
+
+		nodes[index].nextSibling = *link;
+		*link = index;
+
+		auto keyIter = keyIndex.find(key);
+
+		if (keyIter == keyIndex.end())
+		{
+			keyIndex.emplace(key, index);
+		}
+		else
+		{
+			uint32_t lastIndex = keyIter->second;
+
+			while (nodes[lastIndex].nextWithSameKey != noNode)
 			{
-				return currentNode;
+				lastIndex = nodes[lastIndex].nextWithSameKey;
 			}
+
+			nodes[lastIndex].nextWithSameKey = index;
 		}
 
-		return nullptr;
+		return &nodes[index];
 	}
 
-	std::vector<std::pair<KeyType, TreeManagerNode*>> GetChildNodes()
+	TreeManagerNode* FindNodeImpl(uint32_t subtreeIndex, const KeyType& key)
 	{
-		std::vector<std::pair<KeyType, TreeManagerNode*>> res;
+		auto keyIter = keyIndex.find(key);
 
-		for (auto& node : rootNodes)
+		if (keyIter == keyIndex.end())
 		{
-			res.push_back(node);
+			return nullptr;
 		}
 
-		return res;
+		// Node is in the subtree if the root of the subtree is one of its ancestors
+		for (uint32_t index = keyIter->second; index != noNode; index = nodes[index].nextWithSameKey)
+		{
+			for (uint32_t ancestorIndex = index; ancestorIndex != noNode; ancestorIndex = nodes[ancestorIndex].parentIndex)
+			{
+				if (ancestorIndex == subtreeIndex)
+				{
+					return &nodes[index];
+				}
+			}
+		}
+
+		return nullptr;
 	}
 
-	~TreeManager()
+	void DeleteSubnodesImpl(uint32_t firstIndex)
 	{
-		DeleteAllSubnodes();
-	}
+		std::vector<uint32_t> nodesToDelete;
 
-private:
-	std::map<KeyType, TreeManagerNode*> rootNodes;
+		for (uint32_t index = firstIndex; index != noNode; index = nodes[index].nextSibling)
+		{
+			nodesToDelete.push_back(index);
+		}
+
+		while (!nodesToDelete.empty())
+		{
+			uint32_t index = nodesToDelete.back();
+			nodesToDelete.pop_back();
+
+			for (uint32_t childIndex = nodes[index].firstChild; childIndex != noNode; childIndex = nodes[childIndex].nextSibling)
+			{
+				nodesToDelete.push_back(childIndex);
+			}
+
+			RemoveFromKeyIndex(index);
+			freeNodes.push_back(index);
+		}
+	}
 
-	void DeleteAllSubnodes()
+	void RemoveFromKeyIndex(uint32_t index)
 	{
-		for (auto& node : rootNodes)
+		auto keyIter = keyIndex.find(nodes[index].key);
+
+		if (keyIter->second == index)
 		{
-			TreeManagerNode* currentNode = node.second;
-			if (currentNode)
+			if (nodes[index].nextWithSameKey != noNode)
+			{
+				keyIter->second = nodes[index].nextWithSameKey;
+			}
+			else
 			{
-				currentNode->DeleteAllSubnodes();
-				delete currentNode;
+				keyIndex.erase(keyIter);
 			}
+
+			return;
 		}
 
-		rootNodes.clear();
-		
+		uint32_t previousIndex = keyIter->second;
+
+		while (nodes[previousIndex].nextWithSameKey != index)
+		{
+			previousIndex = nodes[previousIndex].nextWithSameKey;
+		}
+
+		nodes[previousIndex].nextWithSameKey = nodes[index].nextWithSameKey;
 	}
-};
 
+	std::vector<std::pair<KeyType, TreeManagerNode*>> CollectChildNodes(uint32_t firstIndex)
+	{
+		std::vector<std::pair<KeyType, TreeManagerNode*>> res;
+
+		for (uint32_t index = firstIndex; index != noNode; index = nodes[index].nextSibling)
+		{
+			res.emplace_back(nodes[index].key, &nodes[index]);
+		}
+
+		return res;
+	}
+};
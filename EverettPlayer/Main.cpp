@@ -16,19 +16,43 @@ struct Config
 	bool fullscreenForce;
 	bool debugText;
 	bool defaultWASD;
+	bool dynamicResolution = false;
+	float targetFrameTime = 16.6f;
+	float minResolutionScale = 0.5f;
+	bool sharpenUpscale = false;
+	int frameLimit = 0;
+	bool adaptiveVSync = false;
+	bool frameTimeReport = false;
+	bool depthPrePass = false;
+	bool preSkinning = false;
+	int gpuMemoryBudget = 0;
+	float animationLODDistance = 0.0f;
+	bool dualQuatBones = false;
 };
 
 void ReadConfigFile(Config& config)
 {
 	stdEx::map<std::string, int> expectedKeys;
 
-	expectedKeys.emplace("WindowWidth",     0);
-	expectedKeys.emplace("WindowHeight",    1);
-	expectedKeys.emplace("WindowTitle",     2);
-	expectedKeys.emplace("StartSave",       3);
-	expectedKeys.emplace("FullscreenForce", 4);
-	expectedKeys.emplace("DebugText",       5);
-	expectedKeys.emplace("DefaultWASD",     6);
+	expectedKeys.emplace("WindowWidth",        0);
+	expectedKeys.emplace("WindowHeight",       1);
+	expectedKeys.emplace("WindowTitle",        2);
+	expectedKeys.emplace("StartSave",          3);
+	expectedKeys.emplace("FullscreenForce",    4);
+	expectedKeys.emplace("DebugText",          5);
+	expectedKeys.emplace("DefaultWASD",        6);
+	expectedKeys.emplace("DynamicResolution",  7);
+	expectedKeys.emplace("TargetFrameTime",    8);
+	expectedKeys.emplace("MinResolutionScale", 9);
+	expectedKeys.emplace("SharpenUpscale",     10);
+	expectedKeys.emplace("FrameLimit",         11);
+	expectedKeys.emplace("AdaptiveVSync",      12);
+	expectedKeys.emplace("FrameTimeReport",    13);
+	expectedKeys.emplace("DepthPrePass",       14);
+	expectedKeys.emplace("PreSkinning",        15);
+	expectedKeys.emplace("GPUMemoryBudget",    16);
+	expectedKeys.emplace("AnimationLODDistance", 17);
+	expectedKeys.emplace("DualQuatBones",      18);
 ;
 	expectedKeys.SetDefaultValue(-1);
 
@@ -66,6 +90,42 @@ void ReadConfigFile(Config& config)
 			case 6:
 				config.defaultWASD = std::stoi(value);
 				break;
+			case 7:
+				config.dynamicResolution = std::stoi(value);
+				break;
+			case 8:
+				config.targetFrameTime = std::stof(value);
+				break;
+			case 9:
+				config.minResolutionScale = std::stof(value);
+				break;
+			case 10:
+				config.sharpenUpscale = std::stoi(value);
+				break;
+			case 11:
+				config.frameLimit = std::stoi(value);
+				break;
+			case 12:
+				config.adaptiveVSync = std::stoi(value);
+				break;
+			case 13:
+				config.frameTimeReport = std::stoi(value);
+				break;
+			case 14:
+				config.depthPrePass = std::stoi(value);
+				break;
+			case 15:
+				config.preSkinning = std::stoi(value);
+				break;
+			case 16:
+				config.gpuMemoryBudget = std::stoi(value);
+				break;
+			case 17:
+				config.animationLODDistance = std::stof(value);
+				break;
+			case 18:
+				config.dualQuatBones = std::stoi(value);
+				break;
 			}
 		}
 	}
@@ -93,6 +153,30 @@ int main(int argc, char* argv[])
 		{
 			engine.SetDefaultWASDControls();
 		}
+
+		if (config.dynamicResolution)
+		{
+			engine.SetDynamicResolution(
+				true, 
+				config.targetFrameTime, 
+				config.minResolutionScale, 
+				config.sharpenUpscale
+			);
+		}
+
+		engine.SetFrameLimit(config.frameLimit);
+		engine.EnableAdaptiveVSync(config.adaptiveVSync);
+		engine.EnableFrameTimeReport(config.frameTimeReport);
+		engine.EnableDepthPrePass(config.depthPrePass);
+		engine.EnablePreSkinning(config.preSkinning);
+		engine.SetGPUMemoryBudget(config.gpuMemoryBudget);
+		// Each following level starts twice as far
+		engine.SetAnimationLOD(
+			config.animationLODDistance, 
+			config.animationLODDistance * 2.0f, 
+			config.animationLODDistance * 4.0f
+		);
+		engine.EnableDualQuaternionBones(config.dualQuatBones);
 		
 		engine.LoadDataFromFile(config.startSave);
 		engine.RunRenderWindow();
@@ -2,11 +2,13 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
 #include <cctype>
 #include <array>
 #include <chrono>
 
 #include "LGLUniformHasher.h"
+#include "LGLFramePacer.h"
 
 #define LGL_EXPORT
 #include "LGL.h"
@@ -16,15 +18,13 @@
 #include <GLFW/glfw3.h>
 
 #include "GLExecutor.h"
+#include "LGLResourceTracker.h"
+#include "LGLCommandQueue.h"
 
 #include "LGLKeyToStringMap.h"
 
 #include "ContextManager.h"
 #define ContextLock ContextManager<GLFWwindow> mux(window, [this](GLFWwindow* context){ glfwMakeContextCurrent(context); });
-#define HandshakeContextLock \
-PauseRendering(); \
-ContextLock \
-PauseRendering(false);
 std::recursive_mutex ContextManager<GLFWwindow>::rMutex;
 size_t ContextManager<GLFWwindow>::counter = 0;
 
@@ -39,6 +39,43 @@ std::map<std::string, LGL::ShaderType> LGL::shaderTypeChoice =
 	{"geom", GL_GEOMETRY_SHADER},
 };
 
+const std::string LGL::upscaleShaderProgram = "LGLUpscale";
+
+const std::map<std::string, std::string> LGL::upscaleShaderCodes =
+{
+	{"vert",
+		"#version 330 core\n"
+		"out vec2 TexCoords;\n"
+		"uniform vec2 uvScale;\n"
+		"void main()\n"
+		"{\n"
+		"	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+		"	TexCoords = pos * uvScale;\n"
+		"	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+		"}\n"
+	},
+	{"frag",
+		"#version 330 core\n"
+		"in vec2 TexCoords;\n"
+		"out vec4 FragColor;\n"
+		"uniform sampler2D sceneTexture;\n"
+		"uniform vec2 uvScale;\n"
+		"uniform vec2 texelSize;\n"
+		"uniform float sharpness;\n"
+		"vec3 SampleScene(vec2 offset)\n"
+		"{\n"
+		"	return texture(sceneTexture, clamp(TexCoords + offset, texelSize * 0.5, uvScale - texelSize * 0.5)).rgb;\n"
+		"}\n"
+		"void main()\n"
+		"{\n"
+		"	vec3 center = SampleScene(vec2(0.0));\n"
+		"	vec3 neighbours = SampleScene(vec2(texelSize.x, 0.0)) + SampleScene(vec2(-texelSize.x, 0.0)) +\n"
+		"	                  SampleScene(vec2(0.0, texelSize.y)) + SampleScene(vec2(0.0, -texelSize.y));\n"
+		"	FragColor = vec4(clamp(center + sharpness * (4.0 * center - neighbours), 0.0, 1.0), 1.0);\n"
+		"}\n"
+	}
+};
+
 const std::vector<int> LGL::LGLEnumInterpreter::DepthTestModeInter =
 {
 	{0, GL_ALWAYS, GL_NEVER, GL_LESS, GL_GREATER, GL_EQUAL, GL_NOTEQUAL, GL_LEQUAL, GL_GEQUAL}
@@ -55,13 +92,28 @@ LGL::LGL()
 	windowWidth = -1;
 	windowHeight = -1;
 	currentVAOToRender = {};
+	currentModelInfoToRender = nullptr;
+	currentMeshIndexToRender = 0;
+	meshRenderedByBehaviour = false;
 	window = nullptr;
 	pauseRendering = false;
 	stopRendering = false;
+	depthTestMode = DepthTestMode::Less;
+	useDepthPrePass = false;
+	depthPrePassActive = false;
+	depthEqualStateSet = false;
 	uniformHasher = std::make_unique<LGLUniformHasher>();
 	batchUniformVals = true;
 	hashUniformVals = true;
 	useVSync = true;
+	useAdaptiveVSync = false;
+	appliedSwapInterval = -2;
+	frameTimeReport = false;
+	framePacer = std::make_unique<LGLFramePacer>();
+	resourceTracker = std::make_unique<LGLResourceTracker>();
+	commandQueue = std::make_unique<LGLCommandQueue>();
+	renderThreadId = std::thread::id();
+	inPlaceExecutorId = std::thread::id();
 	renderDeltaTime = 1.0f;
 	renderTextVOCreated = false;
 
@@ -84,7 +136,7 @@ LGL::~LGL()
 
 void LGL::DeleteGLObjects()
 {
-	HandshakeContextLock
+	ContextLock
 
 	GLSafeExecute(glBindVertexArray, 0);
 	GLSafeExecute(glBindBuffer, GL_ARRAY_BUFFER, 0);
@@ -94,46 +146,36 @@ void LGL::DeleteGLObjects()
 	
 	for (auto& model : internalModelMap)
 	{
-		for (auto& VAO : model.second.VAOs)
-		{
-			GLSafeExecute(glDeleteVertexArrays, 1, &VAO.vboId);
-		}
-		for (auto& texture : model.second.textureIDs)
-		{
-			GLSafeExecute(glDeleteTextures, 1, &texture.second);
-		}
+		ReleaseModelResources(model.second);
 	}
 	internalModelMap.clear();
+	sharedTextures.clear();
+
+	for (auto& evictedTexture : memoryResidency.evictedTextures)
+	{
+		resourceTracker->Release(LGLResourceTracker::ResourceType::Texture, evictedTexture.second.placeholderID);
+	}
+	memoryResidency.evictedTextures.clear();
+	memoryResidency.textureUploadQueue.clear();
+	memoryResidency.modelUploadQueue.clear();
 	internalTextMap.clear();
 
 	for (auto& fontAndChars : collectionToCharTextures)
 	{
 		for (auto& chars : fontAndChars.second)
 		{
-			GLSafeExecute(glDeleteTextures, 1, &chars.second);
+			resourceTracker->Release(LGLResourceTracker::ResourceType::Texture, chars.second);
 		}
 	}
 	collectionToCharTextures.clear();
 
 	if (renderTextVOCreated)
 	{
-		GLSafeExecute(glDeleteVertexArrays, 1, &renderTextVAO);
-		GLSafeExecute(glDeleteBuffers, 1, &renderTextVBO);
+		resourceTracker->Release(LGLResourceTracker::ResourceType::VertexArray, renderTextVAO);
+		resourceTracker->Release(LGLResourceTracker::ResourceType::Buffer, renderTextVBO);
 		renderTextVOCreated = false;
 	}
 
-	for (auto& VBO : VBOCollection)
-	{
-		GLSafeExecute(glDeleteBuffers, 1, &VBO);
-	}
-	VBOCollection.clear();
-
-	for (auto& EBO : EBOCollection)
-	{
-		GLSafeExecute(glDeleteBuffers, 1, &EBO);
-	}
-	EBOCollection.clear();
-
 	for (auto& shaderInfo : shaderInfoCollection)
 	{
 		for (auto& shader : shaderInfo.second)
@@ -145,7 +187,7 @@ void LGL::DeleteGLObjects()
 
 	for (auto& shaderProgram : shaderProgramCollection)
 	{
-		GLSafeExecute(glDeleteProgram, shaderProgram.second);
+		resourceTracker->Release(LGLResourceTracker::ResourceType::ShaderProgram, shaderProgram.second);
 	}
 	shaderProgramCollection.clear();
 
@@ -154,6 +196,59 @@ void LGL::DeleteGLObjects()
 		uniformHasher->ResetHasher();
 	}
 	lastProgram.clear();
+
+	DeleteDynamicResolutionBuffers();
+	DeleteTextureBuffers();
+
+	// Everything known to LGL is released by now, whatever stays alive was never released by its owner
+	resourceTracker->CollectGarbage(true);
+
+	if (resourceTracker->GetAliveAmount())
+	{
+		std::cerr << "LGL resource leak, " << resourceTracker->GetAliveAmount() << " GL object(s) alive after cleanup:\n"
+			<< resourceTracker->GetReport();
+	}
+}
+
+bool LGL::CanQueueCommands()
+{
+	std::thread::id renderThread = renderThreadId;
+
+	return renderThread != std::thread::id() && renderThread != std::this_thread::get_id() && !pauseRendering;
+}
+
+template<typename Func>
+auto LGL::ExecuteOnRenderThread(Func&& func) -> std::future<decltype(func())>
+{
+	using ResultType = decltype(func());
+
+	auto task = std::make_shared<std::packaged_task<ResultType()>>(std::forward<Func>(func));
+	std::future<ResultType> result = task->get_future();
+
+	std::thread::id currentThread = std::this_thread::get_id();
+
+	// Render thread and a thread draining the queue in place already own the context,
+	// this also covers commands issued from inside other commands
+	if (currentThread == renderThreadId || currentThread == inPlaceExecutorId)
+	{
+		(*task)();
+		return result;
+	}
+
+	commandQueue->Push([task]() { (*task)(); });
+
+	// Without running and unpaused rendering cycle the queue is drained in place,
+	// which keeps the order of commands queued by other threads
+	if (!CanQueueCommands())
+	{
+		ContextLock
+
+		inPlaceExecutorId = currentThread;
+		commandQueue->Drain();
+		inPlaceExecutorId = std::thread::id();
+	}
+
+	return result;
 }
 
 bool LGL::CreateWindow(const int width, const int height, const std::string& title, bool fullscreen)
@@ -252,26 +347,40 @@ void LGL::TerminateOpenGL()
 
 void LGL::SetDepthTest(DepthTestMode depthTestMode)
 {
-	HandshakeContextLock
+	ExecuteOnRenderThread([this, depthTestMode]() {
+		this->depthTestMode = depthTestMode;
 
-	if (depthTestMode == DepthTestMode::Disable)
-	{
-		GLSafeExecute(glDisable, GL_DEPTH_TEST);
-	}
-	else
-	{
-		GLSafeExecute(glEnable, GL_DEPTH_TEST);
-		GLSafeExecute(glDepthFunc, static_cast<GLenum>(LGLEnumInterpreter::DepthTestModeInter[static_cast<GLenum>(depthTestMode)]));
-	}
+		if (depthTestMode == DepthTestMode::Disable)
+		{
+			GLSafeExecute(glDisable, GL_DEPTH_TEST);
+		}
+		else
+		{
+			GLSafeExecute(glEnable, GL_DEPTH_TEST);
+			GLSafeExecute(glDepthFunc, static_cast<GLenum>(LGLEnumInterpreter::DepthTestModeInter[static_cast<GLenum>(depthTestMode)]));
+		}
+	});
 }
 
-void LGL::CaptureMouse(bool value)
+void LGL::EnableDepthPrePass(bool value)
+{
+	useDepthPrePass = value;
+
+	std::cout << "Depth pre-pass has been set to " << value << '\n';
+}
+
+bool LGL::IsDepthPrePassActive()
 {
-	HandshakeContextLock
+	return depthPrePassActive;
+}
 
-	glfwSetInputMode(window, GLFW_CURSOR, value ? GLFW_CURSOR_DISABLED : GLFW_CURSOR_NORMAL);
+void LGL::CaptureMouse(bool value)
+{
+	ExecuteOnRenderThread([this, value]() {
+		glfwSetInputMode(window, GLFW_CURSOR, value ? GLFW_CURSOR_DISABLED : GLFW_CURSOR_NORMAL);
 
-	std::cout << "Mouse has been captured\n";
+		std::cout << "Mouse has been captured\n";
+	});
 }
 
 void LGL::SetFramebufferSizeCallback(std::function<void(int, int)> callbackFunc)
@@ -314,14 +423,14 @@ void LGL::SetRenderDeltaCallback(std::function<void(float)> callbackFunc)
 
 int LGL::GetMaxAmountOfVertexAttr()
 {
-	HandshakeContextLock
-
-	int attr;
-	GLSafeExecute(glGetIntegerv, GL_MAX_VERTEX_ATTRIBS, &attr);
+	return ExecuteOnRenderThread([this]() {
+		int attr;
+		GLSafeExecute(glGetIntegerv, GL_MAX_VERTEX_ATTRIBS, &attr);
 	
-	std::cout << "Max amount of vertex attributes: " << attr << '\n';
+		std::cout << "Max amount of vertex attributes: " << attr << '\n';
 	
-	return attr;
+		return attr;
+	}).get();
 }
 
 void LGL::ProcessInput()
@@ -371,6 +480,325 @@ void LGL::EnableVSync(bool value)
 	useVSync = value;
 }
 
+// Pacer and dynamic resolution state is used by render thread every frame, so it is only changed there
+void LGL::EnableAdaptiveVSync(bool value)
+{
+	ExecuteOnRenderThread([this, value]() {
+		useAdaptiveVSync = value;
+	});
+}
+
+void LGL::SetFrameLimit(int targetFPS)
+{
+	ExecuteOnRenderThread([this, targetFPS]() {
+		framePacer->SetTargetFPS(targetFPS);
+	});
+
+	std::cout << "Frame limit has been set to " << targetFPS << '\n';
+}
+
+void LGL::EnableFrameTimeReport(bool value, float reportPeriod)
+{
+	ExecuteOnRenderThread([this, value, reportPeriod]() {
+		frameTimeReport = value;
+		framePacer->SetReportPeriod(reportPeriod);
+	});
+}
+
+LGLStructs::FrameTimeStats LGL::GetFrameTimeStats()
+{
+	return ExecuteOnRenderThread([this]() {
+		return framePacer->GetFrameTimeStats();
+	}).get();
+}
+
+void LGL::ApplySwapInterval()
+{
+	int swapInterval = 0;
+
+	if (useVSync)
+	{
+		static const bool swapTearSupported =
+			glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+
+		swapInterval = useAdaptiveVSync && swapTearSupported ? -1 : 1;
+	}
+
+	// Swap interval change is not free on some drivers, so it is only set when changed
+	if (swapInterval != appliedSwapInterval)
+	{
+		glfwSwapInterval(swapInterval);
+		appliedSwapInterval = swapInterval;
+	}
+}
+
+void LGL::PaceFrame()
+{
+	float frameTime = framePacer->WaitForNextFrame();
+
+	if (frameTime > 0.0f)
+	{
+		renderDeltaTime = frameTime;
+
+		if (renderTimeCallbackFunc)
+		{
+			renderTimeCallbackFunc(renderDeltaTime);
+		}
+	}
+
+	if (frameTimeReport && framePacer->CheckAndResetReportUpdate())
+	{
+		const FrameTimeStats& stats = framePacer->GetFrameTimeStats();
+
+		std::cout 
+			<< "Frame time: avg " << stats.averageFrameTime * 1000.0f << " ms, "
+			<< "std dev " << std::sqrt(stats.frameTimeVariance) * 1000.0f << " ms, "
+			<< "min " << stats.minFrameTime * 1000.0f << " ms, "
+			<< "max " << stats.maxFrameTime * 1000.0f << " ms\n";
+	}
+}
+
+void LGL::EnableDynamicResolution(bool value)
+{
+	ExecuteOnRenderThread([this, value]() {
+		dynamicResolution.enabled = value;
+		dynamicResolution.currentScale = dynamicResolution.maxScale;
+		dynamicResolution.averageGPUFrameTime = 0.0f;
+	});
+
+	std::cout << "Dynamic resolution has been set to " << value << '\n';
+}
+
+void LGL::SetDynamicResolutionParams(float targetFrameTimeMs, float minScale, float maxScale)
+{
+	if (targetFrameTimeMs <= 0.0f || minScale <= 0.0f || minScale > maxScale)
+	{
+		std::cerr << "Invalid dynamic resolution parameters\n";
+		return;
+	}
+
+	ExecuteOnRenderThread([this, targetFrameTimeMs, minScale, maxScale]() {
+		dynamicResolution.targetFrameTime = targetFrameTimeMs / 1000.0f;
+		dynamicResolution.minScale = minScale;
+		dynamicResolution.maxScale = maxScale;
+		dynamicResolution.currentScale = glm::clamp(dynamicResolution.currentScale, minScale, maxScale);
+		dynamicResolution.buffersOutdated = true;
+	});
+}
+
+void LGL::SetUpscaleFilter(UpscaleFilter upscaleFilter, float sharpness)
+{
+	ExecuteOnRenderThread([this, upscaleFilter, sharpness]() {
+		dynamicResolution.upscaleFilter = upscaleFilter;
+		dynamicResolution.sharpness = sharpness;
+	});
+}
+
+float LGL::GetCurrentResolutionScale()
+{
+	return ExecuteOnRenderThread([this]() {
+		return dynamicResolution.enabled ? dynamicResolution.currentScale : 1.0f;
+	}).get();
+}
+
+bool LGL::CreateDynamicResolutionBuffers()
+{
+	DeleteDynamicResolutionBuffers();
+
+	auto& dr = dynamicResolution;
+
+	dr.bufferWidth = std::max(1, static_cast<int>(std::ceil(windowWidth * dr.maxScale)));
+	dr.bufferHeight = std::max(1, static_cast<int>(std::ceil(windowHeight * dr.maxScale)));
+
+	// Both attachments take 4 bytes per pixel
+	size_t attachmentByteSize = static_cast<size_t>(dr.bufferWidth) * dr.bufferHeight * 4;
+
+	GLSafeExecute(glGenFramebuffers, 1, &dr.framebuffer);
+	GLSafeExecute(glBindFramebuffer, GL_FRAMEBUFFER, dr.framebuffer);
+	resourceTracker->Register(LGLResourceTracker::ResourceType::Framebuffer, dr.framebuffer, 0, "Dynamic resolution");
+
+	GLSafeExecute(glGenTextures, 1, &dr.colorTexture);
+	GLSafeExecute(glBindTexture, GL_TEXTURE_2D, dr.colorTexture);
+	resourceTracker->Register(
+		LGLResourceTracker::ResourceType::Texture, dr.colorTexture, attachmentByteSize, "Dynamic resolution color"
+	);
+	GLSafeExecute(
+		glTexImage2D, GL_TEXTURE_2D, 0, GL_RGBA8, dr.bufferWidth, dr.bufferHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr
+	);
+	GLSafeExecute(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	GLSafeExecute(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	GLSafeExecute(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	GLSafeExecute(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	GLSafeExecute(glBindTexture, GL_TEXTURE_2D, 0);
+	GLSafeExecute(glFramebufferTexture2D, GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dr.colorTexture, 0);
+
+	GLSafeExecute(glGenRenderbuffers, 1, &dr.depthRenderbuffer);
+	GLSafeExecute(glBindRenderbuffer, GL_RENDERBUFFER, dr.depthRenderbuffer);
+	resourceTracker->Register(
+		LGLResourceTracker::ResourceType::Renderbuffer, dr.depthRenderbuffer, attachmentByteSize, "Dynamic resolution depth"
+	);
+	GLSafeExecute(glRenderbufferStorage, GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, dr.bufferWidth, dr.bufferHeight);
+	GLSafeExecute(glBindRenderbuffer, GL_RENDERBUFFER, 0);
+	GLSafeExecute(
+		glFramebufferRenderbuffer, GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, dr.depthRenderbuffer
+	);
+
+	bool framebufferComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	GLSafeExecute(glBindFramebuffer, GL_FRAMEBUFFER, 0);
+
+	if (!framebufferComplete)
+	{
+		std::cerr << "Dynamic resolution framebuffer is not complete, disabling dynamic resolution\n";
+		DeleteDynamicResolutionBuffers();
+		dr.enabled = false;
+		return false;
+	}
+
+	GLSafeExecute(glGenQueries, static_cast<int>(dr.timerQueries.size()), dr.timerQueries.data());
+	std::fill(dr.queryIssued.begin(), dr.queryIssued.end(), false);
+
+	GLSafeExecute(glGenVertexArrays, 1, &dr.upscaleVAO);
+	resourceTracker->Register(LGLResourceTracker::ResourceType::VertexArray, dr.upscaleVAO, 0, "Upscale");
+
+	if (shaderProgramCollection.find(upscaleShaderProgram) == shaderProgramCollection.end())
+	{
+		LoadAndCompileShaderFromCode(upscaleShaderProgram, upscaleShaderCodes);
+	}
+
+	dr.buffersOutdated = false;
+
+	std::cout << "Dynamic resolution framebuffer " << dr.bufferWidth << 'x' << dr.bufferHeight << " created\n";
+
+	return true;
+}
+
+void LGL::DeleteDynamicResolutionBuffers()
+{
+	auto& dr = dynamicResolution;
+
+	if (!dr.framebuffer)
+	{
+		return;
+	}
+
+	// Objects are deleted once frames which still use them are done on GPU
+	resourceTracker->Release(LGLResourceTracker::ResourceType::Framebuffer, dr.framebuffer);
+	resourceTracker->Release(LGLResourceTracker::ResourceType::Texture, dr.colorTexture);
+	resourceTracker->Release(LGLResourceTracker::ResourceType::Renderbuffer, dr.depthRenderbuffer);
+	resourceTracker->Release(LGLResourceTracker::ResourceType::VertexArray, dr.upscaleVAO);
+	GLSafeExecute(glDeleteQueries, static_cast<int>(dr.timerQueries.size()), dr.timerQueries.data());
+
+	dr.framebuffer = 0;
+	dr.colorTexture = 0;
+	dr.depthRenderbuffer = 0;
+	dr.upscaleVAO = 0;
+	dr.timerQueries = {};
+	dr.buffersOutdated = true;
+}
+
+bool LGL::BeginDynamicResolutionFrame()
+{
+	auto& dr = dynamicResolution;
+
+	if (dr.buffersOutdated && !CreateDynamicResolutionBuffers())
+	{
+		return false;
+	}
+
+	dr.renderWidth = glm::clamp(static_cast<int>(windowWidth * dr.currentScale), 1, dr.bufferWidth);
+	dr.renderHeight = glm::clamp(static_cast<int>(windowHeight * dr.currentScale), 1, dr.bufferHeight);
+
+	GLSafeExecute(glBindFramebuffer, GL_FRAMEBUFFER, dr.framebuffer);
+	GLSafeExecute(glViewport, 0, 0, dr.renderWidth, dr.renderHeight);
+
+	GLSafeExecute(glBeginQuery, GL_TIME_ELAPSED, dr.timerQueries[dr.currentQuery]);
+
+	return true;
+}
+
+void LGL::EndDynamicResolutionFrame()
+{
+	auto& dr = dynamicResolution;
+
+	GLSafeExecute(glEndQuery, GL_TIME_ELAPSED);
+	dr.queryIssued[dr.currentQuery] = true;
+	dr.currentQuery = (dr.currentQuery + 1) % dr.timerQueries.size();
+
+	if (dr.queryIssued[dr.currentQuery])
+	{
+		int resultAvailable = 0;
+		GLSafeExecute(glGetQueryObjectiv, dr.timerQueries[dr.currentQuery], GL_QUERY_RESULT_AVAILABLE, &resultAvailable);
+
+		if (resultAvailable)
+		{
+			GLuint64 elapsedTime = 0;
+			GLSafeExecute(glGetQueryObjectui64v, dr.timerQueries[dr.currentQuery], GL_QUERY_RESULT, &elapsedTime);
+			dr.queryIssued[dr.currentQuery] = false;
+
+			UpdateResolutionScale(static_cast<float>(elapsedTime) / 1e9f);
+		}
+	}
+
+	if (dr.upscaleFilter == UpscaleFilter::Sharpened && 
+		shaderProgramCollection.find(upscaleShaderProgram) != shaderProgramCollection.end())
+	{
+		GLSafeExecute(glBindFramebuffer, GL_FRAMEBUFFER, 0);
+		GLSafeExecute(glViewport, 0, 0, windowWidth, windowHeight);
+
+		GLboolean depthTestEnabled = glIsEnabled(GL_DEPTH_TEST);
+		GLSafeExecute(glDisable, GL_DEPTH_TEST);
+
+		glm::vec2 bufferSize(static_cast<float>(dr.bufferWidth), static_cast<float>(dr.bufferHeight));
+
+		SetShaderUniformValue("sceneTexture", 0, upscaleShaderProgram);
+		SetShaderUniformValue("uvScale", glm::vec2(dr.renderWidth, dr.renderHeight) / bufferSize);
+		SetShaderUniformValue("texelSize", 1.0f / bufferSize);
+		SetShaderUniformValue("sharpness", dr.sharpness);
+
+		GLSafeExecute(glActiveTexture, GL_TEXTURE0);
+		GLSafeExecute(glBindTexture, GL_TEXTURE_2D, dr.colorTexture);
+		GLSafeExecute(glBindVertexArray, dr.upscaleVAO);
+		GLSafeExecute(glDrawArrays, GL_TRIANGLES, 0, 3);
+		GLSafeExecute(glBindTexture, GL_TEXTURE_2D, 0);
+		uniformLocationTracker.clear();
+
+		if (depthTestEnabled)
+		{
+			GLSafeExecute(glEnable, GL_DEPTH_TEST);
+		}
+	}
+	else
+	{
+		GLSafeExecute(glBindFramebuffer, GL_READ_FRAMEBUFFER, dr.framebuffer);
+		GLSafeExecute(glBindFramebuffer, GL_DRAW_FRAMEBUFFER, 0);
+		GLSafeExecute(
+			glBlitFramebuffer,
+			0, 0, dr.renderWidth, dr.renderHeight,
+			0, 0, windowWidth, windowHeight,
+			GL_COLOR_BUFFER_BIT, GL_LINEAR
+		);
+		GLSafeExecute(glBindFramebuffer, GL_FRAMEBUFFER, 0);
+		GLSafeExecute(glViewport, 0, 0, windowWidth, windowHeight);
+	}
+}
+
+void LGL::UpdateResolutionScale(float gpuFrameTime)
+{
+	auto& dr = dynamicResolution;
+
+	dr.averageGPUFrameTime = 
+		dr.averageGPUFrameTime == 0.0f ? gpuFrameTime : glm::mix(dr.averageGPUFrameTime, gpuFrameTime, 0.1f);
+
+	// Amount of rendered pixels, thus the cost of the frame, grows quadratically with the scale
+	float desiredScale = dr.currentScale * std::sqrt(dr.targetFrameTime / std::max(dr.averageGPUFrameTime, 1e-6f));
+
+	// Small deviations are ignored, so the resolution does not flicker between frames
+	if (std::abs(desiredScale - dr.currentScale) > 0.02f)
+	{
+		dr.currentScale = glm::clamp(glm::mix(dr.currentScale, desiredScale, 0.25f), dr.minScale, dr.maxScale);
+	}
+}
+
 void LGL::RenderText()
 {
 	ContextLock
@@ -449,70 +877,195 @@ void LGL::Render()
 	}
 }
 
-void LGL::RunRenderingCycle(std::function<void()> additionalSteps)
+bool LGL::RenderDepthPrePass()
 {
-	std::array<int, Texture::GetTextureTypeAmount()> textureTypesToUnbind;
-	std::fill(textureTypesToUnbind.begin(), textureTypesToUnbind.end(), false);
+	bool anyModelRendered = false;
 
-	while (!(stopRendering || glfwWindowShouldClose(window)))
+	depthPrePassActive = true;
+
+	GLSafeExecute(glColorMask, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	for (auto& currentModelToProcess : internalModelMap)
 	{
-		if (pauseRendering)
+		if (currentModelToProcess.second.evicted || currentModelToProcess.second.uploading)
 		{
-			std::unique_lock<std::mutex> pauseLock(pauserMux);
-			pauser.wait(pauseLock, [this]() { return !pauseRendering; });
+			continue;
 		}
 
-		ContextLock
-
-		std::chrono::system_clock::time_point renderStartTime = std::chrono::system_clock::now();
-		glfwSwapInterval(useVSync);
+		LGLStructs::ModelInfo& modelInfo = *currentModelToProcess.second.modelPtr;
 
-		ProcessInput();
-		glfwPollEvents();
+		currentModelToProcess.second.renderedInDepthPrePass = 
+			!modelInfo.depthShaderProgram.empty() && 
+			SetCurrentShaderProg(modelInfo.depthShaderProgram) != ~ShaderProgram{};
 
-		GLSafeExecute(glClearColor, background.r, background.g, background.b, background.a);
-		GLSafeExecute(glClear, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (!currentModelToProcess.second.renderedInDepthPrePass)
+		{
+			continue;
+		}
 
-		if (additionalSteps)
+		if (modelInfo.modelBehaviour)
 		{
-			additionalSteps();
+			modelInfo.modelBehaviour();
 		}
 
-		for (auto& currentModelToProcess : internalModelMap)
+		for (size_t meshIndex = 0; meshIndex < currentModelToProcess.second.VAOs.size(); ++meshIndex)
 		{
-			SetCurrentShaderProg(currentModelToProcess.second.modelPtr->shaderProgram);
+			auto& currentVAO = currentModelToProcess.second.VAOs[meshIndex];
 
-			std::function<void()>& modelBeh = currentModelToProcess.second.modelPtr->modelBehaviour;
-			if (modelBeh)
+			if (currentVAO.meshInfo->render)
 			{
-				modelBeh();
-			}
+				currentVAOToRender = currentVAO;
+				currentModelInfoToRender = &currentModelToProcess.second;
+				currentMeshIndexToRender = meshIndex;
+				meshRenderedByBehaviour = false;
 
-			for (size_t meshIndex = 0; meshIndex < currentModelToProcess.second.VAOs.size(); ++meshIndex)
-			{
-				auto& currentVAO = currentModelToProcess.second.VAOs[meshIndex];
+				GLSafeExecute(glBindVertexArray, currentVAO.vboId);
 
-				if (currentVAO.meshInfo->render)
+				std::function<void(int)>& behaviourToCheck = currentVAO.meshInfo->behaviour;
+				if (behaviourToCheck)
 				{
-					currentVAOToRender = currentVAO;
+					behaviourToCheck(static_cast<int>(meshIndex));
+				}
 
-					SetCurrentShaderProg(currentVAO.meshInfo->shaderProgram);
+				if (!meshRenderedByBehaviour)
+				{
+					Render();
+				}
 
-					GLSafeExecute(glBindVertexArray, currentVAO.vboId);
+				anyModelRendered = true;
+			}
+		}
 
-					for (auto& texture : currentVAO.meshInfo->mesh.textures)
-					{
-						auto currentTextureIter = currentModelToProcess.second.textureIDs.find(texture.name);
-						if (currentTextureIter != currentModelToProcess.second.textureIDs.end())
-						{
-							TextureID textureID = (*currentTextureIter).second;
-							int convertedTextureType = static_cast<int>(texture.type);
-							GLSafeExecute(glActiveTexture, GL_TEXTURE0 + convertedTextureType);
-							GLSafeExecute(glBindTexture, GL_TEXTURE_2D, textureID);
+		currentVAOToRender = {};
+		currentModelInfoToRender = nullptr;
+	}
 
-							textureTypesToUnbind[convertedTextureType] = true;
-						}
-					}
+	GLSafeExecute(glColorMask, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	depthPrePassActive = false;
+
+	return anyModelRendered;
+}
+
+void LGL::SetMainPassDepthState(bool afterDepthPrePass)
+{
+	if (afterDepthPrePass == depthEqualStateSet || depthTestMode == DepthTestMode::Disable)
+	{
+		return;
+	}
+
+	if (afterDepthPrePass)
+	{
+		GLSafeExecute(glDepthFunc, GL_EQUAL);
+		GLSafeExecute(glDepthMask, GL_FALSE);
+	}
+	else
+	{
+		GLSafeExecute(glDepthFunc, static_cast<GLenum>(LGLEnumInterpreter::DepthTestModeInter[static_cast<int>(depthTestMode)]));
+		GLSafeExecute(glDepthMask, GL_TRUE);
+	}
+
+	depthEqualStateSet = afterDepthPrePass;
+}
+
+void LGL::RunRenderingCycle(std::function<void()> additionalSteps)
+{
+	std::array<int, Texture::GetTextureTypeAmount()> textureTypesToUnbind;
+	std::fill(textureTypesToUnbind.begin(), textureTypesToUnbind.end(), false);
+
+	renderThreadId = std::this_thread::get_id();
+
+	while (!(stopRendering || glfwWindowShouldClose(window)))
+	{
+		if (pauseRendering)
+		{
+			// Callers which queued commands before the pause wait for them, later ones drain the queue themselves
+			{
+				ContextLock
+				commandQueue->Drain();
+			}
+
+			std::unique_lock<std::mutex> pauseLock(pauserMux);
+			pauser.wait(pauseLock, [this]() { return !pauseRendering; });
+
+			framePacer->ResetFrameTiming();
+		}
+
+		PaceFrame();
+
+		ContextLock
+
+		commandQueue->Drain();
+
+		ApplySwapInterval();
+
+		ProcessInput();
+		glfwPollEvents();
+
+		bool renderOffscreen = dynamicResolution.enabled && BeginDynamicResolutionFrame();
+
+		GLSafeExecute(glClearColor, background.r, background.g, background.b, background.a);
+		GLSafeExecute(glClear, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		// Evicted models which became visible are restored before any pass uses them
+		MarkDrawnModels();
+
+		if (additionalSteps)
+		{
+			additionalSteps();
+		}
+
+		bool depthPrePassRendered = useDepthPrePass && RenderDepthPrePass();
+
+		for (auto& currentModelToProcess : internalModelMap)
+		{
+			// Model became visible after it was evicted, it is restored by the next frame
+			if (currentModelToProcess.second.evicted || currentModelToProcess.second.uploading)
+			{
+				continue;
+			}
+
+			if (depthPrePassRendered)
+			{
+				SetMainPassDepthState(currentModelToProcess.second.renderedInDepthPrePass);
+			}
+
+			SetCurrentShaderProg(currentModelToProcess.second.modelPtr->shaderProgram);
+
+			std::function<void()>& modelBeh = currentModelToProcess.second.modelPtr->modelBehaviour;
+			if (modelBeh)
+			{
+				modelBeh();
+			}
+
+			for (size_t meshIndex = 0; meshIndex < currentModelToProcess.second.VAOs.size(); ++meshIndex)
+			{
+				auto& currentVAO = currentModelToProcess.second.VAOs[meshIndex];
+
+				if (currentVAO.meshInfo->render)
+				{
+					currentVAOToRender = currentVAO;
+					currentModelInfoToRender = &currentModelToProcess.second;
+					currentMeshIndexToRender = meshIndex;
+					meshRenderedByBehaviour = false;
+
+					SetCurrentShaderProg(currentVAO.meshInfo->shaderProgram);
+
+					GLSafeExecute(glBindVertexArray, currentVAO.vboId);
+
+					for (auto& texture : currentVAO.meshInfo->mesh.textures)
+					{
+						auto currentTextureIter = currentModelToProcess.second.textureIDs.find(texture.name);
+						if (currentTextureIter != currentModelToProcess.second.textureIDs.end())
+						{
+							TextureID textureID = (*currentTextureIter).second;
+							int convertedTextureType = static_cast<int>(texture.type);
+							GLSafeExecute(glActiveTexture, GL_TEXTURE0 + convertedTextureType);
+							GLSafeExecute(glBindTexture, GL_TEXTURE_2D, textureID);
+
+							textureTypesToUnbind[convertedTextureType] = true;
+						}
+					}
 
 					std::function<void(int)>& behaviourToCheck = currentVAO.meshInfo->behaviour;
 					if (behaviourToCheck)
@@ -520,7 +1073,10 @@ void LGL::RunRenderingCycle(std::function<void()> additionalSteps)
 						behaviourToCheck(static_cast<int>(meshIndex));
 					}
 
-					Render();
+					if (!meshRenderedByBehaviour)
+					{
+						Render();
+					}
 
 					for (auto& textureTypeToUnbind : textureTypesToUnbind)
 					{
@@ -534,238 +1090,997 @@ void LGL::RunRenderingCycle(std::function<void()> additionalSteps)
 				}
 			}
 
-			currentVAOToRender = {};
+			currentVAOToRender = {};
+			currentModelInfoToRender = nullptr;
+		}
+
+		SetMainPassDepthState(false);
+
+		if (renderOffscreen)
+		{
+			EndDynamicResolutionFrame();
+		}
+
+		RenderText();
+
+		glfwSwapBuffers(window);
+
+		UpdateMemoryResidency();
+		resourceTracker->CollectGarbage();
+	}
+
+	stopRendering = true;
+
+	// Commands queued before the cycle stopped are executed here, later ones are executed by their callers
+	renderThreadId = std::thread::id();
+	{
+		ContextLock
+		commandQueue->Drain();
+	}
+
+	DeleteGLObjects();
+}
+
+void LGL::StopRenderingCycle()
+{
+	stopRendering = true;
+}
+
+void LGL::PauseRendering(bool value)
+{
+	pauseRendering = value;
+
+	if (!pauseRendering)
+	{
+		pauser.notify_one();
+	}
+}
+
+void LGL::SetStaticBackgroundColor(const glm::vec4& rgba)
+{
+	background = rgba;
+}
+
+void LGL::CreateRenderTextVO()
+{
+	ContextLock
+
+	GLSafeExecute(glGenVertexArrays, 1, &renderTextVAO);
+	GLSafeExecute(glGenBuffers, 1, &renderTextVBO);
+	resourceTracker->Register(LGLResourceTracker::ResourceType::VertexArray, renderTextVAO, 0, "Text");
+	resourceTracker->Register(LGLResourceTracker::ResourceType::Buffer, renderTextVBO, sizeof(float) * 6 * 4, "Text");
+	GLSafeExecute(glBindVertexArray, renderTextVAO);
+	GLSafeExecute(glBindBuffer, GL_ARRAY_BUFFER, renderTextVBO);
+	GLSafeExecute(glBufferData, GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, nullptr, GL_DYNAMIC_DRAW);
+	GLSafeExecute(glEnableVertexAttribArray, 0);
+	GLSafeExecute(glVertexAttribPointer, 0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+}
+
+void LGL::SetMeshVertexAttributes(int firstAttribute)
+{
+	auto CollectSteps = []() {
+		std::vector<size_t> steps;
+
+		for (size_t i = 0; i < LGLStructs::BasicVertex::GetLocalMemberAmount(); ++i)
+		{
+			steps.push_back(LGLStructs::BasicVertex::GetMemberElementSize());
+		}
+
+		for (size_t i = 0; i < LGLStructs::Vertex::GetLocalMemberAmount(); ++i)
+		{
+			steps.push_back(LGLStructs::Vertex::GetMemberElementSize());
+		}
+
+		return steps;
+	};
+
+	std::vector<size_t> steps = CollectSteps();
+
+	// The whole secton needs to be generalized more
+	size_t stride = 0;
+	for (int i = 0; i < steps.size(); ++i)
+	{
+		if (i == 5)
+		{
+			stride += steps[i] * sizeof(int);
+		}
+		else
+		{
+			stride += steps[i] * sizeof(float);
+		}
+	}
+
+	size_t byteOffset = 0;
+	for (int i = 0; i < steps.size(); ++i)
+	{
+		if (i >= firstAttribute)
+		{
+			glEnableVertexAttribArray(i);
+
+			if (i == 5)
+			{
+				GLSafeExecute(glVertexAttribIPointer, i, static_cast<int>(steps[i]), GL_INT, stride, (void*)(byteOffset));
+			}
+			else
+			{
+				GLSafeExecute(
+					glVertexAttribPointer, i, static_cast<int>(steps[i]), GL_FLOAT, GL_FALSE, stride, (void*)(byteOffset)
+				);
+			}
+		}
+
+		byteOffset += steps[i] * (i == 5 ? sizeof(int) : sizeof(float));
+	}
+}
+
+void LGL::CreateMesh(const std::string& modelName, MeshInfo& meshInfo)
+{
+	ExecuteOnRenderThread([this, &modelName, &meshInfo]() {
+		if (internalModelMap.find(modelName) == internalModelMap.end())
+		{
+			assert(false && "Trying to add mesh to non existent model");
+			return;
+		}
+
+		auto& newVAOInfo = internalModelMap[modelName];
+
+		newVAOInfo.VAOs.push_back({});
+		newVAOInfo.VAOs.back().meshInfo = &meshInfo;
+
+		CreateMeshBuffers(newVAOInfo.VAOs.back(), modelName);
+
+		//glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//glBindVertexArray(0);
+
+		size_t polygons = newVAOInfo.VAOs.back().pointAmount / 3;
+		std::cout << "Mesh with " << newVAOInfo.VAOs.back().pointAmount << " point(s) / " << polygons << " polygons created\n";
+
+		LoadAndCompileShader(meshInfo.shaderProgram);
+		for (auto& texture : meshInfo.mesh.textures)
+		{
+			ConfigureTexture(modelName, texture);
+		}
+	}).wait();
+}
+
+void LGL::CreateMeshBuffers(VAOInfo& meshVAO, const std::string& modelName)
+{
+	MeshInfo& meshInfo = *meshVAO.meshInfo;
+
+	GLSafeExecute(glGenVertexArrays, 1, &meshVAO.vboId);
+	GLSafeExecute(glBindVertexArray, meshVAO.vboId);
+	resourceTracker->Register(LGLResourceTracker::ResourceType::VertexArray, meshVAO.vboId, 0, modelName);
+
+	GLSafeExecute(glGenBuffers, 1, &meshVAO.vertexBufferId);
+	GLSafeExecute(glBindBuffer, GL_ARRAY_BUFFER, meshVAO.vertexBufferId);
+	resourceTracker->Register(
+		LGLResourceTracker::ResourceType::Buffer, meshVAO.vertexBufferId, meshInfo.mesh.vert.size() * sizeof(Vertex), modelName
+	);
+	meshVAO.vertexAmount = meshInfo.mesh.vert.size();
+	GLSafeExecute(
+		glBufferData,
+		GL_ARRAY_BUFFER, 
+		meshInfo.mesh.vert.size() * sizeof(Vertex),
+		&meshInfo.mesh.vert[0],
+		meshInfo.isDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW
+	);
+
+	if (!meshInfo.mesh.indices.empty())
+	{
+		GLSafeExecute(glGenBuffers, 1, &meshVAO.elementBufferId);
+		GLSafeExecute(glBindBuffer, GL_ELEMENT_ARRAY_BUFFER, meshVAO.elementBufferId);
+		resourceTracker->Register(
+			LGLResourceTracker::ResourceType::Buffer, 
+			meshVAO.elementBufferId, 
+			meshInfo.mesh.indices.size() * sizeof(unsigned int), 
+			modelName
+		);
+		GLSafeExecute(
+			glBufferData,
+			GL_ELEMENT_ARRAY_BUFFER, 
+			meshInfo.mesh.indices.size() * sizeof(unsigned int),
+			&meshInfo.mesh.indices[0],
+			meshInfo.isDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW
+		);
+		meshVAO.useIndices = true;
+		meshVAO.pointAmount = meshInfo.mesh.indices.size();
+	}
+	else
+	{
+		meshVAO.pointAmount = meshInfo.mesh.vert.size();
+	}
+
+	SetMeshVertexAttributes();
+}
+
+void LGL::ReleaseMeshBuffers(VAOInfo& meshVAO)
+{
+	resourceTracker->Release(LGLResourceTracker::ResourceType::VertexArray, meshVAO.vboId);
+	resourceTracker->Release(LGLResourceTracker::ResourceType::Buffer, meshVAO.vertexBufferId);
+
+	if (meshVAO.useIndices)
+	{
+		resourceTracker->Release(LGLResourceTracker::ResourceType::Buffer, meshVAO.elementBufferId);
+	}
+
+	meshVAO.vboId = 0;
+	meshVAO.vertexBufferId = 0;
+	meshVAO.elementBufferId = 0;
+}
+
+void LGL::CreateModel(const std::string& modelName, LGLStructs::ModelInfo& model)
+{
+	ExecuteOnRenderThread([this, &modelName, &model]() {
+		if (internalModelMap.find(modelName) == internalModelMap.end())
+		{
+			internalModelMap.emplace(modelName, InternalModelInfo{ &model, {}, {} });
+			internalModelMap[modelName].lastDrawnFrame = memoryResidency.currentFrame;
+		}
+
+		for (auto& mesh : model.meshes)
+		{
+			CreateMesh(modelName, mesh);
+		}
+
+		if (!model.depthShaderProgram.empty())
+		{
+			LoadAndCompileShader(model.depthShaderProgram);
+		}
+	}).wait();
+}
+
+void LGL::CreateModelGradually(const std::string& modelName, LGLStructs::ModelInfo& model)
+{
+	ExecuteOnRenderThread([this, modelName, &model]() {
+		if (internalModelMap.find(modelName) != internalModelMap.end())
+		{
+			return;
+		}
+
+		InternalModelInfo& modelInfo = internalModelMap.emplace(modelName, InternalModelInfo{ &model, {}, {} }).first->second;
+		modelInfo.lastDrawnFrame = memoryResidency.currentFrame;
+		modelInfo.uploading = true;
+
+		if (!model.depthShaderProgram.empty())
+		{
+			LoadAndCompileShader(model.depthShaderProgram);
+		}
+
+		memoryResidency.modelUploadQueue.push_back(modelName);
+	});
+}
+
+bool LGL::IsModelUploaded(const std::string& modelName)
+{
+	return ExecuteOnRenderThread([this, modelName]() {
+		auto modelIter = internalModelMap.find(modelName);
+
+		return modelIter != internalModelMap.end() && !modelIter->second.uploading;
+	}).get();
+}
+
+void LGL::CreateText(const std::string& textLabel, LGLStructs::TextInfo& text)
+{
+	ExecuteOnRenderThread([this, &textLabel, &text]() {
+		if (!renderTextVOCreated)
+		{
+			CreateRenderTextVO();
+			renderTextVOCreated = true;
+		}
+		LoadAndCompileShader(text.shaderProgram);
+		if (collectionToCharTextures.find(text.glyphInfo.fontName) == collectionToCharTextures.end())
+		{
+			for (auto& charTexture : text.glyphInfo.glyphs)
+			{
+				ConfigueGlyphTexture(text.glyphInfo.fontName, charTexture.second);
+			}
+		}
+
+		internalTextMap[textLabel] = &text;
+	}).wait();
+}
+
+void LGL::DeleteModel(const std::string& modelName)
+{
+	ExecuteOnRenderThread([this, &modelName]() {
+		if(internalModelMap.find(modelName) != internalModelMap.end())
+		{
+			GLSafeExecute(glBindVertexArray, 0);
+
+			ReleaseModelResources(internalModelMap[modelName]);
+
+			internalModelMap.erase(modelName);
+
+			DropUnusedEvictedTextures();
+		}
+	}).wait();
+}
+
+void LGL::ReleaseModelResources(InternalModelInfo& modelInfo)
+{
+	DeleteSkinnedInstances(modelInfo);
+
+	for (auto& VAO : modelInfo.VAOs)
+	{
+		ReleaseMeshBuffers(VAO);
+	}
+	modelInfo.VAOs.clear();
+
+	for (auto& texture : modelInfo.textureIDs)
+	{
+		ReleaseTexture(texture.first, texture.second);
+	}
+	modelInfo.textureIDs.clear();
+}
+
+void LGL::ReleaseTexture(const std::string& textureName, TextureID textureID)
+{
+	if (resourceTracker->Release(LGLResourceTracker::ResourceType::Texture, textureID))
+	{
+		auto sharedIter = sharedTextures.find(textureName);
+		if (sharedIter != sharedTextures.end() && sharedIter->second.textureID == textureID)
+		{
+			sharedTextures.erase(sharedIter);
+		}
+	}
+}
+
+void LGL::SetGPUMemoryBudget(size_t budgetBytes, size_t evictAfterFrames)
+{
+	memoryResidency.budget = budgetBytes;
+	memoryResidency.evictAfterFrames = evictAfterFrames;
+	memoryResidency.budgetWarningShown = false;
+}
+
+void LGL::SetTextureUploadBudget(size_t bytesPerFrame)
+{
+	memoryResidency.uploadBudget = bytesPerFrame;
+}
+
+void LGL::SetModelUploadBudget(size_t bytesPerFrame)
+{
+	memoryResidency.modelUploadBudget = bytesPerFrame;
+}
+
+size_t LGL::GetGPUMemoryUsage()
+{
+	return ExecuteOnRenderThread([this]() {
+		return resourceTracker->GetResidentBytes();
+	}).get();
+}
+
+void LGL::MarkDrawnModels()
+{
+	for (auto& model : internalModelMap)
+	{
+		InternalModelInfo& modelInfo = model.second;
+
+		if (modelInfo.uploading || !modelInfo.modelPtr->visible)
+		{
+			continue;
+		}
+
+		bool drawn = false;
+		for (auto& VAO : modelInfo.VAOs)
+		{
+			if (VAO.meshInfo->render)
+			{
+				drawn = true;
+				break;
+			}
+		}
+
+		if (!drawn)
+		{
+			continue;
+		}
+
+		modelInfo.lastDrawnFrame = memoryResidency.currentFrame;
+
+		if (modelInfo.evicted)
+		{
+			RestoreModel(model.first, modelInfo);
+		}
+	}
+}
+
+void LGL::UpdateMemoryResidency()
+{
+	++memoryResidency.currentFrame;
+
+	// At least one texture is uploaded per frame, even if it does not fit into the budget
+	size_t uploadedBytes = 0;
+	while (!memoryResidency.textureUploadQueue.empty() && uploadedBytes < memoryResidency.uploadBudget)
+	{
+		std::string textureName = memoryResidency.textureUploadQueue.front();
+		memoryResidency.textureUploadQueue.pop_front();
+
+		uploadedBytes += UploadEvictedTexture(textureName);
+	}
+
+	UploadQueuedModels();
+
+	if (!memoryResidency.budget || resourceTracker->GetResidentBytes() <= memoryResidency.budget)
+	{
+		return;
+	}
+
+	std::vector<std::pair<const std::string*, InternalModelInfo*>> evictionCandidates;
+
+	for (auto& model : internalModelMap)
+	{
+		InternalModelInfo& modelInfo = model.second;
+
+		if (!modelInfo.evicted && !modelInfo.uploading && memoryResidency.currentFrame - modelInfo.lastDrawnFrame > memoryResidency.evictAfterFrames)
+		{
+			evictionCandidates.emplace_back(&model.first, &modelInfo);
+		}
+	}
+
+	// Least recently drawn models are evicted first
+	std::sort(
+		evictionCandidates.begin(), 
+		evictionCandidates.end(), 
+		[](const std::pair<const std::string*, InternalModelInfo*>& a, const std::pair<const std::string*, InternalModelInfo*>& b) {
+			return a.second->lastDrawnFrame < b.second->lastDrawnFrame;
+		}
+	);
+
+	for (auto& candidate : evictionCandidates)
+	{
+		if (resourceTracker->GetResidentBytes() <= memoryResidency.budget)
+		{
+			break;
+		}
+
+		EvictModel(*candidate.first, *candidate.second);
+	}
+
+	if (resourceTracker->GetResidentBytes() > memoryResidency.budget && !memoryResidency.budgetWarningShown)
+	{
+		std::cout << "GPU memory budget of " << memoryResidency.budget << " bytes is exceeded by resources in use\n";
+		memoryResidency.budgetWarningShown = true;
+	}
+}
+
+void LGL::UploadQueuedModels()
+{
+	size_t uploadedBytes = 0;
+	bool anyMeshUploaded = false;
+
+	// At least one mesh is uploaded per frame, even if it does not fit into the budget
+	while (!memoryResidency.modelUploadQueue.empty() && uploadedBytes < memoryResidency.modelUploadBudget)
+	{
+		auto modelIter = internalModelMap.find(memoryResidency.modelUploadQueue.front());
+
+		// Model was deleted before it was uploaded
+		if (modelIter == internalModelMap.end() || !modelIter->second.uploading)
+		{
+			memoryResidency.modelUploadQueue.pop_front();
+			continue;
+		}
+
+		InternalModelInfo& modelInfo = modelIter->second;
+		std::vector<MeshInfo>& meshes = modelInfo.modelPtr->meshes;
+
+		// Every uploaded mesh adds its VAO, so their amount tells which mesh is next
+		if (modelInfo.VAOs.size() < meshes.size())
+		{
+			MeshInfo& meshInfo = meshes[modelInfo.VAOs.size()];
+
+			uploadedBytes += meshInfo.mesh.vert.size() * sizeof(Vertex) + meshInfo.mesh.indices.size() * sizeof(unsigned int);
+
+			for (auto& texture : meshInfo.mesh.textures)
+			{
+				uploadedBytes += static_cast<size_t>(texture.width) * texture.height * texture.channelAmount;
+			}
+
+			CreateMesh(modelIter->first, meshInfo);
+			anyMeshUploaded = true;
+		}
+
+		if (modelInfo.VAOs.size() == meshes.size())
+		{
+			modelInfo.uploading = false;
+			memoryResidency.modelUploadQueue.pop_front();
+
+			std::cout << "Model " << modelIter->first << " uploaded to GPU memory\n";
+		}
+	}
+
+	if (anyMeshUploaded)
+	{
+		GLSafeExecute(glBindVertexArray, 0);
+	}
+}
+
+void LGL::EvictModel(const std::string& modelName, InternalModelInfo& modelInfo)
+{
+	DeleteSkinnedInstances(modelInfo);
+
+	// Vertex data is still held by mesh info, so only GL objects are released
+	for (auto& VAO : modelInfo.VAOs)
+	{
+		ReleaseMeshBuffers(VAO);
+	}
+
+	// Texture names are kept to know what to restore
+	for (auto& texture : modelInfo.textureIDs)
+	{
+		EvictTexture(texture.first, texture.second);
+		texture.second = 0;
+	}
+
+	modelInfo.evicted = true;
+
+	std::cout << "Model " << modelName << " evicted from GPU memory\n";
+}
+
+void LGL::RestoreModel(const std::string& modelName, InternalModelInfo& modelInfo)
+{
+	for (auto& VAO : modelInfo.VAOs)
+	{
+		CreateMeshBuffers(VAO, modelName);
+	}
+	GLSafeExecute(glBindVertexArray, 0);
+
+	for (auto& texture : modelInfo.textureIDs)
+	{
+		auto sharedIter = sharedTextures.find(texture.first);
+		if (sharedIter != sharedTextures.end() && 
+			resourceTracker->AddRef(LGLResourceTracker::ResourceType::Texture, sharedIter->second.textureID))
+		{
+			texture.second = sharedIter->second.textureID;
+			continue;
+		}
+
+		auto evictedIter = memoryResidency.evictedTextures.find(texture.first);
+		if (evictedIter != memoryResidency.evictedTextures.end() && 
+			resourceTracker->AddRef(LGLResourceTracker::ResourceType::Texture, evictedIter->second.placeholderID))
+		{
+			texture.second = evictedIter->second.placeholderID;
+
+			if (!evictedIter->second.uploadQueued)
+			{
+				memoryResidency.textureUploadQueue.push_back(texture.first);
+				evictedIter->second.uploadQueued = true;
+			}
+		}
+	}
+
+	modelInfo.evicted = false;
+
+	std::cout << "Model " << modelName << " restored to GPU memory\n";
+}
+
+void LGL::EvictTexture(const std::string& textureName, TextureID textureID)
+{
+	auto sharedIter = sharedTextures.find(textureName);
+
+	// Other users keep the texture resident, otherwise it is read back before being released,
+	// unless system memory copy of the texture with the same name already exists
+	if (sharedIter == sharedTextures.end() || 
+		sharedIter->second.textureID != textureID ||
+		resourceTracker->GetRefCount(LGLResourceTracker::ResourceType::Texture, textureID) != 1 ||
+		memoryResidency.evictedTextures.find(textureName) != memoryResidency.evictedTextures.end())
+	{
+		ReleaseTexture(textureName, textureID);
+		return;
+	}
+
+	const LGLStructs::Texture& description = sharedIter->second.texture;
+	unsigned int textureFormat = GetTextureFormat(description.channelAmount);
+
+	EvictedTextureInfo& evictedTexture = memoryResidency.evictedTextures[textureName];
+	evictedTexture.texture = description;
+	evictedTexture.data.resize(static_cast<size_t>(description.width) * description.height * description.channelAmount);
+
+	// Synchronous read back waits for GPU, which is acceptable for models that are not drawn
+	GLSafeExecute(glBindTexture, GL_TEXTURE_2D, textureID);
+	GLSafeExecute(glPixelStorei, GL_PACK_ALIGNMENT, 1);
+	GLSafeExecute(glGetTexImage, GL_TEXTURE_2D, 0, textureFormat, GL_UNSIGNED_BYTE, evictedTexture.data.data());
+	GLSafeExecute(glBindTexture, GL_TEXTURE_2D, 0);
+
+	// Placeholder is box filtered down from the original
+	int step = std::max(1, std::max(description.width, description.height) / memoryResidency.placeholderSize);
+
+	LGLStructs::Texture placeholder = description;
+	placeholder.name = textureName + " placeholder";
+	placeholder.params.createMipmaps = false;
+	placeholder.width = std::max(1, description.width / step);
+	placeholder.height = std::max(1, description.height / step);
+
+	std::vector<unsigned char> placeholderData(
+		static_cast<size_t>(placeholder.width) * placeholder.height * placeholder.channelAmount
+	);
+
+	for (int y = 0; y < placeholder.height; ++y)
+	{
+		for (int x = 0; x < placeholder.width; ++x)
+		{
+			for (int channel = 0; channel < placeholder.channelAmount; ++channel)
+			{
+				size_t sum = 0;
+				size_t amount = 0;
+
+				for (int sourceY = y * step; sourceY < std::min((y + 1) * step, description.height); ++sourceY)
+				{
+					for (int sourceX = x * step; sourceX < std::min((x + 1) * step, description.width); ++sourceX)
+					{
+						sum += evictedTexture.data[
+							(static_cast<size_t>(sourceY) * description.width + sourceX) * description.channelAmount + channel
+						];
+						++amount;
+					}
+				}
+
+				placeholderData[(static_cast<size_t>(y) * placeholder.width + x) * placeholder.channelAmount + channel] =
+					static_cast<unsigned char>(amount ? sum / amount : 0);
+			}
+		}
+	}
+
+	placeholder.data = placeholderData.data();
+	ConfigureTextureImpl(evictedTexture.placeholderID, placeholder);
+
+	ReleaseTexture(textureName, textureID);
+}
+
+size_t LGL::UploadEvictedTexture(const std::string& textureName)
+{
+	auto evictedIter = memoryResidency.evictedTextures.find(textureName);
+	if (evictedIter == memoryResidency.evictedTextures.end())
+	{
+		return 0;
+	}
+
+	EvictedTextureInfo& evictedTexture = evictedIter->second;
+	evictedTexture.uploadQueued = false;
+
+	std::vector<TextureID*> placeholderUsers;
+
+	for (auto& model : internalModelMap)
+	{
+		auto textureIter = model.second.textureIDs.find(textureName);
+		if (textureIter != model.second.textureIDs.end() && textureIter->second == evictedTexture.placeholderID)
+		{
+			placeholderUsers.push_back(&textureIter->second);
 		}
+	}
 
-		RenderText();
+	// Every user was evicted again before the upload
+	if (placeholderUsers.empty())
+	{
+		return 0;
+	}
 
-		glfwSwapBuffers(window);
+	LGLStructs::Texture texture = evictedTexture.texture;
+	texture.data = evictedTexture.data.data();
 
-		renderDeltaTime = std::chrono::duration<float>(std::chrono::system_clock::now() - renderStartTime).count();
-		if (renderTimeCallbackFunc)
+	TextureID textureID = 0;
+	if (!ConfigureTextureImpl(textureID, texture))
+	{
+		return 0;
+	}
+
+	// Newly created texture already holds a reference of the first user
+	for (size_t userIndex = 0; userIndex < placeholderUsers.size(); ++userIndex)
+	{
+		if (userIndex)
 		{
-			renderTimeCallbackFunc(renderDeltaTime);
+			resourceTracker->AddRef(LGLResourceTracker::ResourceType::Texture, textureID);
 		}
+
+		resourceTracker->Release(LGLResourceTracker::ResourceType::Texture, *placeholderUsers[userIndex]);
+		*placeholderUsers[userIndex] = textureID;
 	}
 
-	stopRendering = true;
-	DeleteGLObjects();
-}
+	size_t uploadedBytes = evictedTexture.data.size();
 
-void LGL::StopRenderingCycle()
-{
-	stopRendering = true;
+	SharedTextureInfo& sharedTexture = sharedTextures[textureName];
+	sharedTexture.textureID = textureID;
+	sharedTexture.texture = evictedTexture.texture;
+
+	DropEvictedTexture(textureName);
+
+	return uploadedBytes;
 }
 
-void LGL::PauseRendering(bool value)
+void LGL::DropEvictedTexture(const std::string& textureName)
 {
-	pauseRendering = value;
-
-	if (!pauseRendering)
+	auto evictedIter = memoryResidency.evictedTextures.find(textureName);
+	if (evictedIter != memoryResidency.evictedTextures.end())
 	{
-		pauser.notify_one();
+		resourceTracker->Release(LGLResourceTracker::ResourceType::Texture, evictedIter->second.placeholderID);
+		memoryResidency.evictedTextures.erase(evictedIter);
 	}
 }
 
-void LGL::SetStaticBackgroundColor(const glm::vec4& rgba)
+void LGL::DropUnusedEvictedTextures()
 {
-	background = rgba;
-}
+	std::vector<std::string> unusedTextures;
 
-void LGL::CreateRenderTextVO()
-{
-	HandshakeContextLock
+	for (auto& evictedTexture : memoryResidency.evictedTextures)
+	{
+		bool used = false;
 
-	GLSafeExecute(glGenVertexArrays, 1, &renderTextVAO);
-	GLSafeExecute(glGenBuffers, 1, &renderTextVBO);
-	GLSafeExecute(glBindVertexArray, renderTextVAO);
-	GLSafeExecute(glBindBuffer, GL_ARRAY_BUFFER, renderTextVBO);
-	GLSafeExecute(glBufferData, GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, nullptr, GL_DYNAMIC_DRAW);
-	GLSafeExecute(glEnableVertexAttribArray, 0);
-	GLSafeExecute(glVertexAttribPointer, 0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-}
+		for (auto& model : internalModelMap)
+		{
+			if (model.second.textureIDs.find(evictedTexture.first) != model.second.textureIDs.end())
+			{
+				used = true;
+				break;
+			}
+		}
 
-void LGL::CreateMesh(const std::string& modelName, MeshInfo& meshInfo)
-{
-	HandshakeContextLock
+		if (!used)
+		{
+			unusedTextures.push_back(evictedTexture.first);
+		}
+	}
 
-	auto CollectSteps = []() {
-		std::vector<size_t> steps;
+	for (auto& textureName : unusedTextures)
+	{
+		DropEvictedTexture(textureName);
+	}
+}
 
-		for (size_t i = 0; i < LGLStructs::BasicVertex::GetLocalMemberAmount(); ++i)
+void LGL::SetModelShaderPrograms(
+	const std::string& modelName, 
+	const std::string& shaderProgram, 
+	const std::string& depthShaderProgram
+)
+{
+	ExecuteOnRenderThread([this, modelName, shaderProgram, depthShaderProgram]() {
+		auto modelIter = internalModelMap.find(modelName);
+		if (modelIter == internalModelMap.end())
 		{
-			steps.push_back(LGLStructs::BasicVertex::GetMemberElementSize());
+			std::cerr << "[ERROR] Model " << modelName << " does not exist\n";
+			return;
 		}
 
-		for (size_t i = 0; i < LGLStructs::Vertex::GetLocalMemberAmount(); ++i)
+		LoadAndCompileShader(shaderProgram);
+		if (!depthShaderProgram.empty())
 		{
-			steps.push_back(LGLStructs::Vertex::GetMemberElementSize());
+			LoadAndCompileShader(depthShaderProgram);
 		}
 
-		return steps;
-	};
+		ModelInfo& model = *modelIter->second.modelPtr;
+		model.shaderProgram = shaderProgram;
+		model.depthShaderProgram = depthShaderProgram;
+	});
+}
 
-	if (internalModelMap.find(modelName) == internalModelMap.end())
+bool LGL::PreSkinModelInstance(
+	const std::string& modelName,
+	size_t instanceIndex,
+	const std::string& skinShaderProgram,
+	const std::function<void()>& skinBehaviour
+)
+{
+	auto modelIter = internalModelMap.find(modelName);
+	if (modelIter == internalModelMap.end() || modelIter->second.evicted || modelIter->second.uploading)
 	{
-		assert(false && "Trying to add mesh to non existent model");
-		return;
+		return false;
 	}
 
-	auto& newVAOInfo = internalModelMap[modelName];
-
-	std::vector<size_t> steps = CollectSteps();
+	if (!LoadAndCompileShader(skinShaderProgram) || SetCurrentShaderProg(skinShaderProgram) == ~ShaderProgram{})
+	{
+		return false;
+	}
 
-	newVAOInfo.VAOs.push_back({});
-	VAO* newVAO = &newVAOInfo.VAOs.back().vboId;
-	GLSafeExecute(glGenVertexArrays, 1, newVAO);
-	GLSafeExecute(glBindVertexArray, *newVAO);
+	InternalModelInfo& modelInfo = modelIter->second;
 
-	VBOCollection.push_back(VBO());
-	VBO* newVBO = &VBOCollection.back();
+	if (instanceIndex >= modelInfo.skinnedInstances.size())
+	{
+		modelInfo.skinnedInstances.resize(instanceIndex + 1);
+	}
 
-	GLSafeExecute(glGenBuffers, 1, newVBO);
-	GLSafeExecute(glBindBuffer, GL_ARRAY_BUFFER, *newVBO);
-	GLSafeExecute(
-		glBufferData,
-		GL_ARRAY_BUFFER, 
-		meshInfo.mesh.vert.size() * sizeof(Vertex),
-		&meshInfo.mesh.vert[0],
-		meshInfo.isDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW
-	);
+	SkinnedInstanceInfo& instance = modelInfo.skinnedInstances[instanceIndex];
 
-	if (!meshInfo.mesh.indices.empty())
+	if (instance.VAOs.empty())
 	{
-		EBOCollection.push_back(EBO());
-		EBO* newEBO = &EBOCollection.back();
+		CreateSkinnedInstance(modelInfo, instance);
+	}
 
-		GLSafeExecute(glGenBuffers, 1, newEBO);
-		GLSafeExecute(glBindBuffer, GL_ELEMENT_ARRAY_BUFFER, *newEBO);
-		GLSafeExecute(
-			glBufferData,
-			GL_ELEMENT_ARRAY_BUFFER, 
-			meshInfo.mesh.indices.size() * sizeof(unsigned int),
-			&meshInfo.mesh.indices[0],
-			meshInfo.isDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW
-		);
-		newVAOInfo.VAOs.back().useIndices = true;
-		newVAOInfo.VAOs.back().pointAmount = meshInfo.mesh.indices.size();
+	if (skinBehaviour)
+	{
+		skinBehaviour();
 	}
-	else
+
+	GLSafeExecute(glEnable, GL_RASTERIZER_DISCARD);
+
+	for (size_t meshIndex = 0; meshIndex < modelInfo.VAOs.size(); ++meshIndex)
 	{
-		newVAOInfo.VAOs.back().pointAmount = meshInfo.mesh.vert.size();
+		VAOInfo& meshVAO = modelInfo.VAOs[meshIndex];
+
+		GLSafeExecute(glBindVertexArray, meshVAO.vboId);
+		GLSafeExecute(glBindBufferBase, GL_TRANSFORM_FEEDBACK_BUFFER, 0, instance.VBOs[meshIndex]);
+
+		// Each vertex is skinned once, no matter how many times indices reference it
+		GLSafeExecute(glBeginTransformFeedback, GL_POINTS);
+		GLSafeExecute(glDrawArrays, GL_POINTS, 0, static_cast<int>(meshVAO.vertexAmount));
+		glEndTransformFeedback();
 	}
 
-	newVAOInfo.VAOs.back().meshInfo = &meshInfo;
+	GLSafeExecute(glBindBufferBase, GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	GLSafeExecute(glDisable, GL_RASTERIZER_DISCARD);
+	GLSafeExecute(glBindVertexArray, 0);
+
+	// Uniforms set by the behaviour were consumed by feedback draws
+	uniformLocationTracker.clear();
 
+	return true;
+}
 
-	// The whole secton needs to be generalized more
-	size_t step = 0;
-	size_t stride = 0;
-	for (int i = 0; i < steps.size(); ++i)
+void LGL::RenderMeshInstance(size_t instanceIndex)
+{
+	if (!currentModelInfoToRender)
 	{
-		if (i == 5)
-		{
-			stride += steps[i] * sizeof(int);
-		}
-		else
-		{
-			stride += steps[i] * sizeof(float);
-		}
+		return;
 	}
 
-	size_t byteOffset = 0;
-	for (int i = 0; i < steps.size(); ++i)
+	meshRenderedByBehaviour = true;
+
+	auto& skinnedInstances = currentModelInfoToRender->skinnedInstances;
+
+	if (instanceIndex >= skinnedInstances.size() || skinnedInstances[instanceIndex].VAOs.empty())
 	{
-		glEnableVertexAttribArray(i);
+		Render();
+		return;
+	}
 
-		if (i == 5)
+	VAOInfo meshVAO = currentVAOToRender;
+
+	currentVAOToRender.vboId = skinnedInstances[instanceIndex].VAOs[currentMeshIndexToRender];
+	GLSafeExecute(glBindVertexArray, currentVAOToRender.vboId);
+
+	Render();
+
+	currentVAOToRender = meshVAO;
+	GLSafeExecute(glBindVertexArray, currentVAOToRender.vboId);
+}
+
+void LGL::SetModelInstanceAmount(const std::string& modelName, size_t instanceAmount)
+{
+	ExecuteOnRenderThread([this, modelName, instanceAmount]() {
+		auto modelIter = internalModelMap.find(modelName);
+		if (modelIter != internalModelMap.end())
 		{
-			GLSafeExecute(glVertexAttribIPointer, i, static_cast<int>(steps[i]), GL_INT, stride, (void*)(byteOffset));
-			byteOffset += steps[i] * sizeof(int);
+			DeleteSkinnedInstances(modelIter->second, instanceAmount);
 		}
-		else
+	});
+}
+
+void LGL::CreateSkinnedInstance(const InternalModelInfo& modelInfo, SkinnedInstanceInfo& instance)
+{
+	for (auto& meshVAO : modelInfo.VAOs)
+	{
+		instance.VAOs.push_back(VAO());
+		instance.VBOs.push_back(VBO());
+
+		GLSafeExecute(glGenVertexArrays, 1, &instance.VAOs.back());
+		GLSafeExecute(glBindVertexArray, instance.VAOs.back());
+		resourceTracker->Register(LGLResourceTracker::ResourceType::VertexArray, instance.VAOs.back(), 0, "Skinned instance");
+
+		// Position and normal are interleaved in the order of feedback varyings
+		GLSafeExecute(glGenBuffers, 1, &instance.VBOs.back());
+		GLSafeExecute(glBindBuffer, GL_ARRAY_BUFFER, instance.VBOs.back());
+		GLSafeExecute(
+			glBufferData, GL_ARRAY_BUFFER, meshVAO.vertexAmount * sizeof(glm::vec3) * 2, nullptr, GL_DYNAMIC_COPY
+		);
+		resourceTracker->Register(
+			LGLResourceTracker::ResourceType::Buffer, instance.VBOs.back(), meshVAO.vertexAmount * sizeof(glm::vec3) * 2, "Skinned instance"
+		);
+
+		for (int i = 0; i < 2; ++i)
 		{
+			GLSafeExecute(glEnableVertexAttribArray, i);
 			GLSafeExecute(
-				glVertexAttribPointer, i, static_cast<int>(steps[i]), GL_FLOAT, GL_FALSE, stride, (void*)(byteOffset)
+				glVertexAttribPointer, i, 3, GL_FLOAT, GL_FALSE, static_cast<int>(sizeof(glm::vec3) * 2), (void*)(i * sizeof(glm::vec3))
 			);
-			byteOffset += steps[i] * sizeof(float);
 		}
-	}
 
-	//glBindBuffer(GL_ARRAY_BUFFER, 0);
-	//glBindVertexArray(0);
+		// The rest of attributes are shared with the mesh
+		GLSafeExecute(glBindBuffer, GL_ARRAY_BUFFER, meshVAO.vertexBufferId);
+		SetMeshVertexAttributes(2);
 
-	size_t polygons = newVAOInfo.VAOs.back().pointAmount / 3;
-	std::cout << "Mesh with " << newVAOInfo.VAOs.back().pointAmount << " point(s) / " << polygons << " polygons created\n";
-
-	LoadAndCompileShader(meshInfo.shaderProgram);
-	for (auto& texture : meshInfo.mesh.textures)
-	{
-		ConfigureTexture(modelName, texture);
+		if (meshVAO.useIndices)
+		{
+			GLSafeExecute(glBindBuffer, GL_ELEMENT_ARRAY_BUFFER, meshVAO.elementBufferId);
+		}
 	}
+
+	GLSafeExecute(glBindVertexArray, 0);
 }
 
-void LGL::CreateModel(const std::string& modelName, LGLStructs::ModelInfo& model)
+void LGL::DeleteSkinnedInstances(InternalModelInfo& modelInfo, size_t fromInstance)
 {
-	if (internalModelMap.find(modelName) == internalModelMap.end())
+	for (size_t instanceIndex = fromInstance; instanceIndex < modelInfo.skinnedInstances.size(); ++instanceIndex)
 	{
-		internalModelMap.emplace(modelName, InternalModelInfo{ &model, {}, {} });
+		SkinnedInstanceInfo& instance = modelInfo.skinnedInstances[instanceIndex];
+
+		for (auto& VAO : instance.VAOs)
+		{
+			resourceTracker->Release(LGLResourceTracker::ResourceType::VertexArray, VAO);
+		}
+		for (auto& VBO : instance.VBOs)
+		{
+			resourceTracker->Release(LGLResourceTracker::ResourceType::Buffer, VBO);
+		}
 	}
 
-	for (auto& mesh : model.meshes)
+	if (fromInstance < modelInfo.skinnedInstances.size())
 	{
-		CreateMesh(modelName, mesh);
+		modelInfo.skinnedInstances.resize(fromInstance);
 	}
 }
 
-void LGL::CreateText(const std::string& textLabel, LGLStructs::TextInfo& text)
+void LGL::UpdateTextureBuffer(const std::string& bufferName, const float* data, size_t vec4Amount)
 {
-	if (!renderTextVOCreated)
-	{
-		CreateRenderTextVO();
-		renderTextVOCreated = true;
-	}
-	LoadAndCompileShader(text.shaderProgram);
-	if (collectionToCharTextures.find(text.glyphInfo.fontName) == collectionToCharTextures.end())
+	auto bufferIter = textureBuffers.find(bufferName);
+
+	if (bufferIter == textureBuffers.end())
 	{
-		for (auto& charTexture : text.glyphInfo.glyphs)
-		{
-			ConfigueGlyphTexture(text.glyphInfo.fontName, charTexture.second);
-		}
+		TextureBufferInfo newBuffer;
+		newBuffer.textureUnit = static_cast<int>(Texture::GetTextureTypeAmount() + textureBuffers.size());
+
+		GLSafeExecute(glGenBuffers, 1, &newBuffer.buffer);
+		GLSafeExecute(glGenTextures, 1, &newBuffer.texture);
+		resourceTracker->Register(LGLResourceTracker::ResourceType::Buffer, newBuffer.buffer, 0, bufferName);
+		resourceTracker->Register(LGLResourceTracker::ResourceType::Texture, newBuffer.texture, 0, bufferName);
+
+		bufferIter = textureBuffers.emplace(bufferName, newBuffer).first;
 	}
 
-	internalTextMap[textLabel] = &text;
+	TextureBufferInfo& textureBuffer = bufferIter->second;
+	size_t byteSize = vec4Amount * sizeof(glm::vec4);
+
+	GLSafeExecute(glBindBuffer, GL_TEXTURE_BUFFER, textureBuffer.buffer);
+	GLSafeExecute(glBufferData, GL_TEXTURE_BUFFER, byteSize, data, GL_STREAM_DRAW);
+	GLSafeExecute(glBindBuffer, GL_TEXTURE_BUFFER, 0);
+
+	// Registering again only updates tracked size
+	resourceTracker->Register(LGLResourceTracker::ResourceType::Buffer, textureBuffer.buffer, byteSize, bufferName);
+
+	// Texture units of buffers are not used by anything else, so the binding stays between frames
+	GLSafeExecute(glActiveTexture, GL_TEXTURE0 + textureBuffer.textureUnit);
+	GLSafeExecute(glBindTexture, GL_TEXTURE_BUFFER, textureBuffer.texture);
+	GLSafeExecute(glTexBuffer, GL_TEXTURE_BUFFER, GL_RGBA32F, textureBuffer.buffer);
+	GLSafeExecute(glActiveTexture, GL_TEXTURE0);
 }
 
-void LGL::DeleteModel(const std::string& modelName)
+bool LGL::BindTextureBuffer(const std::string& bufferName, const std::string& samplerName, const std::string& shaderProgramName)
 {
-	HandshakeContextLock
+	auto bufferIter = textureBuffers.find(bufferName);
 
-	if(internalModelMap.find(modelName) != internalModelMap.end())
+	if (bufferIter == textureBuffers.end())
 	{
-		GLSafeExecute(glBindVertexArray, 0);
+		return false;
+	}
 
-		for (auto& VAO : internalModelMap[modelName].VAOs)
-		{
-			GLSafeExecute(glDeleteVertexArrays, 1, &VAO.vboId);
-		}
-		for (auto& texture : internalModelMap[modelName].textureIDs)
-		{
-			GLSafeExecute(glDeleteTextures, 1, &texture.second);
-		}
+	return SetShaderUniformValue(samplerName, bufferIter->second.textureUnit, shaderProgramName);
+}
 
-		internalModelMap.erase(modelName);
+void LGL::DeleteTextureBuffers()
+{
+	for (auto& textureBuffer : textureBuffers)
+	{
+		resourceTracker->Release(LGLResourceTracker::ResourceType::Buffer, textureBuffer.second.buffer);
+		resourceTracker->Release(LGLResourceTracker::ResourceType::Texture, textureBuffer.second.texture);
 	}
+
+	textureBuffers.clear();
 }
 
 void LGL::DeleteText(const std::string& textLabel)
 {
-	HandshakeContextLock
-
-	if (internalTextMap.find(textLabel) != internalTextMap.end())
-	{
-		internalTextMap.erase(textLabel);
-	}
+	ExecuteOnRenderThread([this, &textLabel]() {
+		if (internalTextMap.find(textLabel) != internalTextMap.end())
+		{
+			internalTextMap.erase(textLabel);
+		}
+	}).wait();
 }
 
 #ifdef ENABLE_OLD_MODEL_IMPORT
@@ -950,7 +2265,7 @@ bool LGL::CompileShader(const std::string& name)
 {
 	using AcceptableShaderCode = const char* const;
 
-	HandshakeContextLock
+	ContextLock
 
 	if (shaderInfoCollection.find(name) == shaderInfoCollection.end())
 	{
@@ -971,7 +2286,7 @@ bool LGL::CompileShader(const std::string& name)
 
 bool LGL::LoadShaderFromFile(const std::string& name, const std::string& file, const std::string& shaderType)
 {
-	HandshakeContextLock
+	ContextLock
 
 	std::string shader; // change to stringstream
 	std::string line;
@@ -1020,11 +2335,20 @@ LGL::ShaderProgram LGL::SetCurrentShaderProg(const std::string& shaderProg)
 
 bool LGL::ConfigureTextureImpl(TextureID& newTextureID, const Texture& texture)
 {
-	HandshakeContextLock
+	ContextLock
 
 	GLSafeExecute(glGenTextures, 1, &newTextureID);
 	GLSafeExecute(glBindTexture, GL_TEXTURE_2D, newTextureID);
 
+	// Mip chain adds roughly a third on top of the base level
+	size_t textureSize = static_cast<size_t>(texture.width) * texture.height * texture.channelAmount;
+	resourceTracker->Register(
+		LGLResourceTracker::ResourceType::Texture, 
+		newTextureID, 
+		texture.params.createMipmaps ? textureSize * 4 / 3 : textureSize, 
+		texture.name
+	);
+
 	float color[] {
 		texture.params.color.r,
 		texture.params.color.g,
@@ -1082,20 +2406,10 @@ bool LGL::ConfigureTextureImpl(TextureID& newTextureID, const Texture& texture)
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	unsigned int textureFormat;
+	unsigned int textureFormat = GetTextureFormat(texture.channelAmount);
 
-	switch (texture.channelAmount)
+	if (!textureFormat)
 	{
-	case 1:
-		textureFormat = GL_RED;
-		break;
-	case 3:
-		textureFormat = GL_RGB;
-		break;
-	case 4:
-		textureFormat = GL_RGBA;
-		break;
-	default:
 		std::cout << "Unknown format\n";
 		return false;
 	}
@@ -1120,43 +2434,99 @@ bool LGL::ConfigureTextureImpl(TextureID& newTextureID, const Texture& texture)
 	return true;
 }
 
-bool LGL::ConfigureTexture(const std::string& modelName, const LGLStructs::Texture& texture)
+unsigned int LGL::GetTextureFormat(int channelAmount)
 {
-	if (internalModelMap[modelName].textureIDs.find(texture.name) != internalModelMap[modelName].textureIDs.end())
+	switch (channelAmount)
 	{
-		return true;
+	case 1:
+		return GL_RED;
+	case 3:
+		return GL_RGB;
+	case 4:
+		return GL_RGBA;
+	default:
+		return 0;
 	}
+}
+
+bool LGL::ConfigureTexture(const std::string& modelName, const LGLStructs::Texture& texture)
+{
+	return ExecuteOnRenderThread([this, &modelName, &texture]() {
+		if (internalModelMap[modelName].textureIDs.find(texture.name) != internalModelMap[modelName].textureIDs.end())
+		{
+			return true;
+		}
 
-	internalModelMap[modelName].textureIDs[texture.name] = TextureID();
+		// Textures with the same name are uploaded once and shared between models
+		auto sharedIter = sharedTextures.find(texture.name);
+		if (sharedIter != sharedTextures.end() && 
+			resourceTracker->AddRef(LGLResourceTracker::ResourceType::Texture, sharedIter->second.textureID))
+		{
+			internalModelMap[modelName].textureIDs[texture.name] = sharedIter->second.textureID;
+			return true;
+		}
+
+		internalModelMap[modelName].textureIDs[texture.name] = TextureID();
+
+		TextureID& newTextureID = internalModelMap[modelName].textureIDs[texture.name];
 
-	TextureID& newTextureID = internalModelMap[modelName].textureIDs[texture.name];
+		bool res = ConfigureTextureImpl(newTextureID, texture);
 
-	return ConfigureTextureImpl(newTextureID, texture);
+		SharedTextureInfo& sharedTexture = sharedTextures[texture.name];
+		sharedTexture.textureID = newTextureID;
+		sharedTexture.texture = texture;
+		// Pixel data belongs to the caller and is not guaranteed to outlive the upload
+		sharedTexture.texture.data = nullptr;
+
+		return res;
+	}).get();
 }
 
 bool LGL::ConfigueGlyphTexture(const std::string& collectionName, const LGLStructs::GlyphTexture& glyphTexture)
 {
-	if (collectionToCharTextures.find(collectionName) == collectionToCharTextures.end())
-	{
-		collectionToCharTextures[collectionName] = {};
-	}
+	return ExecuteOnRenderThread([this, &collectionName, &glyphTexture]() {
+		if (collectionToCharTextures.find(collectionName) == collectionToCharTextures.end())
+		{
+			collectionToCharTextures[collectionName] = {};
+		}
 
-	TextureID& currentRenderCharTexture = collectionToCharTextures[collectionName][glyphTexture.c];
+		TextureID& currentRenderCharTexture = collectionToCharTextures[collectionName][glyphTexture.c];
 
-	return ConfigureTextureImpl(currentRenderCharTexture, glyphTexture);
+		return ConfigureTextureImpl(currentRenderCharTexture, glyphTexture);
+	}).get();
 }
 
 bool LGL::CreateShaderProgram(const std::string& name, const std::vector<std::string>& shaderNames)
 {	
-	HandshakeContextLock
+	ContextLock
 
 	shaderProgramCollection.emplace(name, glCreateProgram());
 	ShaderProgram* newShaderProgram = &shaderProgramCollection[name];
+	resourceTracker->Register(LGLResourceTracker::ResourceType::ShaderProgram, *newShaderProgram, 0, name);
 
 	for (auto& shaderInfo : shaderInfoCollection[name])
 	{
 		GLSafeExecute(glAttachShader, *newShaderProgram, shaderInfo.shaderId);
 	}
+
+	auto varyingsIter = feedbackVaryingsCollection.find(name);
+	if (varyingsIter != feedbackVaryingsCollection.end())
+	{
+		std::vector<const char*> varyingNames;
+		for (auto& varying : varyingsIter->second)
+		{
+			varyingNames.push_back(varying.c_str());
+		}
+
+		GLSafeExecute(
+			glTransformFeedbackVaryings, 
+			*newShaderProgram, 
+			static_cast<int>(varyingNames.size()), 
+			varyingNames.data(), 
+			GL_INTERLEAVED_ATTRIBS
+		);
+	}
+
 	GLSafeExecute(glLinkProgram, *newShaderProgram);
 
 	int success;
@@ -1173,16 +2543,21 @@ void LGL::SetShaderFolder(const std::string& path)
 	shaderPath = path;
 }
 
-void LGL::RecompileShader(const std::string& shaderName)
+void LGL::SetTransformFeedbackVaryings(const std::string& shaderProgramName, const std::vector<std::string>& varyings)
 {
-	HandshakeContextLock
+	feedbackVaryingsCollection[shaderProgramName] = varyings;
+}
 
-	DeleteShader(shaderName);
+void LGL::RecompileShader(const std::string& shaderName)
+{
+	ExecuteOnRenderThread([this, shaderName]() {
+		DeleteShader(shaderName);
 
-	shaderInfoCollection.erase(shaderName);
-	shaderProgramCollection.erase(shaderName);
+		shaderInfoCollection.erase(shaderName);
+		shaderProgramCollection.erase(shaderName);
 
-	LoadAndCompileShader(shaderName);
+		LoadAndCompileShader(shaderName);
+	});
 }
 
 void LGL::DeleteShader(const std::string& shaderName)
@@ -1200,22 +2575,27 @@ void LGL::DeleteShader(const std::string& shaderName)
 		GLSafeExecute(glDeleteShader, shaderInfo.shaderId);
 	}
 
-	GLSafeExecute(glDeleteProgram, shaderProgramCollection[shaderName]);
+	// Program may still be used by frames in flight, so it is only released
+	resourceTracker->Release(LGLResourceTracker::ResourceType::ShaderProgram, shaderProgramCollection[shaderName]);
 }
 
 void LGL::UpdateWindowSize(int width, int height)
 {
-	HandshakeContextLock
+	ContextLock
 
 	windowWidth = width;
 	windowHeight = height;
 
 	GLSafeExecute(glViewport, 0, 0, width, height);
+
+	dynamicResolution.buffersOutdated = true;
 }
 
 void LGL::ResetLGL()
 {
-	DeleteGLObjects();
+	ExecuteOnRenderThread([this]() {
+		DeleteGLObjects();
+	}).wait();
 }
 
 bool LGL::LoadAndCompileShader(const std::string& name)
@@ -1239,6 +2619,35 @@ bool LGL::LoadAndCompileShader(const std::string& name)
 	return shaderInfoCollection[name].size() && CreateShaderProgram(name);
 }
 
+bool LGL::LoadAndCompileShaderFromCode(const std::string& name, const std::map<std::string, std::string>& shaderCodes)
+{
+	ContextLock
+
+	if (shaderProgramCollection.find(name) != shaderProgramCollection.end())
+	{
+		return true;
+	}
+
+	shaderInfoCollection[name] = {};
+
+	for (const auto& shaderCode : shaderCodes)
+	{
+		shaderInfoCollection[name].emplace_back(
+			ShaderInfo{
+				glCreateShader(shaderTypeChoice[shaderCode.first]),
+				shaderCode.second
+			}
+		);
+
+		if (!CompileShader(name))
+		{
+			shaderInfoCollection[name].pop_back();
+		}
+	}
+
+	return shaderInfoCollection[name].size() && CreateShaderProgram(name);
+}
+
 void LGL::SetInteractable(
 	int keyID,
 	bool holdable,
@@ -1396,6 +2805,7 @@ const std::unordered_map<std::type_index, std::function<void(int, void*)>> unifo
 	ShaderCallMatrixAndVector(glm::mat2,    glUniformMatrix2fv),
 	ShaderCallMatrixAndVector(glm::mat3,    glUniformMatrix3fv),
 	ShaderCallMatrixAndVector(glm::mat4,    glUniformMatrix4fv),
+	ShaderCallMatrixAndVector(glm::mat3x4,  glUniformMatrix3x4fv),
 };
 
 void LGL::EnableUniformValueBatchSending(bool value)
@@ -1483,6 +2893,7 @@ ShaderUniformValueExplicit(glm::vec4)
 ShaderUniformValueExplicit(glm::mat2)
 ShaderUniformValueExplicit(glm::mat3)
 ShaderUniformValueExplicit(glm::mat4)
+ShaderUniformValueExplicit(glm::mat3x4)
 
 #undef ShaderCallTypeAndVector
 #undef ShaderCallVectVector
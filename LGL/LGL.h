@@ -13,8 +13,12 @@
 #include <functional>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <future>
 #include <typeindex>
 #include <unordered_set>
+#include <array>
+#include <deque>
 
 #include "LGLStructs.h"
 
@@ -22,12 +26,14 @@
 
 struct GLFWwindow;
 class LGLUniformHasher;
+class LGLFramePacer;
+class LGLResourceTracker;
+class LGLCommandQueue;
 
 /*
 	Lambda (Open) GL
 
 	Todo:
-	Add frame limiter (fix frame dependent camera movement speed)
 	Maybe improve SetShaderUniformValue for arrays
 */
 class LGL
@@ -37,6 +43,10 @@ private:
 	using VBO = unsigned int; // Vertex Buffer Object
 	using VAO = unsigned int; // Vertex Array Object
 	using EBO = unsigned int; // Element Buffer Object
+	using FBO = unsigned int; // Frame Buffer Object
+	using RBO = unsigned int; // Render Buffer Object
+
+	using Query = unsigned int;
 
 	using Shader = unsigned int;
 	using ShaderCode = std::string;
@@ -47,6 +57,7 @@ private:
 	using TextureData = unsigned char*;
 
 	struct VAOInfo;
+	struct SkinnedInstanceInfo;
 	struct InternalModelInfo;
 	using InternalModelMap = std::map<std::string, InternalModelInfo>;
 
@@ -54,24 +65,43 @@ private:
 	struct VAOInfo
 	{
 		VAO vboId;
+		VBO vertexBufferId;
+		EBO elementBufferId;
 		size_t pointAmount;
+		size_t vertexAmount;
 		bool useIndices;
 		LGLStructs::MeshInfo* meshInfo;
 
 		VAOInfo()
 		{
 			vboId = 0;
+			vertexBufferId = 0;
+			elementBufferId = 0;
 			pointAmount = 0;
+			vertexAmount = 0;
 			useIndices = false;
 			meshInfo = nullptr;
 		}
 	};
 
+	// Pre-skinned positions and normals of one model instance, buffer and VAO per mesh
+	struct SkinnedInstanceInfo
+	{
+		std::vector<VAO> VAOs;
+		std::vector<VBO> VBOs;
+	};
+
 	struct InternalModelInfo
 	{
 		LGLStructs::ModelInfo* modelPtr = nullptr;
 		std::vector<VAOInfo> VAOs;
 		std::map<std::string, TextureID> textureIDs;
+		bool renderedInDepthPrePass = false;
+		std::vector<SkinnedInstanceInfo> skinnedInstances;
+		size_t lastDrawnFrame = 0;
+		bool evicted = false;
+		// Set until every mesh of gradually created model is uploaded, such model is not drawn
+		bool uploading = false;
 	};
 
 	struct ShaderInfo
@@ -117,6 +147,12 @@ public:
 		GreaterOrEqual
 	};
 
+	enum class UpscaleFilter
+	{
+		Bilinear,
+		Sharpened
+	};
+
 	// Public functions
 	LGL_API LGL();
 	LGL_API ~LGL();
@@ -134,6 +170,38 @@ public:
 	LGL_API void SetStaticBackgroundColor(const glm::vec4& rgba);
 	LGL_API void EnableVSync(bool value = true);
 
+	// Adaptive VSync lets late frames tear instead of waiting for the next vertical blank,
+	// only applied if the driver supports it
+	LGL_API void EnableAdaptiveVSync(bool value = true);
+
+	// Limits frame rate with a sleep-then-spin wait, 0 disables the limiter
+	LGL_API void SetFrameLimit(int targetFPS);
+
+	// Frame time statistics are collected over the report period,
+	// if enabled they are also printed out once the period passes
+	LGL_API void EnableFrameTimeReport(bool value = true, float reportPeriod = 5.0f);
+	LGL_API LGLStructs::FrameTimeStats GetFrameTimeStats();
+
+	// Renders the scene into an offscreen framebuffer which resolution scale is adjusted
+	// each frame, based on measured GPU frame time, to stay within given target frame time.
+	// Result is upscaled to the window, text is rendered in native resolution afterwards
+	LGL_API void EnableDynamicResolution(bool value = true);
+	LGL_API void SetDynamicResolutionParams(float targetFrameTimeMs, float minScale = 0.5f, float maxScale = 1.0f);
+	LGL_API void SetUpscaleFilter(UpscaleFilter upscaleFilter, float sharpness = 0.25f);
+	LGL_API float GetCurrentResolutionScale();
+
+	// Once GPU memory held by LGL exceeds the budget, meshes and textures of models which were not drawn
+	// for given amount of frames are evicted, least recently drawn first. 0 disables the budget.
+	// Model is drawn if it is rendered and visible. Evicted meshes are uploaded again from vertices kept by the model,
+	// evicted textures are kept in system memory and are drawn with low resolution placeholders
+	// until they are uploaded back, which is limited by texture upload budget per frame
+	LGL_API void SetGPUMemoryBudget(size_t budgetBytes, size_t evictAfterFrames = 300);
+	LGL_API void SetTextureUploadBudget(size_t bytesPerFrame);
+	// Limits bytes of meshes and their textures uploaded per frame for gradually created models,
+	// at least one mesh is uploaded each frame
+	LGL_API void SetModelUploadBudget(size_t bytesPerFrame);
+	LGL_API size_t GetGPUMemoryUsage();
+
 	// Creates a VAO, VBO and (if indices are given) EBO
 	// Must accept amount of steps for
 	// You can pass a lambda to describe general behaviour for your shape
@@ -147,11 +215,44 @@ public:
 #else	
 	LGL_API void CreateMesh(const std::string& modelName, LGLStructs::MeshInfo& meshInfo);
 	LGL_API void CreateModel(const std::string& modelName, LGLStructs::ModelInfo& model);
+	// Returns without waiting, meshes are uploaded at the end of following frames within model upload budget.
+	// Model is not drawn until all of its meshes are uploaded
+	LGL_API void CreateModelGradually(const std::string& modelName, LGLStructs::ModelInfo& model);
+	LGL_API bool IsModelUploaded(const std::string& modelName);
 	LGL_API void CreateText(const std::string& textLabel, LGLStructs::TextInfo& text);
 
 	LGL_API void DeleteModel(const std::string& modelName);
 	LGL_API void DeleteText(const std::string& textLabel);
+
+	// Switches shader programs of a created model, programs are compiled if they were not yet
+	LGL_API void SetModelShaderPrograms(
+		const std::string& modelName, 
+		const std::string& shaderProgram, 
+		const std::string& depthShaderProgram = ""
+	);
+
+	// Runs skin shader program over every vertex of the model with rasterization discarded,
+	// its SkinnedPos and SkinnedNormal outputs are captured with transform feedback into buffers of the instance.
+	// Must be called inside the rendering cycle, behaviour is meant to set instance specific uniforms
+	LGL_API bool PreSkinModelInstance(
+		const std::string& modelName,
+		size_t instanceIndex,
+		const std::string& skinShaderProgram,
+		const std::function<void()>& skinBehaviour = nullptr
+	);
+	// Draws current mesh with pre-skinned vertices of the instance, must be called from mesh behaviour.
+	// Mesh is drawn with its own vertices if the instance was not skinned yet
+	LGL_API void RenderMeshInstance(size_t instanceIndex);
+	// Frees pre-skinned buffers of instances past given amount
+	LGL_API void SetModelInstanceAmount(const std::string& modelName, size_t instanceAmount);
 #endif
+	// Texture buffers expose large arrays of vec4 to shaders as samplerBuffer, read with texelFetch.
+	// Buffer is created on the first update and reallocated each update, so GPU never waits for previous data.
+	// Each buffer keeps its own texture unit past the ones used by mesh textures. Must be called inside the rendering cycle
+	LGL_API void UpdateTextureBuffer(const std::string& bufferName, const float* data, size_t vec4Amount);
+	// Points sampler of the shader program to texture unit of the buffer, false if the buffer was never updated
+	LGL_API bool BindTextureBuffer(const std::string& bufferName, const std::string& samplerName, const std::string& shaderProgramName = "");
+
 	LGL_API bool ConfigureTexture(const std::string& modelName, const LGLStructs::Texture& texture);
 	LGL_API bool ConfigueGlyphTexture(const std::string& collectionName, const LGLStructs::GlyphTexture& glyphText);
 
@@ -161,6 +262,13 @@ public:
 
 	LGL_API void SetDepthTest(DepthTestMode depthTestMode);
 
+	// Models with depthShaderProgram set are rendered into depth buffer first,
+	// main pass of those models is then done with equal depth test and without depth writes,
+	// so fragment shader runs once per visible pixel
+	LGL_API void EnableDepthPrePass(bool value = true);
+	// Allows behaviours to skip work which is not needed for depth only rendering
+	LGL_API bool IsDepthPrePassActive();
+
 	LGL_API int GetMaxAmountOfVertexAttr();
 
 	LGL_API void CaptureMouse(bool value);
@@ -180,6 +288,9 @@ public:
 	LGL_API void SetShaderFolder(const std::string& path);
 	LGL_API void RecompileShader(const std::string& shaderName);
 
+	// Varyings are captured by transform feedback, must be set before the program is compiled
+	LGL_API void SetTransformFeedbackVaryings(const std::string& shaderProgramName, const std::vector<std::string>& varyings);
+
 	LGL_API void ResetLGL();
 
 	//Callback setters - Pass nothing to make callback self-contained
@@ -201,6 +312,13 @@ private:
 	void InitCallbacks();
 
 	void DeleteGLObjects();
+
+	// Mutating calls from other threads are queued and executed by the render thread at the start of the next frame.
+	// If rendering cycle is not running or is paused, the command is executed in place under context lock
+	template<typename Func>
+	auto ExecuteOnRenderThread(Func&& func) -> std::future<decltype(func())>;
+	bool CanQueueCommands();
+
 	void DeleteShader(const std::string& shaderName);
 
 	void UpdateWindowSize(int width, int height);
@@ -222,9 +340,43 @@ private:
 	ShaderProgram SetCurrentShaderProg(const std::string& shaderProg);
 
 	bool ConfigureTextureImpl(TextureID& newTextureID, const LGLStructs::Texture& texture);
+	// Returns 0 for unsupported channel amount
+	static unsigned int GetTextureFormat(int channelAmount);
+
+	// Sets attribute pointers of Vertex layout for currently bound VAO and array buffer,
+	// attributes before the first one are expected to be sourced from another buffer
+	void SetMeshVertexAttributes(int firstAttribute = 0);
+	void CreateSkinnedInstance(const InternalModelInfo& modelInfo, SkinnedInstanceInfo& instance);
+	void DeleteSkinnedInstances(InternalModelInfo& modelInfo, size_t fromInstance = 0);
+	// Drops model's references to its GL objects, shared ones stay alive while other models use them
+	void ReleaseModelResources(InternalModelInfo& modelInfo);
+	void CreateMeshBuffers(VAOInfo& meshVAO, const std::string& modelName);
+	void ReleaseMeshBuffers(VAOInfo& meshVAO);
+	void ReleaseTexture(const std::string& textureName, TextureID textureID);
+	void DeleteTextureBuffers();
+
+	// Memory residency
+	void MarkDrawnModels();
+	void UpdateMemoryResidency();
+	void UploadQueuedModels();
+	void EvictModel(const std::string& modelName, InternalModelInfo& modelInfo);
+	void RestoreModel(const std::string& modelName, InternalModelInfo& modelInfo);
+	void EvictTexture(const std::string& textureName, TextureID textureID);
+	// Returns amount of uploaded bytes
+	size_t UploadEvictedTexture(const std::string& textureName);
+	void DropEvictedTexture(const std::string& textureName);
+	void DropUnusedEvictedTextures();
 
 	// If shader file names can be identical to shader program name, general load and compile can be used
 	bool LoadAndCompileShader(const std::string& name);
+	// Used for shaders that are internal to LGL, shader code is given as a map of shader type to code
+	bool LoadAndCompileShaderFromCode(const std::string& name, const std::map<std::string, std::string>& shaderCodes);
+
+	bool CreateDynamicResolutionBuffers();
+	void DeleteDynamicResolutionBuffers();
+	bool BeginDynamicResolutionFrame();
+	void EndDynamicResolutionFrame();
+	void UpdateResolutionScale(float gpuFrameTime);
 
 	// Callbacks
 	CALLBACK GLFWErrorCallback(int errorCode, const char* description);
@@ -247,6 +399,10 @@ private:
 	static std::map<GLFWwindow*, LGL*> contextToInstance;
 
 	void ProcessInput();
+	bool RenderDepthPrePass();
+	void SetMainPassDepthState(bool afterDepthPrePass);
+	void ApplySwapInterval();
+	void PaceFrame();
 	void Render();
 	void RenderText();
 
@@ -256,8 +412,21 @@ private:
 	float renderDeltaTime;
 
 	bool useVSync; // Passed value is not bool, but will do for on/off switch
-	bool pauseRendering;
+	bool useAdaptiveVSync;
+	int appliedSwapInterval;
+	bool frameTimeReport;
+	std::unique_ptr<LGLFramePacer> framePacer;
+	std::unique_ptr<LGLResourceTracker> resourceTracker;
+	std::unique_ptr<LGLCommandQueue> commandQueue;
+	std::atomic<std::thread::id> renderThreadId;
+	std::atomic<std::thread::id> inPlaceExecutorId;
+	std::atomic<bool> pauseRendering;
 	bool stopRendering;
+
+	DepthTestMode depthTestMode;
+	bool useDepthPrePass;
+	bool depthPrePassActive;
+	bool depthEqualStateSet;
 	std::mutex pauserMux;
 	std::condition_variable pauser;
 
@@ -266,15 +435,34 @@ private:
 	glm::vec4 background;
 
 	VAOInfo currentVAOToRender;
-	std::vector<VBO> VBOCollection;
+	InternalModelInfo* currentModelInfoToRender;
+	size_t currentMeshIndexToRender;
+	bool meshRenderedByBehaviour;
 	InternalModelMap internalModelMap;
-	std::vector<EBO> EBOCollection;
 
 	VAO renderTextVAO;
 	VBO renderTextVBO;
 	bool renderTextVOCreated;
 	std::map<std::string, LGLStructs::TextInfo*> internalTextMap;
 	std::map<std::string, std::map<char, TextureID>> collectionToCharTextures;
+	struct SharedTextureInfo
+	{
+		TextureID textureID = 0;
+		// Description without pixel data, needed to read texture back on eviction
+		LGLStructs::Texture texture;
+	};
+
+	// Texture name to the texture shared by every model which uses it
+	std::map<std::string, SharedTextureInfo> sharedTextures;
+
+	struct TextureBufferInfo
+	{
+		VBO buffer = 0;
+		TextureID texture = 0;
+		int textureUnit = 0;
+	};
+
+	std::map<std::string, TextureBufferInfo> textureBuffers;
 
 	// Shader
 	std::string shaderPath;
@@ -284,9 +472,74 @@ private:
 	
 	std::string lastProgram;
 	std::map<std::string, ShaderProgram> shaderProgramCollection;
+	std::map<std::string, std::vector<std::string>> feedbackVaryingsCollection;
 
 	std::map<size_t, InteractableInfo> interactCollection;
 
+	// Dynamic resolution
+	struct DynamicResolutionInfo
+	{
+		bool enabled = false;
+		bool buffersOutdated = true;
+
+		float targetFrameTime = 1.0f / 60.0f;
+		float minScale = 0.5f;
+		float maxScale = 1.0f;
+		float currentScale = 1.0f;
+		float averageGPUFrameTime = 0.0f;
+
+		UpscaleFilter upscaleFilter = UpscaleFilter::Bilinear;
+		float sharpness = 0.25f;
+
+		FBO framebuffer = 0;
+		TextureID colorTexture = 0;
+		RBO depthRenderbuffer = 0;
+		int bufferWidth = 0;
+		int bufferHeight = 0;
+		int renderWidth = 0;
+		int renderHeight = 0;
+
+		// Queries are double buffered, result of the previous frame is read to avoid stalling
+		std::array<Query, 2> timerQueries = {};
+		std::array<bool, 2> queryIssued = {};
+		size_t currentQuery = 0;
+
+		VAO upscaleVAO = 0;
+	};
+
+	DynamicResolutionInfo dynamicResolution;
+
+	// Memory residency
+	struct EvictedTextureInfo
+	{
+		LGLStructs::Texture texture;
+		std::vector<unsigned char> data;
+		TextureID placeholderID = 0;
+		bool uploadQueued = false;
+	};
+
+	struct MemoryResidencyInfo
+	{
+		size_t budget = 0;
+		size_t evictAfterFrames = 300;
+		size_t uploadBudget = 4 * 1024 * 1024;
+		size_t modelUploadBudget = 16 * 1024 * 1024;
+		size_t currentFrame = 0;
+		bool budgetWarningShown = false;
+
+		// Largest side of placeholder textures
+		int placeholderSize = 16;
+
+		std::map<std::string, EvictedTextureInfo> evictedTextures;
+		std::deque<std::string> textureUploadQueue;
+		// Gradually created models, in order of creation
+		std::deque<std::string> modelUploadQueue;
+	};
+
+	MemoryResidencyInfo memoryResidency;
+	static const std::string upscaleShaderProgram;
+	static const std::map<std::string, std::string> upscaleShaderCodes;
+
 	bool batchUniformVals;
 	bool hashUniformVals;
 	std::vector<std::string> uniformErrorAntispam;
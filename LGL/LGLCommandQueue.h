@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+// Lock-free multi-producer single-consumer queue of commands (Vyukov's node based queue).
+// Push can be called from any thread, Pop and Drain must not be called concurrently
+class LGLCommandQueue
+{
+public:
+	using Command = std::function<void()>;
+
+private:
+	struct Node
+	{
+		std::atomic<Node*> next;
+		Command command;
+
+		Node()
+		{
+			next.store(nullptr, std::memory_order_relaxed);
+		}
+	};
+
+	// Producers link new nodes after the head, consumer reads after the tail,
+	// tail always points to a node which command was already taken
+	std::atomic<Node*> head;
+	Node* tail;
+	Node stub;
+
+public:
+	LGLCommandQueue()
+	{
+		head.store(&stub, std::memory_order_relaxed);
+		tail = &stub;
+	}
+
+	~LGLCommandQueue()
+	{
+		Node* node = tail;
+
+		while (node)
+		{
+			Node* next = node->next.load(std::memory_order_relaxed);
+
+			if (node != &stub)
+			{
+				delete node;
+			}
+
+			node = next;
+		}
+	}
+
+	LGLCommandQueue(const LGLCommandQueue&) = delete;
+	LGLCommandQueue& operator=(const LGLCommandQueue&) = delete;
+
+	void Push(Command command)
+	{
+		Node* node = new Node();
+		node->command = std::move(command);
+
+		Node* previous = head.exchange(node, std::memory_order_acq_rel);
+		previous->next.store(node, std::memory_order_release);
+	}
+
+	// Returns false if the queue is empty, or if the next producer has not linked its node yet
+	bool Pop(Command& command)
+	{
+		Node* currentTail = tail;
+		Node* next = currentTail->next.load(std::memory_order_acquire);
+
+		if (!next)
+		{
+			return false;
+		}
+
+		command = std::move(next->command);
+		next->command = nullptr;
+		tail = next;
+
+		if (currentTail != &stub)
+		{
+			delete currentTail;
+		}
+
+		return true;
+	}
+
+	// Executes commands in the order they were pushed, returns amount of executed commands
+	size_t Drain()
+	{
+		size_t executed = 0;
+		Command command;
+
+		while (Pop(command))
+		{
+			command();
+			++executed;
+		}
+
+		return executed;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "LGLStructs.h"
+
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+
+class LGLFramePacer
+{
+private:
+	using Clock = std::chrono::steady_clock;
+	using Duration = std::chrono::duration<double>;
+
+	// Running mean and variance (Welford), used both for frame times and sleep overshoot
+	struct RunningStats
+	{
+		size_t amount = 0;
+		double mean = 0.0;
+		double m2 = 0.0;
+		double min = 0.0;
+		double max = 0.0;
+
+		void Add(double value)
+		{
+			++amount;
+
+			double delta = value - mean;
+			mean += delta / amount;
+			m2 += delta * (value - mean);
+
+			min = amount == 1 ? value : std::min(min, value);
+			max = amount == 1 ? value : std::max(max, value);
+		}
+
+		double GetVariance() const
+		{
+			return amount > 1 ? m2 / (amount - 1) : 0.0;
+		}
+
+		void Reset()
+		{
+			*this = RunningStats();
+		}
+	};
+
+	Duration targetFrameDuration;
+	Clock::time_point lastFrameTime;
+	Clock::time_point nextFrameTime;
+	bool frameTimingStarted;
+
+	// sleep_for is only accurate to OS scheduler granularity, actual duration of a short sleep is tracked
+	// to know at which point to stop sleeping and start spinning
+	constexpr static double sleepStep = 0.001;
+	RunningStats sleepStats;
+
+	RunningStats currentStats;
+	LGLStructs::FrameTimeStats lastReportedStats;
+	Duration reportPeriod;
+	Clock::time_point lastReportTime;
+	bool reportUpdated;
+
+	double GetSleepEstimate() const
+	{
+		if (sleepStats.amount < 2)
+		{
+			return sleepStep * 2.0;
+		}
+
+		return sleepStats.mean + std::sqrt(sleepStats.GetVariance());
+	}
+
+	void WaitUntil(Clock::time_point timePoint)
+	{
+		while (Duration(timePoint - Clock::now()).count() > GetSleepEstimate())
+		{
+			Clock::time_point sleepStart = Clock::now();
+			std::this_thread::sleep_for(Duration(sleepStep));
+			sleepStats.Add(Duration(Clock::now() - sleepStart).count());
+
+			// Keeps estimate adaptive to scheduler changes
+			if (sleepStats.amount > 1000)
+			{
+				double mean = sleepStats.mean;
+				sleepStats.Reset();
+				sleepStats.Add(mean);
+			}
+		}
+
+		while (Clock::now() < timePoint)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+public:
+	LGLFramePacer()
+	{
+		targetFrameDuration = Duration::zero();
+		frameTimingStarted = false;
+		reportPeriod = Duration(1.0);
+		reportUpdated = false;
+	}
+
+	// 0 or less disables the limiter
+	void SetTargetFPS(int targetFPS)
+	{
+		targetFrameDuration = targetFPS > 0 ? Duration(1.0 / targetFPS) : Duration::zero();
+		ResetFrameTiming();
+	}
+
+	int GetTargetFPS() const
+	{
+		return targetFrameDuration.count() > 0.0 ? static_cast<int>(std::round(1.0 / targetFrameDuration.count())) : 0;
+	}
+
+	// Next frame time will not be compared to the last one, used after pauses
+	void ResetFrameTiming()
+	{
+		frameTimingStarted = false;
+	}
+
+	// Waits till the next frame is due and returns time elapsed since the previous frame in seconds.
+	// Returns 0 if there is no previous frame to compare to
+	float WaitForNextFrame()
+	{
+		Clock::time_point now = Clock::now();
+
+		if (!frameTimingStarted)
+		{
+			frameTimingStarted = true;
+			lastFrameTime = now;
+			nextFrameTime = now;
+			lastReportTime = now;
+
+			return 0.0f;
+		}
+
+		if (targetFrameDuration.count() > 0.0)
+		{
+			nextFrameTime += std::chrono::duration_cast<Clock::duration>(targetFrameDuration);
+
+			// Frame took longer than the whole frame budget, catching up is pointless
+			if (nextFrameTime < now)
+			{
+				nextFrameTime = now;
+			}
+
+			WaitUntil(nextFrameTime);
+			now = Clock::now();
+		}
+
+		double frameTime = Duration(now - lastFrameTime).count();
+		lastFrameTime = now;
+
+		currentStats.Add(frameTime);
+
+		if (now - lastReportTime >= reportPeriod)
+		{
+			lastReportedStats.averageFrameTime = static_cast<float>(currentStats.mean);
+			lastReportedStats.frameTimeVariance = static_cast<float>(currentStats.GetVariance());
+			lastReportedStats.minFrameTime = static_cast<float>(currentStats.min);
+			lastReportedStats.maxFrameTime = static_cast<float>(currentStats.max);
+			lastReportedStats.frameAmount = currentStats.amount;
+
+			currentStats.Reset();
+			lastReportTime = now;
+			reportUpdated = true;
+		}
+
+		return static_cast<float>(frameTime);
+	}
+
+	// Statistics are collected over report period and are updated once it passes
+	void SetReportPeriod(float seconds)
+	{
+		reportPeriod = Duration(seconds);
+	}
+
+	// Returns true once per each finished report period
+	bool CheckAndResetReportUpdate()
+	{
+		bool updated = reportUpdated;
+		reportUpdated = false;
+
+		return updated;
+	}
+
+	const LGLStructs::FrameTimeStats& GetFrameTimeStats() const
+	{
+		return lastReportedStats;
+	}
+};
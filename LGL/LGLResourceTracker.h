@@ -0,0 +1,280 @@
+#pragma once
+
+#include "GLExecutor.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <unordered_map>
+#include <sstream>
+
+// Reference counts GL objects and defers their deletion until GPU is done with commands
+// issued before the last reference was released
+class LGLResourceTracker
+{
+public:
+	using ResourceID = unsigned int;
+
+	enum class ResourceType
+	{
+		VertexArray,
+		Buffer,
+		Texture,
+		ShaderProgram,
+		Framebuffer,
+		Renderbuffer,
+		_SIZE
+	};
+
+private:
+	struct ResourceInfo
+	{
+		size_t refCount = 0;
+		size_t byteSize = 0;
+		std::string label;
+	};
+
+	using ResourceKey = std::pair<ResourceType, ResourceID>;
+
+	struct PendingDeletion
+	{
+		GLsync fence = nullptr;
+		std::vector<ResourceKey> resources;
+	};
+
+	constexpr static size_t typeAmount = static_cast<size_t>(ResourceType::_SIZE);
+
+	// One second, only used when waiting for GPU is requested
+	constexpr static GLuint64 fenceWaitTimeout = 1000000000;
+
+	std::array<std::unordered_map<ResourceID, ResourceInfo>, typeAmount> resources;
+	std::array<size_t, typeAmount> trackedBytes = {};
+	size_t releasedBytes = 0;
+
+	std::vector<ResourceKey> releasedResources;
+	std::deque<PendingDeletion> pendingDeletions;
+
+	std::unordered_map<ResourceID, ResourceInfo>& GetResources(ResourceType type)
+	{
+		return resources[static_cast<size_t>(type)];
+	}
+
+	void DeleteResource(const ResourceKey& resource)
+	{
+		switch (resource.first)
+		{
+		case ResourceType::VertexArray:
+			GLSafeExecute(glDeleteVertexArrays, 1, &resource.second);
+			break;
+		case ResourceType::Buffer:
+			GLSafeExecute(glDeleteBuffers, 1, &resource.second);
+			break;
+		case ResourceType::Texture:
+			GLSafeExecute(glDeleteTextures, 1, &resource.second);
+			break;
+		case ResourceType::ShaderProgram:
+			GLSafeExecute(glDeleteProgram, resource.second);
+			break;
+		case ResourceType::Framebuffer:
+			GLSafeExecute(glDeleteFramebuffers, 1, &resource.second);
+			break;
+		case ResourceType::Renderbuffer:
+			GLSafeExecute(glDeleteRenderbuffers, 1, &resource.second);
+			break;
+		default:
+			break;
+		}
+
+		auto& typeResources = GetResources(resource.first);
+		auto resourceIter = typeResources.find(resource.second);
+
+		if (resourceIter != typeResources.end())
+		{
+			trackedBytes[static_cast<size_t>(resource.first)] -= resourceIter->second.byteSize;
+			releasedBytes -= resourceIter->second.byteSize;
+			typeResources.erase(resourceIter);
+		}
+	}
+
+public:
+	static const char* GetResourceTypeName(ResourceType type)
+	{
+		switch (type)
+		{
+		case ResourceType::VertexArray:
+			return "VertexArray";
+		case ResourceType::Buffer:
+			return "Buffer";
+		case ResourceType::Texture:
+			return "Texture";
+		case ResourceType::ShaderProgram:
+			return "ShaderProgram";
+		case ResourceType::Framebuffer:
+			return "Framebuffer";
+		case ResourceType::Renderbuffer:
+			return "Renderbuffer";
+		default:
+			return "Unknown";
+		}
+	}
+
+	// Newly created object starts with a single reference
+	void Register(ResourceType type, ResourceID id, size_t byteSize = 0, const std::string& label = "")
+	{
+		if (!id)
+		{
+			return;
+		}
+
+		ResourceInfo& resource = GetResources(type)[id];
+
+		trackedBytes[static_cast<size_t>(type)] += byteSize - resource.byteSize;
+
+		resource.refCount = 1;
+		resource.byteSize = byteSize;
+		resource.label = label;
+	}
+
+	// Returns false if the object is not tracked or is already waiting for deletion
+	bool AddRef(ResourceType type, ResourceID id)
+	{
+		auto& typeResources = GetResources(type);
+		auto resourceIter = typeResources.find(id);
+
+		if (resourceIter == typeResources.end() || !resourceIter->second.refCount)
+		{
+			return false;
+		}
+
+		++resourceIter->second.refCount;
+
+		return true;
+	}
+
+	// Returns true if the last reference was released, object is deleted by one of following garbage collections
+	bool Release(ResourceType type, ResourceID id)
+	{
+		auto& typeResources = GetResources(type);
+		auto resourceIter = typeResources.find(id);
+
+		if (resourceIter == typeResources.end() || !resourceIter->second.refCount)
+		{
+			return false;
+		}
+
+		if (--resourceIter->second.refCount)
+		{
+			return false;
+		}
+
+		releasedResources.emplace_back(type, id);
+		releasedBytes += resourceIter->second.byteSize;
+
+		return true;
+	}
+
+	size_t GetRefCount(ResourceType type, ResourceID id)
+	{
+		auto& typeResources = GetResources(type);
+		auto resourceIter = typeResources.find(id);
+
+		return resourceIter != typeResources.end() ? resourceIter->second.refCount : 0;
+	}
+
+	// Meant to be called once per frame after its commands were submitted.
+	// Objects released since the previous call are fenced, ones with signaled fences are deleted
+	void CollectGarbage(bool waitForGPU = false)
+	{
+		if (!releasedResources.empty())
+		{
+			PendingDeletion pendingDeletion;
+			pendingDeletion.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			pendingDeletion.resources.swap(releasedResources);
+
+			pendingDeletions.push_back(std::move(pendingDeletion));
+		}
+
+		while (!pendingDeletions.empty())
+		{
+			PendingDeletion& pendingDeletion = pendingDeletions.front();
+
+			if (pendingDeletion.fence)
+			{
+				GLenum waitRes = glClientWaitSync(
+					pendingDeletion.fence, GL_SYNC_FLUSH_COMMANDS_BIT, waitForGPU ? fenceWaitTimeout : 0
+				);
+
+				// Fences are signaled in order, so there is no point checking the following ones
+				if (waitRes == GL_TIMEOUT_EXPIRED)
+				{
+					break;
+				}
+
+				GLSafeExecute(glDeleteSync, pendingDeletion.fence);
+			}
+
+			for (auto& resource : pendingDeletion.resources)
+			{
+				DeleteResource(resource);
+			}
+
+			pendingDeletions.pop_front();
+		}
+	}
+
+	size_t GetTrackedBytes(ResourceType type) const
+	{
+		return trackedBytes[static_cast<size_t>(type)];
+	}
+
+	size_t GetTrackedBytes() const
+	{
+		size_t res = 0;
+
+		for (size_t bytes : trackedBytes)
+		{
+			res += bytes;
+		}
+
+		return res;
+	}
+
+	// Excludes objects which are only waiting for deletion
+	size_t GetResidentBytes() const
+	{
+		return GetTrackedBytes() - releasedBytes;
+	}
+
+	size_t GetAliveAmount() const
+	{
+		size_t res = 0;
+
+		for (auto& typeResources : resources)
+		{
+			res += typeResources.size();
+		}
+
+		return res;
+	}
+
+	// Lists every object which is still tracked
+	std::string GetReport() const
+	{
+		std::stringstream report;
+
+		for (size_t typeIndex = 0; typeIndex < typeAmount; ++typeIndex)
+		{
+			for (auto& resource : resources[typeIndex])
+			{
+				const ResourceInfo& info = resource.second;
+
+				report << GetResourceTypeName(static_cast<ResourceType>(typeIndex)) << ' ' << resource.first
+					<< " refs: " << info.refCount << " bytes: " << info.byteSize
+					<< (info.label.empty() ? "" : " label: " + info.label) << '\n';
+			}
+		}
+
+		return report.str();
+	}
+};
\ No newline at end of file
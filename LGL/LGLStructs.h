@@ -13,6 +13,7 @@
 #include <array>
 #include <map>
 #include <unordered_map>
+#include <utility>
 
 namespace LGLStructs
 {
@@ -240,14 +241,35 @@ namespace LGLStructs
 			behaviour(&behaviour) 
 		{}
 
+		MeshInfo(
+			Mesh&& mesh, 
+			const std::string& meshName, 
+			bool& render, 
+			bool& isDynamic, 
+			std::string& shaderProgram, 
+			std::function<void(int)>& behaviour
+		)
+		: 
+			mesh(std::move(mesh)), 
+			meshName(meshName), 
+			render(&render), 
+			isDynamic(&isDynamic), 
+			shaderProgram(&shaderProgram), 
+			behaviour(&behaviour) 
+		{}
+
 	};
 	
 	struct ModelInfo
 	{
 		std::vector<MeshInfo> meshes;
 		bool render;
+		// Whether any instance was in view, set by the owner every frame. Models out of view count as not drawn
+		bool visible = true;
 		bool isDynamic;
 		std::string shaderProgram;
+		// Position only variant of shaderProgram, model is skipped during depth pre-pass if empty
+		std::string depthShaderProgram;
 		std::function<void()> modelBehaviour;
  		std::function<void(int)> generalMeshBehaviour;
 
@@ -262,11 +284,26 @@ namespace LGLStructs
 			generalMeshBehaviour = nullptr;
 		}
 
+		ModelInfo(const ModelInfo& modelInfo)
+		{
+			*this = modelInfo;
+		}
+
+		ModelInfo(ModelInfo&& modelInfo)
+		{
+			*this = std::move(modelInfo);
+		}
+
 		void AddMesh(const Mesh& mesh, const std::string meshName)
 		{
 			meshes.emplace_back(MeshInfo(mesh, meshName, render, isDynamic, shaderProgram, generalMeshBehaviour));
 		}
 
+		void AddMesh(Mesh&& mesh, const std::string meshName)
+		{
+			meshes.emplace_back(MeshInfo(std::move(mesh), meshName, render, isDynamic, shaderProgram, generalMeshBehaviour));
+		}
+
 		std::vector<std::string> GetMeshNames()
 		{
 			std::vector<std::string> meshNames;
@@ -320,6 +357,7 @@ namespace LGLStructs
 			render = modelInfo.render;
 			isDynamic = modelInfo.isDynamic;
 			shaderProgram = modelInfo.shaderProgram;
+			depthShaderProgram = modelInfo.depthShaderProgram;
 			modelBehaviour = modelInfo.modelBehaviour;
 			generalMeshBehaviour = modelInfo.generalMeshBehaviour;
 			isTextureless = modelInfo.isTextureless;
@@ -328,6 +366,33 @@ namespace LGLStructs
 
 			return *this;
 		}
+
+		// Meshes keep their data, only their defaults are pointed to the new model
+		ModelInfo& operator=(ModelInfo&& modelInfo)
+		{
+			meshes = std::move(modelInfo.meshes);
+			render = modelInfo.render;
+			isDynamic = modelInfo.isDynamic;
+			shaderProgram = std::move(modelInfo.shaderProgram);
+			depthShaderProgram = std::move(modelInfo.depthShaderProgram);
+			modelBehaviour = std::move(modelInfo.modelBehaviour);
+			generalMeshBehaviour = std::move(modelInfo.generalMeshBehaviour);
+			isTextureless = modelInfo.isTextureless;
+
+			ResetDefaults();
+
+			return *this;
+		}
+	};
+
+	// Times are in seconds
+	struct FrameTimeStats
+	{
+		float averageFrameTime = 0.0f;
+		float frameTimeVariance = 0.0f;
+		float minFrameTime = 0.0f;
+		float maxFrameTime = 0.0f;
+		size_t frameAmount = 0;
 	};
 
 	struct GlyphTexture : Texture
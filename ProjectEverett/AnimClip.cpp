@@ -0,0 +1,252 @@
+#include "AnimClip.h"
+
+namespace
+{
+	glm::vec3 Interpolate(const glm::vec3& vec1, const glm::vec3& vec2, float factor)
+	{
+		return glm::mix(vec1, vec2, factor);
+	}
+
+	glm::quat Interpolate(const glm::quat& quat1, const glm::quat& quat2, float factor)
+	{
+		return glm::slerp(quat1, quat2, factor);
+	}
+
+	// Indices of keys which have to be kept for linear interpolation to stay within tolerance of the source keys
+	template<typename GLMType, typename ErrorFunc>
+	std::vector<size_t> ReduceKeys(const std::vector<std::pair<double, GLMType>>& keys, float tolerance, ErrorFunc GetError)
+	{
+		std::vector<size_t> keptKeys;
+
+		if (keys.empty())
+		{
+			return keptKeys;
+		}
+
+		keptKeys.push_back(0);
+
+		size_t anchor = 0;
+		for (size_t candidate = 2; candidate < keys.size(); ++candidate)
+		{
+			double anchorTime = keys[anchor].first;
+			double timeRange = keys[candidate].first - anchorTime;
+
+			for (size_t skipped = anchor + 1; skipped < candidate; ++skipped)
+			{
+				float factor = timeRange > 0.0 ? static_cast<float>((keys[skipped].first - anchorTime) / timeRange) : 0.0f;
+				GLMType interpolated = Interpolate(keys[anchor].second, keys[candidate].second, factor);
+
+				if (GetError(interpolated, keys[skipped].second) > tolerance)
+				{
+					anchor = candidate - 1;
+					keptKeys.push_back(anchor);
+					break;
+				}
+			}
+		}
+
+		if (keys.size() > 1)
+		{
+			keptKeys.push_back(keys.size() - 1);
+		}
+
+		// Constant track needs only a single key
+		if (keptKeys.size() == 2 && GetError(keys.front().second, keys.back().second) <= tolerance)
+		{
+			keptKeys.pop_back();
+		}
+
+		return keptKeys;
+	}
+}
+
+double AnimClip::GetUniformKeyStep(const std::vector<float>& times)
+{
+	if (times.size() < 2)
+	{
+		return 0.0;
+	}
+
+	double keyStep = (static_cast<double>(times.back()) - times.front()) / (times.size() - 1);
+	double tolerance = keyStep * 0.001;
+
+	if (keyStep <= 0.0)
+	{
+		return 0.0;
+	}
+
+	for (size_t i = 0; i < times.size(); ++i)
+	{
+		if (std::abs(times[i] - (times.front() + keyStep * i)) > tolerance)
+		{
+			return 0.0;
+		}
+	}
+
+	return keyStep;
+}
+
+AnimClip::PackedQuat AnimClip::PackQuat(const glm::quat& quat)
+{
+	constexpr float sqrt2 = 1.41421356f;
+	constexpr float halfRange15 = 32767.0f * 0.5f;
+	constexpr float halfRange16 = 65535.0f * 0.5f;
+
+	glm::quat normalized = glm::normalize(quat);
+	float components[4] = { normalized.x, normalized.y, normalized.z, normalized.w };
+
+	int largest = 0;
+	for (int i = 1; i < 4; ++i)
+	{
+		if (std::abs(components[i]) > std::abs(components[largest]))
+		{
+			largest = i;
+		}
+	}
+
+	// Quaternion and its negation are the same rotation, so the dropped component can be kept positive
+	float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	uint16_t quantized[3];
+	for (int i = 0, j = 0; i < 4; ++i)
+	{
+		if (i == largest)
+		{
+			continue;
+		}
+
+		// Remaining components are in [-1/sqrt(2), 1/sqrt(2)]
+		float value = std::clamp(components[i] * sign * sqrt2, -1.0f, 1.0f) + 1.0f;
+		quantized[j] = static_cast<uint16_t>(std::round(value * (j < 2 ? halfRange15 : halfRange16)));
+		++j;
+	}
+
+	return {
+		static_cast<uint16_t>((quantized[0] << 1) | ((largest >> 1) & 1)),
+		static_cast<uint16_t>((quantized[1] << 1) | (largest & 1)),
+		quantized[2]
+	};
+}
+
+AnimClip::Vec3Track AnimClip::CompressVec3Track(const std::vector<std::pair<double, glm::vec3>>& keys, float tolerance)
+{
+	Vec3Track track;
+
+	if (keys.empty())
+	{
+		return track;
+	}
+
+	glm::vec3 rangeMin = keys.front().second;
+	glm::vec3 rangeMax = keys.front().second;
+
+	for (auto& [time, value] : keys)
+	{
+		rangeMin = glm::min(rangeMin, value);
+		rangeMax = glm::max(rangeMax, value);
+	}
+
+	glm::vec3 extent = rangeMax - rangeMin;
+	float absoluteTolerance = std::max(tolerance * std::max({ extent.x, extent.y, extent.z }), 1e-6f);
+
+	std::vector<size_t> keptKeys = ReduceKeys(keys, absoluteTolerance,
+		[](const glm::vec3& vec1, const glm::vec3& vec2)
+		{
+			return glm::length(vec1 - vec2);
+		}
+	);
+
+	track.rangeMin = rangeMin;
+	track.rangeStep = extent / 65535.0f;
+	track.times.reserve(keptKeys.size());
+	track.values.reserve(keptKeys.size());
+
+	for (size_t keyIndex : keptKeys)
+	{
+		glm::vec3 normalized = glm::vec3(
+			extent.x > 0.0f ? (keys[keyIndex].second.x - rangeMin.x) / extent.x : 0.0f,
+			extent.y > 0.0f ? (keys[keyIndex].second.y - rangeMin.y) / extent.y : 0.0f,
+			extent.z > 0.0f ? (keys[keyIndex].second.z - rangeMin.z) / extent.z : 0.0f
+		);
+
+		glm::vec3 quantized = glm::round(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f);
+
+		track.times.push_back(static_cast<float>(keys[keyIndex].first));
+		track.values.push_back({
+			static_cast<uint16_t>(quantized.x), static_cast<uint16_t>(quantized.y), static_cast<uint16_t>(quantized.z)
+		});
+	}
+
+	track.keyStep = GetUniformKeyStep(track.times);
+
+	return track;
+}
+
+AnimClip::QuatTrack AnimClip::CompressQuatTrack(const std::vector<std::pair<double, glm::quat>>& keys, float tolerance)
+{
+	QuatTrack track;
+
+	// Stored components are rounded by up to half a step. Dropped component is rebuilt from them and is at least 1/2,
+	// which amplifies their error at most sqrt(3) times, so quaternion error is at most twice theirs and angle error
+	// twice that. Only the rest of the tolerance, about 0.13 mrad less, is spent on dropping keys
+	constexpr float halfStep15 = 0.5f / (1.41421356f * 32767.0f * 0.5f);
+	constexpr float halfStep16 = 0.5f / (1.41421356f * 65535.0f * 0.5f);
+	const float quantizationError = 4.0f * std::sqrt(2.0f * halfStep15 * halfStep15 + halfStep16 * halfStep16);
+
+	std::vector<size_t> keptKeys = ReduceKeys(keys, std::max(tolerance - quantizationError, 0.0f),
+		[](const glm::quat& quat1, const glm::quat& quat2)
+		{
+			glm::quat normalized1 = glm::normalize(quat1);
+			glm::quat normalized2 = glm::normalize(quat2);
+
+			if (glm::dot(normalized1, normalized2) < 0.0f)
+			{
+				normalized2 = -normalized2;
+			}
+
+			// Chord between unit quaternions is 2 * sin(angle / 4), unlike acos of their dot it stays precise for small angles
+			float chord = glm::length(glm::vec4(
+				normalized1.x - normalized2.x, normalized1.y - normalized2.y, normalized1.z - normalized2.z, normalized1.w - normalized2.w
+			));
+
+			return 4.0f * std::asin(std::min(chord * 0.5f, 1.0f));
+		}
+	);
+
+	track.times.reserve(keptKeys.size());
+	track.values.reserve(keptKeys.size());
+
+	for (size_t keyIndex : keptKeys)
+	{
+		track.times.push_back(static_cast<float>(keys[keyIndex].first));
+		track.values.push_back(PackQuat(keys[keyIndex].second));
+	}
+
+	track.keyStep = GetUniformKeyStep(track.times);
+
+	return track;
+}
+
+AnimClip::Channel AnimClip::CompressChannel(
+	const std::vector<std::pair<double, glm::vec3>>& positionKeys,
+	const std::vector<std::pair<double, glm::quat>>& rotationKeys,
+	const std::vector<std::pair<double, glm::vec3>>& scalingKeys,
+	const CompressionSettings& settings
+)
+{
+	Channel channel;
+
+	channel.position = CompressVec3Track(positionKeys, settings.positionTolerance);
+	channel.rotation = CompressQuatTrack(rotationKeys, settings.rotationTolerance);
+	channel.scaling = CompressVec3Track(scalingKeys, settings.scalingTolerance);
+
+	return channel;
+}
+
+size_t AnimClip::GetByteSize(const Channel& channel)
+{
+	return sizeof(Channel) +
+		channel.position.times.size() * (sizeof(float) + sizeof(PackedVec3)) +
+		channel.rotation.times.size() * (sizeof(float) + sizeof(PackedQuat)) +
+		channel.scaling.times.size() * (sizeof(float) + sizeof(PackedVec3));
+}
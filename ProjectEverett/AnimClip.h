@@ -0,0 +1,119 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// Compressed animation channels. Keys which linear interpolation reproduces are removed at load,
+// remaining values are quantized and decoded during evaluation
+class AnimClip
+{
+public:
+	// Components quantized to 16 bits inside of the track range
+	struct PackedVec3
+	{
+		uint16_t x;
+		uint16_t y;
+		uint16_t z;
+	};
+
+	// Smallest three encoding: largest component is dropped and restored from unit length,
+	// its index is stored in the lowest bits of the first two values
+	struct PackedQuat
+	{
+		uint16_t a;
+		uint16_t b;
+		uint16_t c;
+	};
+
+	struct Vec3Track
+	{
+		std::vector<float> times;
+		std::vector<PackedVec3> values;
+		glm::vec3 rangeMin = glm::vec3(0.0f);
+		glm::vec3 rangeStep = glm::vec3(0.0f);
+		// Spacing of evenly spaced keys, lets lookup be done by index arithmetic. 0 if spacing is uneven
+		double keyStep = 0.0;
+
+		glm::vec3 GetValue(size_t index) const
+		{
+			const PackedVec3& value = values[index];
+
+			return rangeMin + rangeStep * glm::vec3(value.x, value.y, value.z);
+		}
+	};
+
+	struct QuatTrack
+	{
+		std::vector<float> times;
+		std::vector<PackedQuat> values;
+		double keyStep = 0.0;
+
+		glm::quat GetValue(size_t index) const
+		{
+			return UnpackQuat(values[index]);
+		}
+	};
+
+	struct Channel
+	{
+		Vec3Track position;
+		QuatTrack rotation;
+		Vec3Track scaling;
+	};
+
+	struct CompressionSettings
+	{
+		// Relative to the largest extent of the track values
+		float positionTolerance = 0.0005f;
+		float scalingTolerance = 0.0005f;
+		// In radians, error of quantized rotations is included
+		float rotationTolerance = 0.001f;
+	};
+
+	static Channel CompressChannel(
+		const std::vector<std::pair<double, glm::vec3>>& positionKeys,
+		const std::vector<std::pair<double, glm::quat>>& rotationKeys,
+		const std::vector<std::pair<double, glm::vec3>>& scalingKeys,
+		const CompressionSettings& settings
+	);
+
+	static size_t GetByteSize(const Channel& channel);
+
+	static PackedQuat PackQuat(const glm::quat& quat);
+
+	static glm::quat UnpackQuat(const PackedQuat& packedQuat)
+	{
+		constexpr float sqrt2 = 1.41421356f;
+		constexpr float halfRange15 = 32767.0f * 0.5f;
+		constexpr float halfRange16 = 65535.0f * 0.5f;
+
+		int largest = ((packedQuat.a & 1) << 1) | (packedQuat.b & 1);
+
+		float a = ((packedQuat.a >> 1) / halfRange15 - 1.0f) / sqrt2;
+		float b = ((packedQuat.b >> 1) / halfRange15 - 1.0f) / sqrt2;
+		float c = (packedQuat.c / halfRange16 - 1.0f) / sqrt2;
+		float d = std::sqrt(std::max(0.0f, 1.0f - a * a - b * b - c * c));
+
+		switch (largest)
+		{
+		case 0:
+			return glm::quat(c, d, a, b);
+		case 1:
+			return glm::quat(c, a, d, b);
+		case 2:
+			return glm::quat(c, a, b, d);
+		default:
+			return glm::quat(d, a, b, c);
+		}
+	}
+private:
+	static double GetUniformKeyStep(const std::vector<float>& times);
+
+	static Vec3Track CompressVec3Track(const std::vector<std::pair<double, glm::vec3>>& keys, float tolerance);
+	static QuatTrack CompressQuatTrack(const std::vector<std::pair<double, glm::quat>>& keys, float tolerance);
+};
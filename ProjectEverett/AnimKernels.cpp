@@ -0,0 +1,275 @@
+#include "AnimKernels.h"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define ANIM_KERNELS_SSE
+#include <xmmintrin.h>
+#endif
+
+AnimKernels::Affine AnimKernels::ToAffine(const glm::mat4& matrix)
+{
+	Affine res;
+
+	for (int row = 0; row < 3; ++row)
+	{
+		res[row] = glm::vec4(matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]);
+	}
+
+	return res;
+}
+
+glm::mat4 AnimKernels::ToMat4(const Affine& affine)
+{
+	glm::mat4 res(1.0f);
+
+	for (int row = 0; row < 3; ++row)
+	{
+		for (int column = 0; column < 4; ++column)
+		{
+			res[column][row] = affine[row][column];
+		}
+	}
+
+	return res;
+}
+
+void AnimKernels::ComposeTRSScalar(const TRSArrays& trs, size_t begin, size_t end, Affine* res)
+{
+	for (size_t i = begin; i < end; ++i)
+	{
+		float x = trs.rotX[i];
+		float y = trs.rotY[i];
+		float z = trs.rotZ[i];
+		float w = trs.rotW[i];
+
+		float xx = x * x, yy = y * y, zz = z * z;
+		float xy = x * y, xz = x * z, yz = y * z;
+		float wx = w * x, wy = w * y, wz = w * z;
+
+		float sx = trs.scaX[i];
+		float sy = trs.scaY[i];
+		float sz = trs.scaZ[i];
+
+		res[i][0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * sx, 2.0f * (xy - wz) * sy, 2.0f * (xz + wy) * sz, trs.posX[i]);
+		res[i][1] = glm::vec4(2.0f * (xy + wz) * sx, (1.0f - 2.0f * (xx + zz)) * sy, 2.0f * (yz - wx) * sz, trs.posY[i]);
+		res[i][2] = glm::vec4(2.0f * (xz - wy) * sx, 2.0f * (yz + wx) * sy, (1.0f - 2.0f * (xx + yy)) * sz, trs.posZ[i]);
+	}
+}
+
+void AnimKernels::ComposeTRS(const TRSArrays& trs, size_t amount, Affine* res)
+{
+	size_t i = 0;
+
+#ifdef ANIM_KERNELS_SSE
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	// Every lane is a separate channel, results are transposed into rows of 4 matrices at once
+	for (; i + 4 <= amount; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(trs.rotX + i);
+		__m128 y = _mm_loadu_ps(trs.rotY + i);
+		__m128 z = _mm_loadu_ps(trs.rotZ + i);
+		__m128 w = _mm_loadu_ps(trs.rotW + i);
+
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		__m128 sx = _mm_loadu_ps(trs.scaX + i);
+		__m128 sy = _mm_loadu_ps(trs.scaY + i);
+		__m128 sz = _mm_loadu_ps(trs.scaZ + i);
+
+		__m128 m00 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+		__m128 m01 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+		__m128 m02 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+		__m128 m03 = _mm_loadu_ps(trs.posX + i);
+
+		__m128 m10 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+		__m128 m11 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+		__m128 m12 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+		__m128 m13 = _mm_loadu_ps(trs.posY + i);
+
+		__m128 m20 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+		__m128 m21 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+		__m128 m22 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+		__m128 m23 = _mm_loadu_ps(trs.posZ + i);
+
+		_MM_TRANSPOSE4_PS(m00, m01, m02, m03);
+		_MM_TRANSPOSE4_PS(m10, m11, m12, m13);
+		_MM_TRANSPOSE4_PS(m20, m21, m22, m23);
+
+		_mm_storeu_ps(&res[i + 0][0][0], m00);
+		_mm_storeu_ps(&res[i + 0][1][0], m10);
+		_mm_storeu_ps(&res[i + 0][2][0], m20);
+
+		_mm_storeu_ps(&res[i + 1][0][0], m01);
+		_mm_storeu_ps(&res[i + 1][1][0], m11);
+		_mm_storeu_ps(&res[i + 1][2][0], m21);
+
+		_mm_storeu_ps(&res[i + 2][0][0], m02);
+		_mm_storeu_ps(&res[i + 2][1][0], m12);
+		_mm_storeu_ps(&res[i + 2][2][0], m22);
+
+		_mm_storeu_ps(&res[i + 3][0][0], m03);
+		_mm_storeu_ps(&res[i + 3][1][0], m13);
+		_mm_storeu_ps(&res[i + 3][2][0], m23);
+	}
+#endif
+
+	ComposeTRSScalar(trs, i, amount, res);
+}
+
+void AnimKernels::Multiply(const Affine& left, const Affine& right, Affine& res)
+{
+#ifdef ANIM_KERNELS_SSE
+	const __m128 lastRow = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+	__m128 right0 = _mm_loadu_ps(&right[0][0]);
+	__m128 right1 = _mm_loadu_ps(&right[1][0]);
+	__m128 right2 = _mm_loadu_ps(&right[2][0]);
+
+	__m128 resRows[3];
+
+	for (int row = 0; row < 3; ++row)
+	{
+		__m128 leftRow = _mm_loadu_ps(&left[row][0]);
+
+		__m128 resRow = _mm_mul_ps(_mm_shuffle_ps(leftRow, leftRow, _MM_SHUFFLE(0, 0, 0, 0)), right0);
+		resRow = _mm_add_ps(resRow, _mm_mul_ps(_mm_shuffle_ps(leftRow, leftRow, _MM_SHUFFLE(1, 1, 1, 1)), right1));
+		resRow = _mm_add_ps(resRow, _mm_mul_ps(_mm_shuffle_ps(leftRow, leftRow, _MM_SHUFFLE(2, 2, 2, 2)), right2));
+		resRow = _mm_add_ps(resRow, _mm_mul_ps(_mm_shuffle_ps(leftRow, leftRow, _MM_SHUFFLE(3, 3, 3, 3)), lastRow));
+
+		resRows[row] = resRow;
+	}
+
+	for (int row = 0; row < 3; ++row)
+	{
+		_mm_storeu_ps(&res[row][0], resRows[row]);
+	}
+#else
+	Affine resCopy;
+
+	for (int row = 0; row < 3; ++row)
+	{
+		resCopy[row] = left[row][0] * right[0] + left[row][1] * right[1] + left[row][2] * right[2];
+		resCopy[row][3] += left[row][3];
+	}
+
+	res = resCopy;
+#endif
+}
+
+void AnimKernels::ToDualQuats(const Affine* affines, size_t amount, glm::vec4* res)
+{
+	for (size_t i = 0; i < amount; ++i)
+	{
+		const Affine& affine = affines[i];
+
+		glm::mat3 rotation;
+		for (int column = 0; column < 3; ++column)
+		{
+			glm::vec3 axis(affine[0][column], affine[1][column], affine[2][column]);
+			float length = glm::length(axis);
+
+			rotation[column] = length > 0.0f ? axis / length : axis;
+		}
+
+		glm::quat real = glm::normalize(glm::quat_cast(rotation));
+		glm::quat dual = glm::quat(0.0f, affine[0][3], affine[1][3], affine[2][3]) * real * 0.5f;
+
+		res[i * 2] = glm::vec4(real.x, real.y, real.z, real.w);
+		res[i * 2 + 1] = glm::vec4(dual.x, dual.y, dual.z, dual.w);
+	}
+}
+
+bool AnimKernels::SelfTest()
+{
+	constexpr size_t testAmount = 37;
+	constexpr float tolerance = 1e-4f;
+
+	std::mt19937 generator(1337);
+	std::uniform_real_distribution<float> distribution(-2.0f, 2.0f);
+
+	auto Matches = [tolerance](const Affine& affine, const glm::mat4& expected)
+	{
+		Affine expectedAffine = ToAffine(expected);
+
+		for (int row = 0; row < 3; ++row)
+		{
+			for (int column = 0; column < 4; ++column)
+			{
+				float diff = std::abs(affine[row][column] - expectedAffine[row][column]);
+
+				if (diff > tolerance * std::max(1.0f, std::abs(expectedAffine[row][column])))
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	};
+
+	std::vector<float> values(testAmount * 10);
+	for (float& value : values)
+	{
+		value = distribution(generator);
+	}
+
+	// Non normalized quaternions are kept on purpose, scalar path does not normalize them either
+	TRSArrays trs =
+	{
+		&values[testAmount * 0], &values[testAmount * 1], &values[testAmount * 2],
+		&values[testAmount * 3], &values[testAmount * 4], &values[testAmount * 5], &values[testAmount * 6],
+		&values[testAmount * 7], &values[testAmount * 8], &values[testAmount * 9]
+	};
+
+	std::vector<Affine> composed(testAmount);
+	ComposeTRS(trs, testAmount, composed.data());
+
+	std::vector<glm::mat4> expected(testAmount);
+
+	for (size_t i = 0; i < testAmount; ++i)
+	{
+		glm::mat4 translation = glm::translate(glm::mat4(1.0f), glm::vec3(trs.posX[i], trs.posY[i], trs.posZ[i]));
+		glm::mat4 rotation = glm::mat4_cast(glm::quat(trs.rotW[i], trs.rotX[i], trs.rotY[i], trs.rotZ[i]));
+		glm::mat4 scaling = glm::scale(glm::mat4(1.0f), glm::vec3(trs.scaX[i], trs.scaY[i], trs.scaZ[i]));
+
+		expected[i] = translation * rotation * scaling;
+
+		if (!Matches(composed[i], expected[i]))
+		{
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i + 1 < testAmount; ++i)
+	{
+		Affine multiplied;
+		Multiply(composed[i], composed[i + 1], multiplied);
+
+		if (!Matches(multiplied, expected[i] * expected[i + 1]))
+		{
+			return false;
+		}
+
+		// Result aliasing an argument, as done by hierarchy evaluation
+		Multiply(composed[i], composed[i + 1], composed[i + 1]);
+
+		if (!Matches(composed[i + 1], expected[i] * expected[i + 1]))
+		{
+			return false;
+		}
+
+		composed[i + 1] = ToAffine(expected[i + 1]);
+	}
+
+	return true;
+}
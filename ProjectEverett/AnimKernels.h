@@ -0,0 +1,45 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <cstddef>
+
+// Batch kernels for pose evaluation. Affine transforms are stored as glm::mat3x4 holding the rows of the matrix,
+// its last row is implicitly 0 0 0 1. This is also the layout of bone palette expected by shaders
+class AnimKernels
+{
+public:
+	using Affine = glm::mat3x4;
+
+	// Sampled channels in structure of arrays form, every array holds amount elements
+	struct TRSArrays
+	{
+		const float* posX;
+		const float* posY;
+		const float* posZ;
+		const float* rotX;
+		const float* rotY;
+		const float* rotZ;
+		const float* rotW;
+		const float* scaX;
+		const float* scaY;
+		const float* scaZ;
+	};
+
+	static Affine ToAffine(const glm::mat4& matrix);
+	static glm::mat4 ToMat4(const Affine& affine);
+
+	// res[i] = translate(pos[i]) * mat4_cast(rot[i]) * scale(sca[i])
+	static void ComposeTRS(const TRSArrays& trs, size_t amount, Affine* res);
+	// res = left * right, res may alias any of arguments
+	static void Multiply(const Affine& left, const Affine& right, Affine& res);
+	// Writes rotation and translation of each transform as a dual quaternion, two vec4 per transform:
+	// real part followed by dual part, both as x y z w. Scaling can not be represented and is dropped
+	static void ToDualQuats(const Affine* affines, size_t amount, glm::vec4* res);
+
+	// Compares kernels with scalar glm on generated poses, returns false on mismatch
+	static bool SelfTest();
+private:
+	static void ComposeTRSScalar(const TRSArrays& trs, size_t begin, size_t end, Affine* res);
+};
@@ -1,6 +1,9 @@
 #include "AnimSystem.h"
 #include "LGL.h"
 
+#include <numeric>
+#include <string_view>
+
 void AnimSystem::InterpolateImpl(const glm::vec3& vec1, const glm::vec3& vec2, glm::vec3& resVec, float factor)
 {
 	resVec = glm::mix(vec1, vec2, factor);
@@ -11,128 +14,1037 @@ void AnimSystem::InterpolateImpl(const glm::quat& quat1, const glm::quat& quat2,
 	resQuat = glm::slerp(quat1, quat2, factor);
 }
 
-template<typename GLMType>
-void AnimSystem::InterpolateKey(std::vector<std::pair<double, GLMType>>& keys, GLMType& res, double animTime)
+size_t AnimSystem::FindKeyIndex(const std::vector<float>& times, double keyStep, size_t cursor, bool seek, double animTime)
 {
-	size_t keyAmount = keys.size();
+	// Caller guarantees animTime is before the last key, so there is always a following key
+	size_t lastPairIndex = times.size() - 2;
+	size_t keyIndex = 0;
+
+	if (keyStep > 0.0)
+	{
+		double keyOffset = (animTime - times.front()) / keyStep;
+		keyIndex = keyOffset > 0.0 ? std::min(static_cast<size_t>(keyOffset), lastPairIndex) : 0;
+
+		// Corrects floating point error at key boundaries
+		while (keyIndex < lastPairIndex && animTime >= times[keyIndex + 1])
+		{
+			++keyIndex;
+		}
+
+		while (keyIndex && animTime < times[keyIndex])
+		{
+			--keyIndex;
+		}
+	}
+	else if (seek || cursor > lastPairIndex || animTime < times[cursor])
+	{
+		auto timeIter = std::upper_bound(times.begin(), times.end(), animTime);
+
+		keyIndex = timeIter != times.begin() ? std::min(static_cast<size_t>(timeIter - times.begin()) - 1, lastPairIndex) : 0;
+	}
+	else
+	{
+		// Playback moves forward, usually by no more than a key per frame
+		keyIndex = cursor;
+
+		while (animTime >= times[keyIndex + 1])
+		{
+			++keyIndex;
+		}
+	}
+
+	return keyIndex;
+}
+
+template<typename Track, typename GLMType>
+void AnimSystem::InterpolateKey(const Track& track, size_t& cursor, bool seek, GLMType& res, double animTime)
+{
+	const std::vector<float>& times = track.times;
+	size_t keyAmount = times.size();
 
 	if (keyAmount)
 	{
-		for (size_t i = 0; i < keyAmount - 1; ++i)
+		if (keyAmount == 1 || animTime >= times.back())
+		{
+			res = track.GetValue(keyAmount - 1);
+			cursor = keyAmount - 1;
+
+			return;
+		}
+
+		size_t keyIndex = FindKeyIndex(times, track.keyStep, cursor, seek, animTime);
+
+		double t1 = times[keyIndex];
+		double t2 = times[keyIndex + 1];
+		float factor = static_cast<float>((animTime - t1) / (t2 - t1));
+
+		InterpolateImpl(track.GetValue(keyIndex), track.GetValue(keyIndex + 1), res, factor);
+
+		cursor = keyIndex;
+	}
+}
+
+void AnimSystem::CompileSkeleton(ModelAnim& modelAnim)
+{
+	Skeleton& skeleton = modelAnim.skeleton;
+	skeleton = Skeleton();
+
+	// Depth first traversal with explicit stack, children are pushed in reverse to keep sibling order
+	std::vector<std::pair<BoneTree::TreeManagerNode*, int>> nodesToVisit;
+
+	for (auto& rootNode : modelAnim.boneTree.GetChildren())
+	{
+		nodesToVisit.emplace_back(&rootNode, -1);
+	}
+
+	std::reverse(nodesToVisit.begin(), nodesToVisit.end());
+
+	while (!nodesToVisit.empty())
+	{
+		auto [node, parentIndex] = nodesToVisit.back();
+		nodesToVisit.pop_back();
+
+		int nodeIndex = static_cast<int>(skeleton.parentIndices.size());
+		BoneInfo& bone = node->GetValue();
+
+		skeleton.parentIndices.push_back(parentIndex);
+		skeleton.boneIds.push_back(bone.id);
+		skeleton.localTransforms.push_back(AnimKernels::ToAffine(bone.localTransform));
+		skeleton.offsetMatrices.push_back(AnimKernels::ToAffine(bone.offsetMatrix));
+		skeleton.nodeNames.push_back(node->GetKey());
+
+		size_t firstChildIndex = nodesToVisit.size();
+
+		for (auto& childNode : node->GetChildren())
+		{
+			nodesToVisit.emplace_back(&childNode, nodeIndex);
+		}
+
+		std::reverse(nodesToVisit.begin() + firstChildIndex, nodesToVisit.end());
+	}
+
+	skeleton.globalInverseTransform = AnimKernels::ToAffine(modelAnim.globalInverseTransform);
+
+	size_t nodeAmount = skeleton.parentIndices.size();
+	size_t animAmount = modelAnim.animInfoVect.size();
+
+	skeleton.channelIndices.assign(animAmount, std::vector<int>(nodeAmount, -1));
+
+	std::unordered_map<std::string, int> nodeIndexMap;
+	for (size_t nodeIndex = 0; nodeIndex < nodeAmount; ++nodeIndex)
+	{
+		nodeIndexMap.emplace(skeleton.nodeNames[nodeIndex], static_cast<int>(nodeIndex));
+	}
+
+	modelAnim.rawClips.resize(animAmount);
+	modelAnim.clips.clear();
+	modelAnim.clipLibrary = nullptr;
+
+	for (auto& rawClip : modelAnim.rawClips)
+	{
+		rawClip.nodeIndices.clear();
+
+		for (auto& nodeName : rawClip.nodeNames)
+		{
+			auto nodeIter = nodeIndexMap.find(nodeName);
+			rawClip.nodeIndices.push_back(nodeIter != nodeIndexMap.end() ? nodeIter->second : -1);
+		}
+
+		std::vector<std::string>().swap(rawClip.nodeNames);
+	}
+}
+
+void AnimSystem::AppendRawChannel(RawClip& rawClip, const std::string& nodeName, const AnimKeys& keys)
+{
+	rawClip.nodeNames.push_back(nodeName);
+	rawClip.keyAmounts.push_back(static_cast<uint32_t>(keys.positionKeys.size()));
+	rawClip.keyAmounts.push_back(static_cast<uint32_t>(keys.rotationKeys.size()));
+	rawClip.keyAmounts.push_back(static_cast<uint32_t>(keys.scalingKeys.size()));
+
+	for (auto& [time, position] : keys.positionKeys)
+	{
+		rawClip.keys.insert(rawClip.keys.end(), { static_cast<float>(time), position.x, position.y, position.z });
+	}
+
+	for (auto& [time, rotation] : keys.rotationKeys)
+	{
+		rawClip.keys.insert(rawClip.keys.end(), { static_cast<float>(time), rotation.w, rotation.x, rotation.y, rotation.z });
+	}
+
+	for (auto& [time, scaling] : keys.scalingKeys)
+	{
+		rawClip.keys.insert(rawClip.keys.end(), { static_cast<float>(time), scaling.x, scaling.y, scaling.z });
+	}
+}
+
+size_t AnimSystem::GetSkeletonSignature(const std::vector<std::string>& nodeNames, const std::vector<int>& parentIndices)
+{
+	std::hash<std::string> hasher;
+	size_t signature = nodeNames.size();
+
+	// Hash of every node and its parent is summed, sum does not depend on order
+	for (size_t nodeIndex = 0; nodeIndex < nodeNames.size(); ++nodeIndex)
+	{
+		int parentIndex = parentIndices[nodeIndex];
+
+		size_t hash = hasher(nodeNames[nodeIndex]);
+		size_t parentHash = parentIndex != -1 ? hasher(nodeNames[parentIndex]) : 0;
+
+		signature += hash ^ (parentHash + 0x9e3779b9 + (hash << 6) + (hash >> 2));
+	}
+
+	return signature;
+}
+
+bool AnimSystem::MapToLibrary(const ClipLibrary& clipLibrary, const Skeleton& skeleton, std::vector<int>& remap)
+{
+	size_t nodeAmount = skeleton.parentIndices.size();
+
+	if (clipLibrary.nodeNames.size() != nodeAmount)
+	{
+		return false;
+	}
+
+	remap.assign(nodeAmount, -1);
+	std::vector<bool> mapped(nodeAmount, false);
+
+	// Parents precede their children, so the parent of every node is already mapped
+	for (size_t nodeIndex = 0; nodeIndex < nodeAmount; ++nodeIndex)
+	{
+		auto libraryNodeIter = clipLibrary.nodeIndexMap.find(skeleton.nodeNames[nodeIndex]);
+
+		if (libraryNodeIter == clipLibrary.nodeIndexMap.end() || mapped[libraryNodeIter->second])
+		{
+			return false;
+		}
+
+		int libraryNodeIndex = libraryNodeIter->second;
+		int parentIndex = skeleton.parentIndices[nodeIndex];
+
+		if (clipLibrary.parentIndices[libraryNodeIndex] != (parentIndex != -1 ? remap[parentIndex] : -1))
+		{
+			return false;
+		}
+
+		remap[nodeIndex] = libraryNodeIndex;
+		mapped[libraryNodeIndex] = true;
+	}
+
+	return true;
+}
+
+AnimSystem::KeysDigest AnimSystem::GetKeysDigest(const std::vector<float>& keys)
+{
+	std::string_view bytes(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(float));
+
+	KeysDigest keysDigest;
+	keysDigest.hash = std::hash<std::string_view>()(bytes);
+
+	// FNV-1a, independent of the standard hash
+	keysDigest.fnvHash = 0xcbf29ce484222325;
+	for (char byte : bytes)
+	{
+		keysDigest.fnvHash ^= static_cast<uint8_t>(byte);
+		keysDigest.fnvHash *= 0x100000001b3;
+	}
+
+	return keysDigest;
+}
+
+std::vector<int> AnimSystem::GetModelChannelIndices(const RawClip& rawClip, const std::vector<int>& remap)
+{
+	size_t nodeAmount = remap.size();
+
+	std::vector<int> libraryChannelIndices = GetChannelIndices(rawClip, nodeAmount);
+	std::vector<int> channelIndices(nodeAmount, -1);
+
+	for (size_t nodeIndex = 0; nodeIndex < nodeAmount; ++nodeIndex)
+	{
+		channelIndices[nodeIndex] = libraryChannelIndices[remap[nodeIndex]];
+	}
+
+	return channelIndices;
+}
+
+void AnimSystem::RegisterClips(ModelAnim& modelAnim)
+{
+	Skeleton& skeleton = modelAnim.skeleton;
+	size_t nodeAmount = skeleton.parentIndices.size();
+
+	auto& libraries = clipLibraries[GetSkeletonSignature(skeleton.nodeNames, skeleton.parentIndices)];
+
+	libraries.erase(
+		std::remove_if(libraries.begin(), libraries.end(), [](const std::weak_ptr<ClipLibrary>& library) { return library.expired(); }),
+		libraries.end()
+	);
+
+	std::vector<int> remap;
+	modelAnim.clipLibrary = nullptr;
+
+	for (auto& weakLibrary : libraries)
+	{
+		std::shared_ptr<ClipLibrary> library = weakLibrary.lock();
+
+		if (MapToLibrary(*library, skeleton, remap))
+		{
+			modelAnim.clipLibrary = library;
+			break;
+		}
+	}
+
+	if (!modelAnim.clipLibrary)
+	{
+		modelAnim.clipLibrary = std::make_shared<ClipLibrary>();
+		modelAnim.clipLibrary->nodeNames = skeleton.nodeNames;
+		modelAnim.clipLibrary->parentIndices = skeleton.parentIndices;
+
+		for (size_t nodeIndex = 0; nodeIndex < nodeAmount; ++nodeIndex)
+		{
+			modelAnim.clipLibrary->nodeIndexMap.emplace(skeleton.nodeNames[nodeIndex], static_cast<int>(nodeIndex));
+		}
+
+		libraries.push_back(modelAnim.clipLibrary);
+
+		remap.resize(nodeAmount);
+		std::iota(remap.begin(), remap.end(), 0);
+	}
+
+	ClipLibrary& clipLibrary = *modelAnim.clipLibrary;
+	modelAnim.clips.clear();
+	modelAnim.libraryRemap = remap;
+	modelAnim.libraryClipsBound = 0;
+
+	std::lock_guard<std::mutex> lock(clipLibrary.clipsMux);
+
+	size_t libraryClipAmount = clipLibrary.clips.size();
+
+	for (size_t animIndex = 0; animIndex < modelAnim.rawClips.size(); ++animIndex)
+	{
+		RawClip& rawClip = modelAnim.rawClips[animIndex];
+		const AnimInfo& animInfo = modelAnim.animInfoVect[animIndex];
+
+		for (int& nodeIndex : rawClip.nodeIndices)
+		{
+			nodeIndex = nodeIndex != -1 ? remap[nodeIndex] : -1;
+		}
+
+		rawClip.keysDigest = GetKeysDigest(rawClip.keys);
+
+		// Keys of library clips are not compared, render thread frees them once the clip is cooked
+		auto clipIter = std::find_if(clipLibrary.clips.begin(), clipLibrary.clips.end(),
+			[&animInfo, &rawClip](const SharedClip& clip)
+			{
+				return
+					clip.animInfo.animName == animInfo.animName &&
+					clip.animInfo.animDuration == animInfo.animDuration &&
+					clip.animInfo.ticksPerSecond == animInfo.ticksPerSecond &&
+					clip.rawClip.nodeIndices == rawClip.nodeIndices &&
+					clip.rawClip.keyAmounts == rawClip.keyAmounts &&
+					clip.rawClip.keysDigest == rawClip.keysDigest;
+			}
+		);
+
+		if (clipIter == clipLibrary.clips.end())
+		{
+			clipLibrary.clips.push_back(SharedClip{ animInfo, std::move(rawClip) });
+			clipIter = std::prev(clipLibrary.clips.end());
+		}
+
+		modelAnim.clips.push_back(&*clipIter);
+
+		skeleton.channelIndices[animIndex] = GetModelChannelIndices(clipIter->rawClip, remap);
+	}
+
+	std::vector<RawClip>().swap(modelAnim.rawClips);
+
+	if (clipLibrary.clips.size() > libraryClipAmount)
+	{
+		libraryClipsAdded = true;
+	}
+
+	BindLibraryClipsImpl(modelAnim);
+}
+
+bool AnimSystem::LibraryClipsAdded()
+{
+	return libraryClipsAdded.exchange(false);
+}
+
+bool AnimSystem::BindLibraryClips(ModelAnim& modelAnim)
+{
+	if (!modelAnim.clipLibrary)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(modelAnim.clipLibrary->clipsMux);
+
+	return BindLibraryClipsImpl(modelAnim);
+}
+
+bool AnimSystem::BindLibraryClipsImpl(ModelAnim& modelAnim)
+{
+	ClipLibrary& clipLibrary = *modelAnim.clipLibrary;
+	size_t libraryClipAmount = clipLibrary.clips.size();
+
+	// Nodes without bones would not move any vertex, so models without bones only keep their own animations
+	if (!modelAnim.boneAmount)
+	{
+		modelAnim.libraryClipsBound = libraryClipAmount;
+		return false;
+	}
+
+	bool bound = false;
+
+	for (size_t clipIndex = modelAnim.libraryClipsBound; clipIndex < libraryClipAmount; ++clipIndex)
+	{
+		SharedClip* clip = &clipLibrary.clips[clipIndex];
+
+		if (std::find(modelAnim.clips.begin(), modelAnim.clips.end(), clip) != modelAnim.clips.end())
+		{
+			continue;
+		}
+
+		modelAnim.clips.push_back(clip);
+		modelAnim.animInfoVect.push_back(clip->animInfo);
+		modelAnim.skeleton.channelIndices.push_back(GetModelChannelIndices(clip->rawClip, modelAnim.libraryRemap));
+
+		bound = true;
+	}
+
+	modelAnim.libraryClipsBound = libraryClipAmount;
+
+	return bound;
+}
+
+std::vector<int> AnimSystem::GetChannelIndices(const RawClip& rawClip, size_t nodeAmount)
+{
+	std::vector<int> channelIndices(nodeAmount, -1);
+	int channelAmount = 0;
+
+	for (size_t channelIndex = 0; channelIndex < rawClip.nodeIndices.size(); ++channelIndex)
+	{
+		int nodeIndex = rawClip.nodeIndices[channelIndex];
+		const uint32_t* keyAmounts = &rawClip.keyAmounts[channelIndex * 3];
+
+		if (nodeIndex < 0 || !(keyAmounts[0] || keyAmounts[1] || keyAmounts[2]) || channelIndices[nodeIndex] != -1)
+		{
+			continue;
+		}
+
+		channelIndices[nodeIndex] = channelAmount++;
+	}
+
+	return channelIndices;
+}
+
+std::vector<AnimClip::Channel> AnimSystem::CookAnimation(const RawClip& rawClip, const std::vector<float>& keys, size_t nodeAmount)
+{
+	std::vector<AnimClip::Channel> channels;
+
+	// Channels are cooked in the order given by channel indices, which models were bound with at registration
+	std::vector<int> channelIndices = GetChannelIndices(rawClip, nodeAmount);
+
+	AnimClip::CompressionSettings compressionSettings;
+
+	const float* key = keys.data();
+
+	for (size_t channelIndex = 0; channelIndex < rawClip.nodeIndices.size(); ++channelIndex)
+	{
+		AnimKeys keys;
+
+		for (uint32_t i = 0; i < rawClip.keyAmounts[channelIndex * 3]; ++i, key += 4)
+		{
+			keys.positionKeys.emplace_back(key[0], glm::vec3(key[1], key[2], key[3]));
+		}
+
+		for (uint32_t i = 0; i < rawClip.keyAmounts[channelIndex * 3 + 1]; ++i, key += 5)
+		{
+			keys.rotationKeys.emplace_back(key[0], glm::quat(key[1], key[2], key[3], key[4]));
+		}
+
+		for (uint32_t i = 0; i < rawClip.keyAmounts[channelIndex * 3 + 2]; ++i, key += 4)
+		{
+			keys.scalingKeys.emplace_back(key[0], glm::vec3(key[1], key[2], key[3]));
+		}
+
+		int nodeIndex = rawClip.nodeIndices[channelIndex];
+
+		// Channels of nodes missing from the skeleton are only skipped, their keys still have to be stepped over
+		if (nodeIndex < 0 || !keys.KeysExist() || channelIndices[nodeIndex] != static_cast<int>(channels.size()))
+		{
+			continue;
+		}
+
+		channels.push_back(
+			AnimClip::CompressChannel(keys.positionKeys, keys.rotationKeys, keys.scalingKeys, compressionSettings)
+		);
+	}
+
+	return channels;
+}
+
+bool AnimSystem::RequestAnimation(ModelAnim& modelAnim, size_t animIndex)
+{
+	if (animIndex >= modelAnim.clips.size())
+	{
+		return false;
+	}
+
+	SharedClip& clip = *modelAnim.clips[animIndex];
+	clip.lastUse = std::chrono::steady_clock::now();
+
+	modelAnim.clipBounds.resize(modelAnim.animInfoVect.size());
+	modelAnim.boundsCooking.resize(modelAnim.animInfoVect.size());
+
+	ClipBounds& clipBounds = modelAnim.clipBounds[animIndex];
+	std::shared_future<CookedClip>& boundsCooking = modelAnim.boundsCooking[animIndex];
+
+	if (!clip.cooked)
+	{
+		if (!clip.cooking.valid())
 		{
-			if (animTime < keys[i + 1].first)
+			if (clip.keysLost)
 			{
-				double t1 = keys[i].first;
-				double t2 = keys[i + 1].first;
-				float factor = static_cast<float>((animTime - t1) / (t2 - t1));
+				return false;
+			}
+
+			bool computeBounds = clipBounds.segments.empty();
+
+			// Raw clip is not modified while it is cooked, so the worker can read it without synchronization.
+			// Keys of a released clip are read again by the worker
+			clip.cooking = std::async(
+				std::launch::async,
+				[
+					&clip,
+					nodeAmount = modelAnim.clipLibrary->nodeNames.size(),
+					computeBounds,
+					boundsSource = computeBounds ? GetBoundsSource(modelAnim, animIndex) : BoundsSource()
+				]()
+				{
+					CookedClip cookedClip;
+
+					if (!clip.rawClip.keys.empty() || !clip.rawClip.reloadKeys)
+					{
+						cookedClip.channels = CookAnimation(clip.rawClip, clip.rawClip.keys, nodeAmount);
+					}
+					else
+					{
+						std::vector<float> keys;
+
+						if (!clip.rawClip.reloadKeys(keys))
+						{
+							clip.keysLost = true;
+
+							return cookedClip;
+						}
 
-				InterpolateImpl(keys[i].second, keys[i + 1].second, res, factor);
+						cookedClip.channels = CookAnimation(clip.rawClip, keys, nodeAmount);
+					}
 
-				return;
+					if (computeBounds)
+					{
+						cookedClip.bounds = ComputeClipBounds(boundsSource, cookedClip.channels);
+					}
+
+					return cookedClip;
+				}
+			).share();
+
+			if (computeBounds)
+			{
+				boundsCooking = clip.cooking;
+			}
+
+			return false;
+		}
+
+		if (clip.cooking.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			return false;
+		}
+
+		clip.channels = clip.cooking.get().channels;
+
+		clip.cooking = std::shared_future<CookedClip>();
+
+		if (clip.keysLost)
+		{
+			return false;
+		}
+
+		clip.cooked = true;
+
+		// Compressed channels replace the keys, they are read again if the clip has to be cooked anew
+		std::vector<float>().swap(clip.rawClip.keys);
+	}
+
+	if (!clipBounds.segments.empty())
+	{
+		return true;
+	}
+
+	// Clip was cooked for another model, channels are copied as the clip may be released while bounds are computed
+	if (!boundsCooking.valid())
+	{
+		boundsCooking = std::async(
+			std::launch::async,
+			[boundsSource = GetBoundsSource(modelAnim, animIndex), channels = clip.channels]()
+			{
+				return CookedClip{ {}, ComputeClipBounds(boundsSource, channels) };
 			}
+		).share();
+
+		return false;
+	}
+
+	if (boundsCooking.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		return false;
+	}
+
+	clipBounds = boundsCooking.get().bounds;
+
+	boundsCooking = std::shared_future<CookedClip>();
+
+	return !clipBounds.segments.empty();
+}
+
+void AnimSystem::ReleaseUnusedAnimations(ModelAnim& modelAnim, double unusedSeconds)
+{
+	auto now = std::chrono::steady_clock::now();
+
+	// Last use is shared by every model of the clip, so it is only released once none of them requests it
+	for (SharedClip* clip : modelAnim.clips)
+	{
+		if (!clip->cooked || !clip->rawClip.reloadKeys || std::chrono::duration<double>(now - clip->lastUse).count() < unusedSeconds)
+		{
+			continue;
 		}
 
-		res = keys.back().second;
+		std::vector<AnimClip::Channel>().swap(clip->channels);
+
+		clip->cooked = false;
+	}
+}
+
+bool AnimSystem::IsPoseEvaluationDue(
+	const ModelAnim& modelAnim, 
+	size_t animIndex, 
+	const PoseState& poseState, 
+	size_t updateInterval
+)
+{
+	bool poseValid =
+		!poseState.poseOutdated &&
+		poseState.palette.size() == modelAnim.boneAmount &&
+		poseState.keyCursors.animIndex == animIndex;
+
+	return !poseValid || updateInterval <= 1 || poseState.framesSinceUpdate + 1 >= updateInterval;
+}
+
+bool AnimSystem::ProcessAnimations(
+	ModelAnim& modelAnim,
+	double animationTimeTicks,
+	size_t animIndex,
+	size_t startingBoneIndex,
+	PoseState& poseState,
+	size_t updateInterval,
+	const PoseState* sharedPose
+)
+{
+	if (animIndex >= modelAnim.skeleton.channelIndices.size())
+	{
+		return false;
+	}
+
+	bool poseValid =
+		!poseState.poseOutdated &&
+		poseState.palette.size() == modelAnim.boneAmount &&
+		poseState.keyCursors.animIndex == animIndex;
+
+	bool evaluate = IsPoseEvaluationDue(modelAnim, animIndex, poseState, updateInterval);
+
+	if (evaluate)
+	{
+		std::swap(poseState.palette, poseState.previousPalette);
+
+		if (sharedPose)
+		{
+			poseState.palette = sharedPose->palette;
+			poseState.keyCursors = sharedPose->keyCursors;
+		}
+		else
+		{
+			poseState.palette.resize(modelAnim.boneAmount, Affine(1.0f));
+			EvaluatePose(modelAnim.skeleton, modelAnim.clips[animIndex]->channels, animationTimeTicks, animIndex, poseState);
+		}
+
+		// Nothing to blend from
+		if (!poseValid)
+		{
+			poseState.previousPalette = poseState.palette;
+		}
+
+		poseState.framesSinceUpdate = 0;
+		poseState.poseOutdated = false;
+	}
+	else
+	{
+		++poseState.framesSinceUpdate;
+	}
+
+	// Blending trails evaluation by the interval, in exchange poses never have to be extrapolated
+	float factor = updateInterval > 1 ? 
+		std::min(static_cast<float>(poseState.framesSinceUpdate + 1) / updateInterval, 1.0f) : 1.0f;
+
+	WritePalette(startingBoneIndex, poseState, factor);
+
+	return evaluate;
+}
+
+void AnimSystem::HoldPose(size_t startingBoneIndex, PoseState& poseState)
+{
+	WritePalette(startingBoneIndex, poseState, 1.0f);
+	poseState.poseOutdated = true;
+}
+
+void AnimSystem::WritePalette(size_t startingBoneIndex, const PoseState& poseState, float factor)
+{
+	const std::vector<Affine>& palette = poseState.palette;
+	const std::vector<Affine>& previousPalette = poseState.previousPalette;
+
+	if (factor >= 1.0f || previousPalette.size() != palette.size())
+	{
+		std::copy(palette.begin(), palette.end(), finalTransforms.begin() + startingBoneIndex);
+		return;
+	}
+
+	for (size_t boneIndex = 0; boneIndex < palette.size(); ++boneIndex)
+	{
+		finalTransforms[startingBoneIndex + boneIndex] = 
+			previousPalette[boneIndex] + (palette[boneIndex] - previousPalette[boneIndex]) * factor;
 	}
 }
 
-void AnimSystem::ParseBoneTree(
-	BoneTree::TreeManagerNode* currentBoneNode,
+void AnimSystem::EvaluatePose(
+	const Skeleton& skeleton,
+	const std::vector<AnimClip::Channel>& channels,
 	double animationTimeTicks,
 	size_t animIndex,
-	glm::mat4& globalInverseTransform,
-	AnimKeyMap& animKeyMap
+	PoseState& poseState
 )
 {
-	BoneInfo& currentBone = currentBoneNode->GetValue();
-	auto& nameKeyPair = animKeyMap[currentBoneNode->GetKey()];
+	size_t nodeAmount = skeleton.parentIndices.size();
+
+	const std::vector<int>& channelIndices = skeleton.channelIndices[animIndex];
+	size_t channelAmount = channels.size();
+
+	KeyCursors& keyCursors = poseState.keyCursors;
+	std::vector<float>& channelSamples = poseState.channelSamples;
+	std::vector<Affine>& localTransforms = poseState.localTransforms;
+	std::vector<Affine>& globalTransforms = poseState.globalTransforms;
+
+	if (globalTransforms.size() < nodeAmount)
+	{
+		globalTransforms.resize(nodeAmount);
+	}
 
-	glm::mat4 nodeTransformation = currentBone.localTransform;
+	if (localTransforms.size() < channelAmount)
+	{
+		localTransforms.resize(channelAmount);
+	}
 
-	if (!nameKeyPair.empty() && nameKeyPair[animIndex].KeysExist())
+	channelSamples.resize(channelAmount * PoseState::valuesPerChannel);
+
+	// Cursors are only valid for the animation they were advanced in, going back in time means a loop or a seek
+	bool seek = animationTimeTicks < keyCursors.lastAnimTime;
+
+	if (keyCursors.animIndex != animIndex || keyCursors.keyIndices.size() != channelAmount * KeyCursors::tracksPerChannel)
 	{
+		keyCursors.animIndex = animIndex;
+		keyCursors.keyIndices.assign(channelAmount * KeyCursors::tracksPerChannel, 0);
+		seek = true;
+	}
+
+	keyCursors.lastAnimTime = animationTimeTicks;
+
+	float* samples[PoseState::valuesPerChannel];
+	for (size_t valueIndex = 0; valueIndex < PoseState::valuesPerChannel; ++valueIndex)
+	{
+		samples[valueIndex] = channelSamples.data() + valueIndex * channelAmount;
+	}
+
+	// Key lookup is branchy, so channels are sampled one by one into arrays the kernels consume
+	for (size_t channelIndex = 0; channelIndex < channelAmount; ++channelIndex)
+	{
+		const AnimClip::Channel& channel = channels[channelIndex];
+		size_t* cursors = &keyCursors.keyIndices[channelIndex * KeyCursors::tracksPerChannel];
+
 		glm::vec3 interpolPos(1.0, 1.0, 1.0);
 		glm::quat interpolRot(1.0, 1.0, 1.0, 1.0);
 		glm::vec3 interpolSca(1.0, 1.0, 1.0);
 
-		InterpolateKey(nameKeyPair[animIndex].positionKeys, interpolPos, animationTimeTicks);
-		InterpolateKey(nameKeyPair[animIndex].rotationKeys, interpolRot, animationTimeTicks);
-		InterpolateKey(nameKeyPair[animIndex].scalingKeys, interpolSca, animationTimeTicks);
+		InterpolateKey(channel.position, cursors[0], seek, interpolPos, animationTimeTicks);
+		InterpolateKey(channel.rotation, cursors[1], seek, interpolRot, animationTimeTicks);
+		InterpolateKey(channel.scaling,  cursors[2], seek, interpolSca, animationTimeTicks);
 
-		glm::mat4 translation = glm::translate(glm::mat4(1.0f), interpolPos);
-		glm::mat4 rotation = glm::mat4_cast(interpolRot);
-		glm::mat4 scaling = glm::scale(glm::mat4(1.0f), interpolSca);
+		samples[0][channelIndex] = interpolPos.x;
+		samples[1][channelIndex] = interpolPos.y;
+		samples[2][channelIndex] = interpolPos.z;
+		samples[3][channelIndex] = interpolRot.x;
+		samples[4][channelIndex] = interpolRot.y;
+		samples[5][channelIndex] = interpolRot.z;
+		samples[6][channelIndex] = interpolRot.w;
+		samples[7][channelIndex] = interpolSca.x;
+		samples[8][channelIndex] = interpolSca.y;
+		samples[9][channelIndex] = interpolSca.z;
+	}
+
+	AnimKernels::TRSArrays trs =
+	{
+		samples[0], samples[1], samples[2],
+		samples[3], samples[4], samples[5], samples[6],
+		samples[7], samples[8], samples[9]
+	};
+
+	AnimKernels::ComposeTRS(trs, channelAmount, localTransforms.data());
+
+	for (size_t nodeIndex = 0; nodeIndex < nodeAmount; ++nodeIndex)
+	{
+		// Channels of a released clip are empty, its nodes fall back to the bind pose
+		int channelIndex = channelIndices[nodeIndex];
+		bool animated = channelIndex != -1 && static_cast<size_t>(channelIndex) < channelAmount;
+		const Affine& localTransform = animated ? localTransforms[channelIndex] : skeleton.localTransforms[nodeIndex];
 
-		nodeTransformation = translation * rotation * scaling;
+		int parentIndex = skeleton.parentIndices[nodeIndex];
+		if (parentIndex != -1)
+		{
+			AnimKernels::Multiply(globalTransforms[parentIndex], localTransform, globalTransforms[nodeIndex]);
+		}
+		else
+		{
+			globalTransforms[nodeIndex] = localTransform;
+		}
+
+		int boneId = skeleton.boneIds[nodeIndex];
+		if (boneId != -1)
+		{
+			Affine& finalTransform = poseState.palette[boneId];
+
+			AnimKernels::Multiply(skeleton.globalInverseTransform, globalTransforms[nodeIndex], finalTransform);
+			AnimKernels::Multiply(finalTransform, skeleton.offsetMatrices[nodeIndex], finalTransform);
+		}
+	}
+}
+
+void AnimSystem::BakeAnimation(ModelAnim& modelAnim, size_t animIndex, double framesPerSecond)
+{
+	if (animIndex >= modelAnim.skeleton.channelIndices.size() || framesPerSecond <= 0.0)
+	{
+		return;
 	}
 
-	BoneTree::TreeManagerNode* parentBoneNode = currentBoneNode->GetParentNode();
-	glm::mat4 parentTransformMatrix = parentBoneNode ? parentBoneNode->GetValue().globalTransform : glm::mat4(1.0f);
+	modelAnim.bakedClips.resize(modelAnim.animInfoVect.size());
 
-	currentBone.globalTransform = parentTransformMatrix * nodeTransformation;
+	BakedClip& bakedClip = modelAnim.bakedClips[animIndex];
 
-	if (currentBone.id != -1)
+	if (bakedClip.frameAmount)
 	{
-		currentBone.finalTransform = globalInverseTransform * currentBone.globalTransform * currentBone.offsetMatrix;
+		return;
 	}
 
-	for (auto& [childNodeName, childNode] : currentBoneNode->GetChildNodes())
+	const AnimInfo& animInfo = modelAnim.animInfoVect[animIndex];
+
+	bakedClip.ticksPerFrame = animInfo.ticksPerSecond / framesPerSecond;
+	// Last frame lands on the end of the animation, so the whole of it can be blended
+	bakedClip.frameAmount = static_cast<size_t>(std::ceil(animInfo.animDuration / bakedClip.ticksPerFrame)) + 1;
+	bakedClip.palettes.reserve(bakedClip.frameAmount * modelAnim.boneAmount);
+
+	PoseState poseState;
+	poseState.palette.resize(modelAnim.boneAmount, Affine(1.0f));
+
+	for (size_t frameIndex = 0; frameIndex < bakedClip.frameAmount; ++frameIndex)
 	{
-		ParseBoneTree(childNode, animationTimeTicks, animIndex, globalInverseTransform, animKeyMap);
+		double animationTimeTicks = std::min(frameIndex * bakedClip.ticksPerFrame, animInfo.animDuration);
+
+		EvaluatePose(modelAnim.skeleton, modelAnim.clips[animIndex]->channels, animationTimeTicks, animIndex, poseState);
+
+		bakedClip.palettes.insert(bakedClip.palettes.end(), poseState.palette.begin(), poseState.palette.end());
 	}
 }
 
-void AnimSystem::CollectAllFinalTransforms(
-	BoneTree::TreeManagerNode* boneTreeNode,
-	size_t startingBoneIndex,
-	std::vector<glm::mat4>& finalTransforms
-)
+AnimSystem::BakedPlayback AnimSystem::GetBakedPlayback(const BakedClip& bakedClip, size_t boneAmount, double animationTimeTicks)
 {
-	int currentID = boneTreeNode->GetValue().id;
+	BakedPlayback bakedPlayback;
+
+	if (!bakedClip.frameAmount || bakedClip.startingBoneIndex == SIZE_MAX)
+	{
+		return bakedPlayback;
+	}
+
+	double frame = std::max(animationTimeTicks / bakedClip.ticksPerFrame, 0.0);
+	size_t frameIndex = std::min(static_cast<size_t>(frame), bakedClip.frameAmount - 1);
+	size_t nextFrameIndex = std::min(frameIndex + 1, bakedClip.frameAmount - 1);
+
+	bakedPlayback.frames = glm::ivec2(
+		static_cast<int>(bakedClip.startingBoneIndex + frameIndex * boneAmount),
+		static_cast<int>(bakedClip.startingBoneIndex + nextFrameIndex * boneAmount)
+	);
+	bakedPlayback.factor = static_cast<float>(std::min(frame - frameIndex, 1.0));
+
+	return bakedPlayback;
+}
 
-	if (currentID != -1)
+void AnimSystem::ExtendBoneBounds(ModelAnim& modelAnim, size_t boneId, const glm::vec3& position)
+{
+	if (boneId >= modelAnim.boneBounds.size())
 	{
-		finalTransforms[startingBoneIndex + currentID] = boneTreeNode->GetValue().finalTransform;
+		modelAnim.boneBounds.resize(boneId + 1);
 	}
 
-	for (auto& [childNodeName, childNode] : boneTreeNode->GetChildNodes())
+	modelAnim.boneBounds[boneId].Extend(position);
+	modelAnim.bindBounds.Extend(position);
+}
+
+AnimSystem::Bounds AnimSystem::GetPoseBounds(const std::vector<Bounds>& allBoneBounds, const std::vector<Affine>& palette)
+{
+	Bounds bounds;
+
+	size_t boneAmount = std::min(allBoneBounds.size(), palette.size());
+
+	// Skinned vertex is a weighted sum of its bone transforms, so it stays within the union of transformed bone bounds
+	for (size_t boneId = 0; boneId < boneAmount; ++boneId)
 	{
-		CollectAllFinalTransforms(childNode, startingBoneIndex, finalTransforms);
+		const Bounds& boneBounds = allBoneBounds[boneId];
+
+		if (boneBounds.IsEmpty())
+		{
+			continue;
+		}
+
+		const Affine& transform = palette[boneId];
+
+		glm::vec3 center = (boneBounds.min + boneBounds.max) * 0.5f;
+		glm::vec3 extent = (boneBounds.max - boneBounds.min) * 0.5f;
+
+		glm::vec3 transformedCenter;
+		glm::vec3 transformedExtent;
+
+		for (int row = 0; row < 3; ++row)
+		{
+			glm::vec3 linearRow = glm::vec3(transform[row]);
+
+			transformedCenter[row] = glm::dot(linearRow, center) + transform[row][3];
+			transformedExtent[row] = glm::dot(glm::abs(linearRow), extent);
+		}
+
+		bounds.Extend(transformedCenter - transformedExtent);
+		bounds.Extend(transformedCenter + transformedExtent);
 	}
+
+	return bounds;
 }
 
-void AnimSystem::ProcessAnimations(ModelAnim& modelAnim, double animationTimeTicks, size_t animIndex, size_t startingBoneIndex)
+AnimSystem::BoundsSource AnimSystem::GetBoundsSource(const ModelAnim& modelAnim, size_t animIndex)
 {
-	if (!modelAnim.animInfoVect.empty())
+	const AnimInfo& animInfo = modelAnim.animInfoVect[animIndex];
+
+	return BoundsSource{
+		modelAnim.skeleton, modelAnim.boneBounds, modelAnim.boneAmount, animIndex, animInfo.animDuration, animInfo.ticksPerSecond
+	};
+}
+
+AnimSystem::ClipBounds AnimSystem::ComputeClipBounds(const BoundsSource& boundsSource, const std::vector<AnimClip::Channel>& channels)
+{
+	ClipBounds clipBounds;
+
+	clipBounds.ticksPerSegment = ClipBounds::segmentSeconds * boundsSource.ticksPerSecond;
+	clipBounds.segments.resize(
+		std::max(static_cast<size_t>(std::ceil(boundsSource.animDuration / clipBounds.ticksPerSegment)), size_t(1))
+	);
+
+	PoseState poseState;
+	poseState.palette.resize(boundsSource.boneAmount, Affine(1.0f));
+
+	// Both borders of a segment are sampled, so poses between segments are covered by both of them
+	for (size_t segmentIndex = 0; segmentIndex < clipBounds.segments.size(); ++segmentIndex)
 	{
-		for (auto& [childNodeName, childNode] : modelAnim.boneTree.GetChildNodes())
+		for (size_t sampleIndex = 0; sampleIndex <= ClipBounds::samplesPerSegment; ++sampleIndex)
 		{
-			ParseBoneTree(childNode, animationTimeTicks, animIndex, modelAnim.globalInverseTransform, modelAnim.animKeyMap);
+			double segmentPosition = segmentIndex + static_cast<double>(sampleIndex) / ClipBounds::samplesPerSegment;
+			double animationTimeTicks = std::min(segmentPosition * clipBounds.ticksPerSegment, boundsSource.animDuration);
+
+			EvaluatePose(boundsSource.skeleton, channels, animationTimeTicks, boundsSource.animIndex, poseState);
+
+			clipBounds.segments[segmentIndex].Extend(GetPoseBounds(boundsSource.boneBounds, poseState.palette));
 		}
+	}
+
+	return clipBounds;
+}
+
+const AnimSystem::Bounds& AnimSystem::GetAnimatedBounds(const ModelAnim& modelAnim, size_t animIndex, double animationTimeTicks)
+{
+	if (animIndex >= modelAnim.clipBounds.size() || modelAnim.clipBounds[animIndex].segments.empty())
+	{
+		return modelAnim.bindBounds;
+	}
+
+	const ClipBounds& clipBounds = modelAnim.clipBounds[animIndex];
+
+	size_t segmentIndex = static_cast<size_t>(std::max(animationTimeTicks / clipBounds.ticksPerSegment, 0.0));
+
+	return clipBounds.segments[std::min(segmentIndex, clipBounds.segments.size() - 1)];
+}
+
+size_t AnimSystem::GetAnimationByteSize(const ModelAnim& modelAnim)
+{
+	size_t res = 0;
 
-		for (auto& [childNodeName, childNode] : modelAnim.boneTree.GetChildNodes())
+	for (const SharedClip* clip : modelAnim.clips)
+	{
+		for (auto& channel : clip->channels)
 		{
-			CollectAllFinalTransforms(childNode, startingBoneIndex, finalTransforms);
+			res += AnimClip::GetByteSize(channel);
 		}
 	}
+
+	return res;
 }
 
-std::vector<glm::mat4>& AnimSystem::GetFinalTransforms()
+AnimSystem::PoseState* AnimSystem::FindOrRegisterCachedPose(
+	const ModelAnim& modelAnim,
+	size_t animIndex,
+	double animationTime,
+	PoseState& poseState
+)
 {
-	return finalTransforms;
+	auto [cacheIter, inserted] = poseCache.emplace(PoseCacheKey{ &modelAnim, animIndex, animationTime }, &poseState);
+
+	return inserted ? nullptr : cacheIter->second;
 }
 
-void AnimSystem::ResetFinalTransforms()
+void AnimSystem::ResetPoseCache()
 {
-	finalTransforms = std::vector<glm::mat4>(GetTotalBoneAmount(), glm::mat4(1.0f));
+	poseCache.clear();
 }
 
-void AnimSystem::IncrementTotalBoneAmount(ModelAnim& modelAnim)
+std::vector<AnimSystem::Affine>& AnimSystem::GetFinalTransforms()
 {
-	totalBoneAmount += modelAnim.boneAmount;
+	return finalTransforms;
+}
+
+void AnimSystem::ResetFinalTransforms(size_t restBoneAmount)
+{
+	finalTransforms.assign(restBoneAmount, Affine(1.0f));
 }
 
-size_t AnimSystem::GetTotalBoneAmount()
+size_t AnimSystem::AllocatePalette(size_t boneAmount)
 {
-	return totalBoneAmount;
+	size_t startingBoneIndex = finalTransforms.size();
+
+	finalTransforms.resize(startingBoneIndex + boneAmount, Affine(1.0f));
+
+	return startingBoneIndex;
 }
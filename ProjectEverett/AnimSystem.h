@@ -8,8 +8,21 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
 
 #include "TreeManager.h"
+#include "AnimKernels.h"
+#include "AnimClip.h"
 
 class AnimSystem
 {
@@ -50,43 +63,333 @@ public:
 		}
 	};
 
+	using Affine = AnimKernels::Affine;
+
+	// Bone tree compiled into flat arrays, every parent precedes its children
+	struct Skeleton
+	{
+		std::vector<std::string> nodeNames;
+		std::vector<int> parentIndices;
+		std::vector<int> boneIds;
+		std::vector<Affine> localTransforms;
+		std::vector<Affine> offsetMatrices;
+		Affine globalInverseTransform = Affine(1.0f);
+
+		// Per animation, index of the node channel in the shared clip or -1 if the node is not animated.
+		// Remaps nodes of the model to the node order of the clip library
+		std::vector<std::vector<int>> channelIndices;
+	};
+
+	// Per instance indices of the last used keys, so lookups continue from them instead of scanning all keys
+	struct KeyCursors
+	{
+		constexpr static size_t tracksPerChannel = 3;
+
+		size_t animIndex = SIZE_MAX;
+		double lastAnimTime = 0.0;
+		std::vector<size_t> keyIndices;
+	};
+
+	// Everything evaluation of a pose changes, owned by each instance so instances can be posed concurrently
+	struct PoseState
+	{
+		constexpr static size_t valuesPerChannel = 10;
+
+		KeyCursors keyCursors;
+		// Sampled channel values as arrays of position x, y, z, rotation x, y, z, w and scaling x, y, z
+		std::vector<float> channelSamples;
+		std::vector<Affine> localTransforms;
+		std::vector<Affine> globalTransforms;
+
+		// Pose is evaluated once per update interval, palettes of two last evaluations are blended in between
+		std::vector<Affine> palette;
+		std::vector<Affine> previousPalette;
+		size_t framesSinceUpdate = 0;
+		bool poseOutdated = true;
+	};
+
+	// Palettes of an animation sampled at a fixed rate, stored frame after frame
+	struct BakedClip
+	{
+		double ticksPerFrame = 0.0;
+		size_t frameAmount = 0;
+		std::vector<Affine> palettes;
+		// Position of the first palette in the buffer of all baked clips, assigned once the clip is uploaded
+		size_t startingBoneIndex = SIZE_MAX;
+	};
+
+	// Baked instances are posed in shaders by blending two frames of the baked clip
+	struct BakedPlayback
+	{
+		// Starting bone indices of both frames, -1 if the instance is not baked
+		glm::ivec2 frames = glm::ivec2(-1);
+		float factor = 0.0f;
+	};
+
+	// Axis aligned box, empty until extended
+	struct Bounds
+	{
+		glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+		bool IsEmpty() const
+		{
+			return min.x > max.x;
+		}
+
+		void Extend(const glm::vec3& point)
+		{
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+
+		void Extend(const Bounds& bounds)
+		{
+			if (!bounds.IsEmpty())
+			{
+				min = glm::min(min, bounds.min);
+				max = glm::max(max, bounds.max);
+			}
+		}
+	};
+
+	// Model space bounds of all poses of an animation, split into time segments of equal length
+	struct ClipBounds
+	{
+		constexpr static double segmentSeconds = 0.25;
+		constexpr static size_t samplesPerSegment = 4;
+
+		double ticksPerSegment = 0.0;
+		std::vector<Bounds> segments;
+	};
+
+	// Result of a worker task, channels are empty if the task only computed bounds
+	struct CookedClip
+	{
+		std::vector<AnimClip::Channel> channels;
+		// Bounds for the model the task was started by, empty if that model already had them
+		ClipBounds bounds;
+	};
+
+	// Two independent 64 bit hashes of the keys, so clips are told apart reliably after their keys are freed
+	struct KeysDigest
+	{
+		uint64_t hash = 0;
+		uint64_t fnvHash = 0;
+
+		bool operator==(const KeysDigest& other) const
+		{
+			return hash == other.hash && fnvHash == other.fnvHash;
+		}
+	};
+
+	// Keys of an animation as they were imported, kept in a single array until the animation is cooked on first use.
+	// Keys are freed once the animation is cooked, only its compressed channels stay in memory
+	struct RawClip
+	{
+		// Per channel, name of the animated node. Resolved into node indices once the skeleton is compiled
+		std::vector<std::string> nodeNames;
+		std::vector<int> nodeIndices;
+		// Per channel, key amounts of position, rotation and scaling tracks
+		std::vector<uint32_t> keyAmounts;
+		// Keys of all tracks one after another, each is time followed by x, y, z or by w, x, y, z for rotations
+		std::vector<float> keys;
+		// Identifies identical clips, also after their keys are freed
+		KeysDigest keysDigest;
+		// Reads the keys again from the file they were loaded from, empty if they were only kept in memory
+		std::function<bool(std::vector<float>&)> reloadKeys;
+	};
+
+	// Animation stored once for every model with a compatible skeleton, cooked on the first request of any of them
+	struct SharedClip
+	{
+		AnimInfo animInfo;
+		// Node indices are in the node order of the library
+		RawClip rawClip;
+		std::vector<AnimClip::Channel> channels;
+		std::shared_future<CookedClip> cooking;
+		bool cooked = false;
+		// Set if keys of a released animation could not be read again, it stays in bind pose then
+		bool keysLost = false;
+		std::chrono::steady_clock::time_point lastUse;
+	};
+
+	// Clips of skeletons with the same node names and hierarchy, order of nodes may differ between models
+	struct ClipLibrary
+	{
+		std::vector<std::string> nodeNames;
+		std::vector<int> parentIndices;
+		std::unordered_map<std::string, int> nodeIndexMap;
+		// Deque keeps clips in place when new ones are added, models point to them
+		std::deque<SharedClip> clips;
+		// Clips are added by models registered on any thread and bound to other models on render thread
+		std::mutex clipsMux;
+	};
+
 	using BoneTree = TreeManager<std::string, BoneInfo>;
-	using AnimKeyMap = std::unordered_map<std::string, std::vector<AnimKeys>>;
 	using AnimInfoVect = std::vector<AnimInfo>;
 
 	struct ModelAnim
 	{
 		size_t boneAmount;
 		BoneTree boneTree;
-		AnimKeyMap animKeyMap;
+		// Per animation, raw clips are only kept until they are registered in the clip library
+		std::vector<RawClip> rawClips;
+		std::vector<SharedClip*> clips;
+		std::shared_ptr<ClipLibrary> clipLibrary;
+		// Library node index of every node, clips added to the library later are bound through it
+		std::vector<int> libraryRemap;
+		// Amount of library clips the model was bound to or skipped, clips after it are new
+		size_t libraryClipsBound = 0;
 		AnimInfoVect animInfoVect;
 		glm::mat4 globalInverseTransform = glm::mat4(1.0f);
+		Skeleton skeleton;
+		// Per animation, empty until the animation is baked
+		std::vector<BakedClip> bakedClips;
+		// Per bone id, bind pose bounds of vertices the bone influences
+		std::vector<Bounds> boneBounds;
+		Bounds bindBounds;
+		// Per animation, empty until bounds of the animation are computed
+		std::vector<ClipBounds> clipBounds;
+		// Per animation, task computing the bounds, it is the cooking of the clip if the model started that
+		std::vector<std::shared_future<CookedClip>> boundsCooking;
 	};
 
-	void ProcessAnimations(ModelAnim& modelAnim, double currentTime, size_t animIndex, size_t startingBoneIndex);
-	std::vector<glm::mat4>& GetFinalTransforms();
-	void ResetFinalTransforms();
-	void IncrementTotalBoneAmount(ModelAnim& modelAnim);
-	size_t GetTotalBoneAmount();
+	// Must be called once bone tree and raw clips are loaded, then clips have to be registered
+	static void CompileSkeleton(ModelAnim& modelAnim);
+	static void AppendRawChannel(RawClip& rawClip, const std::string& nodeName, const AnimKeys& keys);
+	// Clips shared with other models are counted for each of them
+	static size_t GetAnimationByteSize(const ModelAnim& modelAnim);
+
+	// Binds the model to clips of the library of its skeleton, identical clips already stored there are reused
+	// instead of new ones. Other clips of the library follow own animations of the model, if it has bones.
+	// Animations stay raw until requested, must not be called concurrently for the same model
+	void RegisterClips(ModelAnim& modelAnim);
+	// Returns true once after any registration added clips to a library, which other models can be bound to
+	bool LibraryClipsAdded();
+	// Appends clips added to the library since the model was last bound, returns true if any were appended.
+	// Must be called on the thread which evaluates the model
+	bool BindLibraryClips(ModelAnim& modelAnim);
+
+	// Returns true if the animation is cooked and its bounds are computed for the model, otherwise both are done
+	// on a worker. Bounds are computed by the same task which cooks the clip, models which share an already cooked
+	// clip get a task of their own. Must not be called concurrently with evaluation of the model
+	bool RequestAnimation(ModelAnim& modelAnim, size_t animIndex);
+	// Cooked animations not requested by any model for given time are released and cooked again from reloaded keys.
+	// Animations whose keys can not be reloaded are kept, their channels are the only copy left
+	void ReleaseUnusedAnimations(ModelAnim& modelAnim, double unusedSeconds);
+
+	bool IsPoseEvaluationDue(const ModelAnim& modelAnim, size_t animIndex, const PoseState& poseState, size_t updateInterval);
+	// Pose is evaluated every updateInterval calls, returns false if it was only interpolated.
+	// If sharedPose is set, its pose is copied instead of evaluation, it must be evaluated for the same time first
+	bool ProcessAnimations(
+		ModelAnim& modelAnim,
+		double currentTime,
+		size_t animIndex,
+		size_t startingBoneIndex,
+		PoseState& poseState,
+		size_t updateInterval = 1,
+		const PoseState* sharedPose = nullptr
+	);
+	// Writes the last evaluated pose without evaluating, next processing starts from a fresh pose
+	void HoldPose(size_t startingBoneIndex, PoseState& poseState);
+
+	// Samples every palette of the animation, from its start to its end, at given rate. Does nothing if already baked
+	void BakeAnimation(ModelAnim& modelAnim, size_t animIndex, double framesPerSecond);
+	// Playback of an uploaded clip at given animation time, frames are only blended, never looped around
+	static BakedPlayback GetBakedPlayback(const BakedClip& bakedClip, size_t boneAmount, double animationTimeTicks);
+
+	// Must be called for every vertex and each bone influencing it, before bounds of animations are computed
+	static void ExtendBoneBounds(ModelAnim& modelAnim, size_t boneId, const glm::vec3& position);
+	// Bounds of the segment given time is in, bind pose bounds if bounds of the animation are not computed
+	static const Bounds& GetAnimatedBounds(const ModelAnim& modelAnim, size_t animIndex, double animationTimeTicks);
+	// Palette is stored in the upload format, rows of affine transforms
+	std::vector<Affine>& GetFinalTransforms();
+	// Palettes are allocated anew every frame, only for instances animated in it.
+	// Palette starts with identity transforms of given amount, shared by every instance which is not animated
+	void ResetFinalTransforms(size_t restBoneAmount);
+	// Returns starting bone index of the allocated range, not thread safe
+	size_t AllocatePalette(size_t boneAmount);
+
+	// Poses registered during the current frame, not thread safe.
+	// Returns pose state registered first for the same model, animation and time, or nullptr if given one is the first
+	PoseState* FindOrRegisterCachedPose(const ModelAnim& modelAnim, size_t animIndex, double animationTime, PoseState& poseState);
+	void ResetPoseCache();
 private:
-	template<typename GLMType>
-	void InterpolateKey(std::vector<std::pair<double, GLMType>>& keys, GLMType& res, double animTime);
-	void InterpolateImpl(const glm::vec3& vec1, const glm::vec3& vec2, glm::vec3& resVec, float factor);
-	void InterpolateImpl(const glm::quat& quat1, const glm::quat& quat2, glm::quat& resQuat, float factor);
-	void ParseBoneTree(
-		BoneTree::TreeManagerNode* currentBoneNode,
+	// Signature does not depend on order of nodes, so skeletons exported with different order share it
+	static size_t GetSkeletonSignature(const std::vector<std::string>& nodeNames, const std::vector<int>& parentIndices);
+	// Fills remap with library node index of every node, returns false if the skeleton does not match the library
+	static bool MapToLibrary(const ClipLibrary& clipLibrary, const Skeleton& skeleton, std::vector<int>& remap);
+	static KeysDigest GetKeysDigest(const std::vector<float>& keys);
+	// Channel index of every node of the model, for a clip stored in library node order
+	static std::vector<int> GetModelChannelIndices(const RawClip& rawClip, const std::vector<int>& remap);
+	// Caller must hold mutex of clips of the library
+	static bool BindLibraryClipsImpl(ModelAnim& modelAnim);
+	// First channel with keys of every node is used, others are ignored
+	static std::vector<int> GetChannelIndices(const RawClip& rawClip, size_t nodeAmount);
+	static std::vector<AnimClip::Channel> CookAnimation(const RawClip& rawClip, const std::vector<float>& keys, size_t nodeAmount);
+
+	static size_t FindKeyIndex(const std::vector<float>& times, double keyStep, size_t cursor, bool seek, double animTime);
+	template<typename Track, typename GLMType>
+	static void InterpolateKey(const Track& track, size_t& cursor, bool seek, GLMType& res, double animTime);
+	static void InterpolateImpl(const glm::vec3& vec1, const glm::vec3& vec2, glm::vec3& resVec, float factor);
+	static void InterpolateImpl(const glm::quat& quat1, const glm::quat& quat2, glm::quat& resQuat, float factor);
+
+	static void EvaluatePose(
+		const Skeleton& skeleton,
+		const std::vector<AnimClip::Channel>& channels,
 		double animationTimeTicks,
 		size_t animIndex,
-		glm::mat4& globalInverseTransform,
-		AnimKeyMap& animKeyMap
-	);
-	void CollectAllFinalTransforms(
-		BoneTree::TreeManagerNode* boneTreeNode,
-		size_t startingBoneIndex,
-		std::vector<glm::mat4>& finalTransforms
+		PoseState& poseState
 	);
+	void WritePalette(size_t startingBoneIndex, const PoseState& poseState, float factor);
+	static Bounds GetPoseBounds(const std::vector<Bounds>& boneBounds, const std::vector<Affine>& palette);
+
+	// Copy of the model data bounds are sampled from, so workers do not depend on the model staying alive
+	struct BoundsSource
+	{
+		Skeleton skeleton;
+		std::vector<Bounds> boneBounds;
+		size_t boneAmount = 0;
+		size_t animIndex = 0;
+		double animDuration = 0.0;
+		double ticksPerSecond = 0.0;
+	};
+
+	static BoundsSource GetBoundsSource(const ModelAnim& modelAnim, size_t animIndex);
+	// Samples poses of the whole animation into bounds of its time segments
+	static ClipBounds ComputeClipBounds(const BoundsSource& boundsSource, const std::vector<AnimClip::Channel>& channels);
+
+	// Instances write only to their own range, so it is safe to fill from several threads
+	std::vector<Affine> finalTransforms;
+
+	struct PoseCacheKey
+	{
+		const ModelAnim* modelAnim;
+		size_t animIndex;
+		double animationTime;
+
+		bool operator==(const PoseCacheKey& other) const
+		{
+			return modelAnim == other.modelAnim && animIndex == other.animIndex && animationTime == other.animationTime;
+		}
+	};
+
+	struct PoseCacheKeyHash
+	{
+		size_t operator()(const PoseCacheKey& key) const
+		{
+			size_t hash = std::hash<const ModelAnim*>()(key.modelAnim);
+			hash ^= std::hash<size_t>()(key.animIndex) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+			hash ^= std::hash<double>()(key.animationTime) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+			return hash;
+		}
+	};
 
-	std::vector<glm::mat4> finalTransforms;
+	std::unordered_map<PoseCacheKey, PoseState*, PoseCacheKeyHash> poseCache;
 
-	size_t totalBoneAmount = 0;
+	// Libraries with the same skeleton signature, released together with the last model using them
+	std::unordered_map<size_t, std::vector<std::weak_ptr<ClipLibrary>>> clipLibraries;
+	std::atomic<bool> libraryClipsAdded = false;
 };
\ No newline at end of file
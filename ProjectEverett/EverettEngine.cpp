@@ -36,6 +36,7 @@
 #include "SolidToModelManager.h"
 
 #include "ShaderGenerator.h"
+#include "ThreadPool.h"
 
 //#define BONE_TEST
 
@@ -69,6 +70,31 @@ struct EverettEngine::ModelSolidInfo
 	std::string modelPath;
 	SolidToModelManager::FullModelInfo model;
 	std::map<std::string, SolidSim> solids;
+	// Index of the first solid of the model in shader arrays, updated each frame
+	size_t startSolidIndex = 0;
+	uint32_t shaderFeatures = 0;
+	// Bind pose bounding sphere in model space, centered at the origin
+	float boundingRadius = 0.0f;
+
+	bool preSkinned = false;
+	// Set when solid instances change, so every solid is skinned again
+	bool preSkinAllSolids = true;
+	// Solids posed during the frame, their palette is applied before pre-skinning of the same frame
+	std::unordered_set<std::string> posedSolids;
+	std::unordered_set<std::string> lastPosedSolids;
+};
+
+struct EverettEngine::PendingModel
+{
+	// Filled by import worker, moved to MSM once imported
+	ModelSolidInfo model;
+	std::future<bool> import;
+	std::promise<bool> ready;
+	std::shared_future<bool> readyResult;
+	std::vector<std::function<void(bool)>> readyCallbacks;
+	// Solids requested before the model was ready
+	std::vector<std::string> solidNames;
+	bool uploading = false;
 };
 
 EverettEngine::LightShaderValueNames EverettEngine::lightShaderValueNames =
@@ -117,6 +143,7 @@ EverettEngine::EverettEngine()
 	mainLGL    = std::make_unique<LGL>();
 	fileLoader = std::make_unique<FileLoader>();
 	animSystem = std::make_unique<AnimSystem>();
+	animWorkers = std::make_unique<ThreadPool>();
 	cmdHandler = std::make_unique<CommandHandler>();
 	hwndHolder = std::make_unique<WindowHandleHolder>();
 
@@ -228,6 +255,9 @@ void EverettEngine::CreateAndSetupMainWindow(
 	mainLGL->SetShaderUniformValue("boneIDChoice", 0);
 #else
 	defaultShaderProgram = "lightCombAndBone";
+
+	shaderGen = std::make_unique<ShaderGenerator>();
+	shaderGen->LoadPreSources(FileLoader::GetCurrentDir() + '\\' + shaderPath + '\\' + defaultShaderProgram);
 #endif
 
 	mainLGL->EnableVSync(ENABLE_VSYNC);
@@ -248,19 +278,187 @@ void EverettEngine::SetDefaultWASDControls()
 	}
 }
 
+void EverettEngine::SetDynamicResolution(bool enable, float targetFrameTimeMs, float minScale, bool sharpenUpscale)
+{
+	mainLGL->SetDynamicResolutionParams(targetFrameTimeMs, minScale);
+	mainLGL->SetUpscaleFilter(sharpenUpscale ? LGL::UpscaleFilter::Sharpened : LGL::UpscaleFilter::Bilinear);
+	mainLGL->EnableDynamicResolution(enable);
+}
+
+void EverettEngine::SetFrameLimit(int targetFPS)
+{
+	mainLGL->SetFrameLimit(targetFPS);
+}
+
+void EverettEngine::EnableAdaptiveVSync(bool value)
+{
+	mainLGL->EnableAdaptiveVSync(value);
+}
+
+void EverettEngine::EnableFrameTimeReport(bool value)
+{
+	mainLGL->EnableFrameTimeReport(value);
+}
+
+void EverettEngine::EnableDepthPrePass(bool value)
+{
+	useDepthPrePass = value;
+	mainLGL->EnableDepthPrePass(value);
+}
+
+void EverettEngine::EnablePreSkinning(bool value)
+{
+	usePreSkinning = value;
+	shaderPermutationsOutdated = true;
+}
+
+void EverettEngine::SetGPUMemoryBudget(size_t budgetMegabytes)
+{
+	mainLGL->SetGPUMemoryBudget(budgetMegabytes * 1024 * 1024);
+}
+
+void EverettEngine::SetModelUploadBudget(size_t budgetMegabytes)
+{
+	mainLGL->SetModelUploadBudget(budgetMegabytes * 1024 * 1024);
+}
+
+void EverettEngine::SetAnimationLOD(
+	float halfRateDistance,
+	float quarterRateDistance,
+	float eighthRateDistance,
+	bool offscreenTimeOnly
+)
+{
+	std::lock_guard<std::mutex> lock(animationLODMux);
+
+	animationLOD.distances = { halfRateDistance, quarterRateDistance, eighthRateDistance };
+	animationLOD.offscreenTimeOnly = offscreenTimeOnly;
+}
+
+EverettEngine::AnimationLODStats EverettEngine::GetAnimationLODStats()
+{
+	std::lock_guard<std::mutex> lock(animationLODMux);
+
+	return animationLOD.stats;
+}
+
+void EverettEngine::EnableDualQuaternionBones(bool value)
+{
+	useDualQuatBones = value;
+	bakedBonesOutdated = true;
+	GenerateShader();
+}
+
+void EverettEngine::SetBakedAnimationRate(float framesPerSecond)
+{
+	std::lock_guard<std::mutex> lock(animationLODMux);
+
+	bakedAnimationRate = std::max(framesPerSecond, 1.0f);
+}
+
+void EverettEngine::SetAnimationReleaseTime(float seconds)
+{
+	std::lock_guard<std::mutex> lock(animationLODMux);
+
+	animationReleaseTime = std::max(seconds, 0.0f);
+}
+
 void EverettEngine::RunRenderWindow()
 {
 	auto additionalFuncs = [this]() {
-		currentStartSolidIndex = 0;
-		nextStartSolidIndex = 0;
+		auto AddActiveShaderProgram = [this](const std::string& shaderProgram, uint32_t features)
+		{
+			for (auto& [activeShaderProgram, activeFeatures] : activeShaderPrograms)
+			{
+				if (*activeShaderProgram == shaderProgram)
+				{
+					return;
+				}
+			}
 
-		std::vector<glm::mat4>& finalTransforms = animSystem->GetFinalTransforms();
+			activeShaderPrograms.emplace_back(&shaderProgram, features);
+		};
+
+		UpdatePendingModels();
+
+		// Clips registered by models of the same skeleton, models animated for the first time need other shaders
+		if (animSystem->LibraryClipsAdded())
+		{
+			for (auto& [modelName, model] : MSM)
+			{
+				bool animated = !model.model.second.animInfoVect.empty();
+
+				if (animSystem->BindLibraryClips(model.model.second) && !animated)
+				{
+					shaderPermutationsOutdated = true;
+				}
+			}
+		}
+
+		if (shaderPermutationsOutdated.exchange(false))
+		{
+			UpdateShaderPermutations();
+		}
+
+		activeShaderPrograms.clear();
+
+		glm::mat4 viewProj = camera->GetProjectionMatrixAddr() * camera->GetViewMatrixAddr();
+
+		size_t startSolidIndex = 0;
+		for (auto& [modelName, model] : MSM)
+		{
+			model.startSolidIndex = startSolidIndex;
+			startSolidIndex += model.solids.size();
+
+			// Models with no solid in view are not counted as drawn, so they can be evicted from GPU memory
+			model.model.first.visible = std::any_of(model.solids.begin(), model.solids.end(),
+				[this, &model, &viewProj](std::pair<const std::string, SolidSim>& solid)
+				{
+					return IsSolidInView(model, solid.second, viewProj);
+				}
+			);
+
+			AddActiveShaderProgram(model.model.first.shaderProgram, model.shaderFeatures);
+
+			if (!model.model.first.depthShaderProgram.empty())
+			{
+				AddActiveShaderProgram(
+					model.model.first.depthShaderProgram, 
+					ShaderGenerator::DepthOnly | (model.shaderFeatures & ShaderGenerator::Skinned)
+				);
+			}
+
+			if (model.preSkinned)
+			{
+				AddActiveShaderProgram(preSkinShaderProgram, ShaderGenerator::Skinned | ShaderGenerator::PreSkin);
+			}
+		}
+
+		AnimateSolids();
+
+		std::vector<glm::mat3x4>& finalTransforms = animSystem->GetFinalTransforms();
 
 		if (!finalTransforms.empty())
 		{
-			mainLGL->SetShaderUniformValue("Bones", finalTransforms, defaultShaderProgram);
+			UploadBones("Bones", finalTransforms);
+
+			if (bakedBonesOutdated)
+			{
+				bakedBonesOutdated = false;
+				UploadBones("BakedBones", bakedBones);
+			}
+
+			for (auto& [shaderProgram, features] : activeShaderPrograms)
+			{
+				if (features & ShaderGenerator::Skinned)
+				{
+					mainLGL->BindTextureBuffer("Bones", "Bones", *shaderProgram);
+					mainLGL->BindTextureBuffer("BakedBones", "BakedBones", *shaderProgram);
+				}
+			}
 		}
-		animSystem->ResetFinalTransforms();
+
+		PreSkinSolids();
 
 		camera->SetPosition(CameraSim::Direction::Nowhere);
 		camera->ExecuteAllScriptFuncs();
@@ -305,188 +503,982 @@ int EverettEngine::PollForLastKeyPressed()
 	mainLGL->SetKeyPressCallback(nullptr);
 	mainLGL->SetCursorPositionCallback(cursorCaptureCallback);
 
-	return lastKeyPressPoll.GetLastKeyPressedID();
+	return lastKeyPressPoll.GetLastKeyPressedID();
+}
+
+
+std::string EverettEngine::ConvertKeyTo(int keyId)
+{
+	return LGL::ConvertKeyTo(keyId);
+}
+
+int EverettEngine::ConvertKeyTo(const std::string& keyName)
+{
+	return LGL::ConvertKeyTo(keyName);
+}
+
+bool EverettEngine::CreateModel(const std::string& path, const std::string& name)
+{
+	return CreateModelImpl(path, name, !MSM.size());
+}
+
+bool EverettEngine::CreateModelImpl(const std::string& path, const std::string& name, bool regenerateShader)
+{
+	if (IsModelPending(name) || DoesModelExist(name))
+	{
+		return true;
+	}
+
+	// Model is imported outside of MSM, so the map is not held during the import
+	ModelSolidInfo newModel;
+	newModel.modelPath = CheckIfRelativePathToUse(path, "models");
+
+	AcquireLoadedTextures();
+
+	bool loaded = false;
+	{
+		std::lock_guard<std::mutex> lock(modelLoaderMux);
+		loaded = fileLoader->modelLoader.LoadModel(newModel.modelPath, name, newModel.model.first, newModel.model.second);
+	}
+
+	if (!loaded)
+	{
+		ReleaseLoadedTextures();
+		return false;
+	}
+
+	LGLStructs::ModelInfo* modelInfo = nullptr;
+	{
+		std::lock_guard<std::recursive_mutex> lock(modelsMux);
+
+		auto [modelIter, inserted] = MSM.emplace(name, std::move(newModel));
+
+		// Model of the same name created meanwhile is kept
+		if (!inserted)
+		{
+			ReleaseLoadedTextures();
+			return true;
+		}
+
+		SetupModel(name);
+
+		modelInfo = &modelIter->second.model.first;
+	}
+
+	if (regenerateShader)
+	{
+		GenerateShader();
+	}
+
+	mainLGL->CreateModel(name, *modelInfo);
+
+	ReleaseLoadedTextures();
+
+	return true;
+}
+
+std::shared_future<bool> EverettEngine::CreateModelAsync(
+	const std::string& path,
+	const std::string& name,
+	std::function<void(bool)> onReady
+)
+{
+	{
+		std::lock_guard<std::mutex> lock(pendingModelsMux);
+
+		auto pendingIter = pendingModels.find(name);
+
+		if (pendingIter != pendingModels.end())
+		{
+			if (onReady)
+			{
+				pendingIter->second.readyCallbacks.push_back(std::move(onReady));
+			}
+
+			return pendingIter->second.readyResult;
+		}
+
+		if (!DoesModelExist(name))
+		{
+			PendingModel& pendingModel = pendingModels[name];
+
+			pendingModel.model.modelPath = CheckIfRelativePathToUse(path, "models");
+			pendingModel.readyResult = pendingModel.ready.get_future().share();
+
+			if (onReady)
+			{
+				pendingModel.readyCallbacks.push_back(std::move(onReady));
+			}
+
+			AcquireLoadedTextures();
+
+			// Node of the pending model stays in place until the import is finished
+			pendingModel.import = std::async(std::launch::async, [this, &pendingModel, name]()
+			{
+				std::lock_guard<std::mutex> loaderLock(modelLoaderMux);
+
+				ModelSolidInfo& model = pendingModel.model;
+
+				// Result is read on render thread, so failures are reported instead of being rethrown there
+				try
+				{
+					return fileLoader->modelLoader.LoadModel(model.modelPath, name, model.model.first, model.model.second);
+				}
+				catch (const std::exception& exception)
+				{
+					std::cerr << "Model " << name << " could not be loaded: " << exception.what() << '\n';
+				}
+				catch (...)
+				{
+					std::cerr << "Model " << name << " could not be loaded\n";
+				}
+
+				return false;
+			});
+
+			return pendingModel.readyResult;
+		}
+
+		auto existingIter = existingPendingModels.emplace(name, PendingModel());
+		PendingModel& existingModel = existingIter->second;
+
+		existingModel.readyResult = existingModel.ready.get_future().share();
+
+		if (onReady)
+		{
+			existingModel.readyCallbacks.push_back(std::move(onReady));
+		}
+
+		// Every pending model keeps loaded textures until it is resolved
+		AcquireLoadedTextures();
+
+		return existingModel.readyResult;
+	}
+}
+
+bool EverettEngine::IsModelPending(const std::string& modelName)
+{
+	std::lock_guard<std::mutex> lock(pendingModelsMux);
+
+	return pendingModels.find(modelName) != pendingModels.end();
+}
+
+bool EverettEngine::DoesModelExist(const std::string& modelName)
+{
+	std::lock_guard<std::recursive_mutex> lock(modelsMux);
+
+	return MSM.find(modelName) != MSM.end();
+}
+
+void EverettEngine::UpdatePendingModels()
+{
+	struct ResolvedModel
+	{
+		std::promise<bool> ready;
+		std::vector<std::function<void(bool)>> readyCallbacks;
+		bool res;
+	};
+
+	std::vector<ResolvedModel> resolvedModels;
+
+	auto Resolve = [&resolvedModels](PendingModel& pendingModel, bool res)
+	{
+		resolvedModels.push_back({ std::move(pendingModel.ready), std::move(pendingModel.readyCallbacks), res });
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(pendingModelsMux);
+
+		for (auto& [name, existingModel] : existingPendingModels)
+		{
+			Resolve(existingModel, true);
+		}
+
+		existingPendingModels.clear();
+
+		for (auto droppedIter = droppedPendingModels.begin(); droppedIter != droppedPendingModels.end();)
+		{
+			std::future<bool>& import = droppedIter->second.import;
+
+			if (import.valid() && import.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++droppedIter;
+				continue;
+			}
+
+			Resolve(droppedIter->second, false);
+			droppedIter = droppedPendingModels.erase(droppedIter);
+		}
+
+		for (auto pendingIter = pendingModels.begin(); pendingIter != pendingModels.end();)
+		{
+			const std::string& name = pendingIter->first;
+			PendingModel& pendingModel = pendingIter->second;
+
+			bool resolved = false;
+			bool res = false;
+
+			if (!pendingModel.uploading)
+			{
+				if (pendingModel.import.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+				{
+					bool imported = pendingModel.import.get();
+					bool regenerateShader = false;
+					LGLStructs::ModelInfo* modelInfo = nullptr;
+
+					if (imported)
+					{
+						std::lock_guard<std::recursive_mutex> modelsLock(modelsMux);
+
+						regenerateShader = MSM.empty();
+
+						auto [modelIter, inserted] = MSM.emplace(name, std::move(pendingModel.model));
+
+						// Model of the same name created meanwhile is kept
+						if (inserted)
+						{
+							SetupModel(name);
+							modelInfo = &modelIter->second.model.first;
+						}
+					}
+
+					if (!modelInfo)
+					{
+						resolved = true;
+					}
+					else
+					{
+						if (regenerateShader)
+						{
+							GenerateShader();
+						}
+
+						mainLGL->CreateModelGradually(name, *modelInfo);
+						pendingModel.uploading = true;
+					}
+				}
+			}
+			else if (!DoesModelExist(name))
+			{
+				// Deleted during the upload
+				resolved = true;
+			}
+			else if (mainLGL->IsModelUploaded(name))
+			{
+				for (auto& solidName : pendingModel.solidNames)
+				{
+					CreateSolidImpl(name, solidName, false);
+				}
+
+				if (!pendingModel.solidNames.empty())
+				{
+					GenerateShader();
+				}
+
+				resolved = true;
+				res = true;
+			}
+
+			if (resolved)
+			{
+				Resolve(pendingModel, res);
+				pendingIter = pendingModels.erase(pendingIter);
+			}
+			else
+			{
+				++pendingIter;
+			}
+		}
+	}
+
+	// Callbacks may create or delete objects, so they are called without holding pending models
+	for (auto& resolvedModel : resolvedModels)
+	{
+		resolvedModel.ready.set_value(resolvedModel.res);
+
+		for (auto& onReady : resolvedModel.readyCallbacks)
+		{
+			onReady(resolvedModel.res);
+		}
+
+		ReleaseLoadedTextures();
+	}
+}
+
+void EverettEngine::AcquireLoadedTextures()
+{
+	std::lock_guard<std::mutex> lock(loadedTexturesMux);
+
+	++loadedTextureUsers;
+}
+
+void EverettEngine::ReleaseLoadedTextures()
+{
+	std::lock_guard<std::mutex> lock(loadedTexturesMux);
+
+	if (!--loadedTextureUsers)
+	{
+		fileLoader->modelLoader.FreeTextureData();
+	}
+}
+
+void EverettEngine::SetupModel(const std::string& name)
+{
+	auto modelIter = MSM.find(name);
+
+	LGLStructs::ModelInfo& newModel = modelIter->second.model.first;
+	AnimSystem::ModelAnim& newModelAnim = modelIter->second.model.second;
+
+	animSystem->RegisterClips(newModelAnim);
+
+	CheckAndAddToNameTracker(modelIter->first);
+
+	for (auto& meshInfo : newModel.meshes)
+	{
+		for (auto& vertex : meshInfo.mesh.vert)
+		{
+			MSM[name].boundingRadius = std::max(MSM[name].boundingRadius, glm::length(vertex.Position));
+
+			for (size_t i = 0; i < LGLStructs::Vertex::maxWeightPerVertex; ++i)
+			{
+				if (vertex.boneWeights[i] > 0.0f)
+				{
+					AnimSystem::ExtendBoneBounds(newModelAnim, static_cast<size_t>(vertex.boneIDs[i]), vertex.Position);
+				}
+			}
+		}
+	}
+
+	SelectShaderPermutation(MSM[name], newModel.shaderProgram, newModel.depthShaderProgram);
+	MSM[name].shaderFeatures = GetModelShaderFeatures(MSM[name]);
+	MSM[name].preSkinned = IsModelPreSkinned(MSM[name]);
+	newModel.render = false;
+
+	newModel.modelBehaviour = [this, name]()
+	{
+		// Existence of the lambda implies existence of the model
+		auto& model = MSM[name];
+
+		bool depthPrePass = mainLGL->IsDepthPrePassActive();
+
+		if (!model.solids.empty())
+		{
+			size_t index = model.startSolidIndex;
+			for (auto& [solidName, solid] : model.solids)
+			{
+				glm::mat4& modelMatrix = solid.GetModelMatrixAddr();
+
+				LGLUtils::SetShaderUniformArrayAt(*mainLGL, "models", index, modelMatrix);
+
+				if (!depthPrePass)
+				{
+					LGLUtils::SetShaderUniformArrayAt(*mainLGL, "invs", index, glm::inverse(modelMatrix));
+				}
+
+				++index;
+			}
+		}
+	};
+
+	newModel.generalMeshBehaviour = [this, name](int meshIndex)
+	{
+		// Existence of the lambda implies existence of the model
+		auto& model = MSM[name];
+
+		size_t index = model.startSolidIndex;
+		for (auto& [solidName, solid] : model.solids)
+		{
+			mainLGL->SetShaderUniformValue("meshVisibility", static_cast<int>(solid.GetModelMeshVisibility(meshIndex)));
+			mainLGL->SetShaderUniformValue("solidIndex", static_cast<int>(index));
+
+			// Palette of each solid is placed anew every frame
+			if (model.shaderFeatures & ShaderGenerator::Skinned)
+			{
+				AnimSystem::BakedPlayback& bakedPlayback = solid.GetModelBakedPlayback();
+
+				mainLGL->SetShaderUniformValue("startingBoneIndex", static_cast<int>(solid.GetModelStartingBoneIndex()));
+				mainLGL->SetShaderUniformValue("bakedFrames", bakedPlayback.frames);
+				mainLGL->SetShaderUniformValue("bakedFactor", bakedPlayback.factor);
+			}
+
+			if (model.preSkinned)
+			{
+				mainLGL->RenderMeshInstance(index - model.startSolidIndex);
+			}
+
+			++index;
+		}
+	};
+}
+
+bool EverettEngine::CreateSolid(const std::string& modelName, const std::string& solidName)
+{
+	{
+		std::lock_guard<std::mutex> lock(pendingModelsMux);
+
+		auto pendingIter = pendingModels.find(modelName);
+
+		// Solid is created once the model is ready
+		if (pendingIter != pendingModels.end())
+		{
+			pendingIter->second.solidNames.push_back(solidName);
+			return true;
+		}
+	}
+
+	return CreateSolidImpl(modelName, solidName, true);
+}
+
+bool EverettEngine::CreateSolidImpl(const std::string& modelName, const std::string& solidName, bool regenerateShader)
+{
+	{
+		std::lock_guard<std::recursive_mutex> lock(modelsMux);
+
+		auto modelIter = MSM.find(modelName);
+
+		if (modelIter == MSM.end())
+		{
+			return false;
+		}
+
+		ModelSolidInfo& model = modelIter->second;
+
+		if (model.solids.find(solidName) != model.solids.end())
+		{
+			return true;
+		}
+
+		SolidSim newSolid(camera->GetPositionVectorAddr() + camera->GetFrontVectorAddr());
+		newSolid.SetBackwardsModelAccess(model.model);
+
+		auto resPair = model.solids.emplace(solidName, std::move(newSolid));
+
+		if (!resPair.second)
+		{
+			return false;
+		}
+
+		model.model.first.render = true;
+		model.preSkinAllSolids = true;
+
+		CheckAndAddToNameTracker(resPair.first->first);
+	}
+
+	// Recompilation waits for render thread, so it is done without holding the models
+	if (regenerateShader)
+	{
+		GenerateShader();
+	}
+
+	return true;
+}
+
+void EverettEngine::GenerateShader()
+{
+	if (!shaderGen)
+	{
+		return;
+	}
+
+	size_t totalSolidAmount = GetCreatedSolidAmount();
+
+	std::vector<std::string> permutationNames;
+	{
+		std::lock_guard<std::mutex> lock(shaderGenMux);
+
+		// Generator is kept between calls, so amounts are reset back to the minimum as well
+		shaderGen->SetValueToDefine("DUAL_QUAT_BONES", useDualQuatBones ? 1 : 0);
+		shaderGen->SetValueToDefine("SOLID_AMOUNT", std::max(totalSolidAmount, size_t(1)));
+
+		permutationNames = shaderGen->RegeneratePermutations();
+	}
+
+	// Recompilation waits for render thread, so it is done without holding the generator
+	for (auto& permutationName : permutationNames)
+	{
+		mainLGL->RecompileShader(permutationName);
+	}
+}
+
+uint32_t EverettEngine::GetModelShaderFeatures(const ModelSolidInfo& model)
+{
+	const LGLStructs::ModelInfo& modelInfo = model.model.first;
+	uint32_t features = 0;
+
+	// Pre-skinned vertices are drawn as static ones
+	if (!model.model.second.animInfoVect.empty() && !IsModelPreSkinned(model))
+	{
+		features |= ShaderGenerator::Skinned;
+	}
+
+	if (!modelInfo.isTextureless)
+	{
+		features |= ShaderGenerator::Textured;
+
+		// Normal mapping is only used if every mesh has a normal map, as there is no fallback texture
+		bool allMeshesNormalMapped = !modelInfo.meshes.empty();
+		for (auto& mesh : modelInfo.meshes)
+		{
+			bool meshNormalMapped = std::any_of(
+				mesh.mesh.textures.begin(), 
+				mesh.mesh.textures.end(), 
+				[](const LGLStructs::Texture& texture) { return texture.type == LGLStructs::Texture::TextureType::Normal; }
+			);
+
+			if (!meshNormalMapped)
+			{
+				allMeshesNormalMapped = false;
+				break;
+			}
+		}
+
+		if (allMeshesNormalMapped)
+		{
+			features |= ShaderGenerator::NormalMapped;
+		}
+
+		// Untextured models are not lit, so light features are only relevant to textured ones
+		features |= GetLightShaderFeatures();
+	}
+
+	return features;
+}
+
+bool EverettEngine::IsModelPreSkinned(const ModelSolidInfo& model)
+{
+	return shaderGen && usePreSkinning && !model.model.second.animInfoVect.empty();
+}
+
+uint32_t EverettEngine::GetLightShaderFeatures()
+{
+	uint32_t features = 0;
+
+	if (!lights[LightTypes::Direction].empty())
+	{
+		features |= ShaderGenerator::DirLights;
+	}
+	if (!lights[LightTypes::Point].empty())
+	{
+		features |= ShaderGenerator::PointLights;
+	}
+	if (!lights[LightTypes::Spot].empty())
+	{
+		features |= ShaderGenerator::SpotLights;
+	}
+
+	return features;
+}
+
+bool EverettEngine::SelectShaderPermutation(
+	const ModelSolidInfo& model, 
+	std::string& shaderProgram, 
+	std::string& depthShaderProgram
+)
+{
+	std::string newShaderProgram = defaultShaderProgram;
+	std::string newDepthShaderProgram = "";
+
+	if (shaderGen)
+	{
+		std::lock_guard<std::mutex> lock(shaderGenMux);
+
+		uint32_t features = GetModelShaderFeatures(model);
+
+		newShaderProgram = shaderGen->GeneratePermutation(features);
+		newDepthShaderProgram = shaderGen->GeneratePermutation(
+			ShaderGenerator::DepthOnly | (features & ShaderGenerator::Skinned)
+		);
+
+		if (IsModelPreSkinned(model) && preSkinShaderProgram.empty())
+		{
+			std::string skinShaderProgram = ShaderGenerator::GetPermutationName(
+				defaultShaderProgram, ShaderGenerator::Skinned | ShaderGenerator::PreSkin
+			);
+
+			// Varyings are bound at link time, so they are set before the program is ever compiled
+			mainLGL->SetTransformFeedbackVaryings(skinShaderProgram, { "SkinnedPos", "SkinnedNormal" });
+			preSkinShaderProgram = shaderGen->GeneratePermutation(ShaderGenerator::Skinned | ShaderGenerator::PreSkin);
+		}
+	}
+
+	bool changed = newShaderProgram != shaderProgram || newDepthShaderProgram != depthShaderProgram;
+
+	shaderProgram = std::move(newShaderProgram);
+	depthShaderProgram = std::move(newDepthShaderProgram);
+
+	return changed;
+}
+
+void EverettEngine::UpdateShaderPermutations()
+{
+	if (!shaderGen)
+	{
+		return;
+	}
+
+	for (auto& [modelName, model] : MSM)
+	{
+		std::string shaderProgram = model.model.first.shaderProgram;
+		std::string depthShaderProgram = model.model.first.depthShaderProgram;
+
+		bool permutationChanged = SelectShaderPermutation(model, shaderProgram, depthShaderProgram);
+		bool preSkinned = IsModelPreSkinned(model);
+
+		// Pre-skinned models draw with static shaders, so they may become animated without a shader change
+		if (permutationChanged || model.preSkinned != preSkinned)
+		{
+			model.shaderFeatures = GetModelShaderFeatures(model);
+			mainLGL->SetModelShaderPrograms(modelName, shaderProgram, depthShaderProgram);
+
+			if (model.preSkinned && !preSkinned)
+			{
+				mainLGL->SetModelInstanceAmount(modelName, 0);
+			}
+
+			model.preSkinned = preSkinned;
+			model.preSkinAllSolids = true;
+		}
+	}
+}
+
+size_t EverettEngine::GetAnimationUpdateInterval(const ModelSolidInfo& model, SolidSim& solid, const glm::mat4& viewProj)
+{
+	if (!IsSolidInView(model, solid, viewProj))
+	{
+		return animationLOD.offscreenTimeOnly ? 0 : 8;
+	}
+
+	const AnimSystem::Bounds& bounds = solid.GetModelAnimatedBoundsAddr();
+	glm::vec3 boundsCenter = bounds.IsEmpty() ? glm::vec3(0.0f) : (bounds.min + bounds.max) * 0.5f;
+	glm::vec3 center = glm::vec3(solid.GetModelMatrixAddr() * glm::vec4(boundsCenter, 1.0f));
+
+	float distance = glm::distance(center, camera->GetPositionVectorAddr());
+	size_t updateInterval = 1;
+
+	for (size_t level = 0; level < animationLOD.distances.size(); ++level)
+	{
+		if (animationLOD.distances[level] > 0.0f && distance > animationLOD.distances[level])
+		{
+			updateInterval = size_t(2) << level;
+		}
+	}
+
+	return updateInterval;
 }
 
-
-std::string EverettEngine::ConvertKeyTo(int keyId)
+bool EverettEngine::IsSolidInView(const ModelSolidInfo& model, SolidSim& solid, const glm::mat4& viewProj)
 {
-	return LGL::ConvertKeyTo(keyId);
-}
+	const glm::mat4& modelMatrix = solid.GetModelMatrixAddr();
 
-int EverettEngine::ConvertKeyTo(const std::string& keyName)
-{
-	return LGL::ConvertKeyTo(keyName);
-}
+	const AnimSystem::Bounds& bounds = solid.GetModelAnimatedBoundsAddr();
 
-bool EverettEngine::CreateModel(const std::string& path, const std::string& name)
-{
-	return CreateModelImpl(path, name, !MSM.size());
-}
+	// Sphere around animated bounds of the current pose, bind pose sphere around the origin if there are none
+	glm::vec3 boundsCenter = bounds.IsEmpty() ? glm::vec3(0.0f) : (bounds.min + bounds.max) * 0.5f;
+	float boundsRadius = bounds.IsEmpty() ? model.boundingRadius : glm::length(bounds.max - bounds.min) * 0.5f;
 
-bool EverettEngine::CreateModelImpl(const std::string& path, const std::string& name, bool regenerateShader)
-{
-	if (MSM.find(name) != MSM.end())
+	glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(boundsCenter, 1.0f));
+	float maxScale = std::max({ glm::length(modelMatrix[0]), glm::length(modelMatrix[1]), glm::length(modelMatrix[2]) });
+	float radius = boundsRadius * maxScale;
+
+	// Frustum planes are extracted from rows of view projection matrix, sphere is outside if it is behind any of them
+	glm::mat4 rows = glm::transpose(viewProj);
+	bool offscreen = false;
+
+	for (int plane = 0; plane < 6 && !offscreen; ++plane)
 	{
-		return true;
+		glm::vec4 planeEq = rows[3] + (plane % 2 ? -rows[plane / 2] : rows[plane / 2]);
+		float normalLength = glm::length(glm::vec3(planeEq));
+
+		offscreen = normalLength > 0.0f && glm::dot(glm::vec3(planeEq), center) + planeEq.w < -radius * normalLength;
 	}
 
-	auto resPair = MSM.emplace(name, std::move(ModelSolidInfo{}));
-	
-	std::string pathToUse = CheckIfRelativePathToUse(path, "models");
+	return !offscreen;
+}
+
+void EverettEngine::AnimateSolids()
+{
+	std::lock_guard<std::mutex> lock(animationLODMux);
 
-	LGLStructs::ModelInfo& newModel = MSM[name].model.first;
-	AnimSystem::ModelAnim& newModelAnim = MSM[name].model.second;
-	MSM[name].modelPath = pathToUse;
+	animatedSolids.clear();
+	animSystem->ResetPoseCache();
 
-	if (!fileLoader->modelLoader.LoadModel(pathToUse, name, newModel, newModelAnim))
+	// Solids which are not animated share identity transforms at the start of the palette
+	size_t restBoneAmount = 0;
+	for (auto& [modelName, model] : MSM)
 	{
-		MSM.erase(name);
-		return false;
+		if (!model.model.second.animInfoVect.empty())
+		{
+			restBoneAmount = std::max(restBoneAmount, model.model.second.boneAmount);
+		}
 	}
 
-	CheckAndAddToNameTracker(resPair.first->first);
+	animSystem->ResetFinalTransforms(restBoneAmount);
 
-	newModel.shaderProgram = defaultShaderProgram;
-	newModel.render = false;
+	glm::mat4 viewProj = camera->GetProjectionMatrixAddr() * camera->GetViewMatrixAddr();
 
-	newModel.modelBehaviour = [this, name]()
-	{
-		// Existence of the lambda implies existence of the model
-		auto& model = MSM[name];
-		auto& [modelPath, modelInfo, solidInfo] = model;
+	// Pose registered in the cache to index of its owner in animatedSolids
+	std::unordered_map<const AnimSystem::PoseState*, size_t> poseCacheIndices;
+	size_t bakedSolids = 0;
 
-		bool animationless = model.model.second.animInfoVect.empty();
-		mainLGL->SetShaderUniformValue("textureless", static_cast<int>(modelInfo.first.isTextureless));
-		mainLGL->SetShaderUniformValue("animationless", static_cast<int>(animationless));
+	for (auto& [modelName, model] : MSM)
+	{
+		if (model.model.second.animInfoVect.empty())
+		{
+			continue;
+		}
 
-		if (!animationless)
+		for (auto& [solidName, solid] : model.solids)
 		{
-			for (auto& [solidName, solid] : solidInfo)
+			solid.GetModelBakedPlayback() = AnimSystem::BakedPlayback();
+
+			// Animation is in bind pose until it is cooked and its bounds are computed on a worker
+			bool animated =
+				solid.IsModelAnimationPlaying() && animSystem->RequestAnimation(model.model.second, solid.GetModelAnimation());
+
+			solid.GetModelAnimatedBoundsAddr() = animated ?
+				AnimSystem::GetAnimatedBounds(model.model.second, solid.GetModelAnimation(), solid.GetModelCurrentAnimationTime()) :
+				model.model.second.bindBounds;
+
+			if (!animated)
+			{
+				solid.SetModelStartingBoneIndex(0);
+			}
+			else if (solid.IsModelAnimationBaked())
 			{
-				if (solid.IsModelAnimationPlaying())
+				solid.SetModelStartingBoneIndex(0);
+				solid.GetModelBakedPlayback() = GetBakedPlayback(model, solid);
+
+				++bakedSolids;
+
+				if (model.preSkinned)
 				{
-					animSystem->ProcessAnimations(
-						modelInfo.second,
-						solid.GetModelCurrentAnimationTime(),
-						solid.GetModelAnimation(),
-						solid.GetModelCurrentStartingBoneIndex()
-					);
+					model.posedSolids.insert(solidName);
 				}
 			}
-		}
-
-		if (!model.solids.empty())
-		{
-			size_t index = currentStartSolidIndex = nextStartSolidIndex;
-			for (auto& [solidName, solid] : model.solids)
+			else
 			{
-				glm::mat4& modelMatrix = solid.GetModelMatrixAddr();
+				solid.SetModelStartingBoneIndex(animSystem->AllocatePalette(model.model.second.boneAmount));
 
-				LGLUtils::SetShaderUniformArrayAt(*mainLGL, "models", index, modelMatrix);
-				LGLUtils::SetShaderUniformArrayAt(*mainLGL, "invs", index, glm::inverse(modelMatrix));
+				size_t updateInterval = GetAnimationUpdateInterval(model, solid, viewProj);
 
-				if (!model.model.second.animInfoVect.empty())
+				// Time is advanced even for held poses, so animation continues where expected once it is visible
+				double animationTime = solid.GetModelCurrentAnimationTime();
+				size_t animIndex = solid.GetModelAnimation();
+				size_t sharedPoseIndex = SIZE_MAX;
+
+				// Only solids evaluating this frame register poses, so the first registered one is always evaluated
+				if (updateInterval &&
+					animSystem->IsPoseEvaluationDue(model.model.second, animIndex, solid.GetModelPoseState(), updateInterval))
 				{
-					mainLGL->SetShaderUniformValue("startingBoneIndex", static_cast<int>(
-						solid.GetModelCurrentStartingBoneIndex()
-						)
+					AnimSystem::PoseState* cachedPose = animSystem->FindOrRegisterCachedPose(
+						model.model.second, animIndex, animationTime, solid.GetModelPoseState()
 					);
+
+					if (cachedPose)
+					{
+						sharedPoseIndex = poseCacheIndices[cachedPose];
+					}
+					else
+					{
+						poseCacheIndices[&solid.GetModelPoseState()] = animatedSolids.size();
+					}
 				}
 
-				++index;
+				animatedSolids.push_back({ &model, &solid, updateInterval, animationTime, sharedPoseIndex, false });
+
+				// Held poses do not change, so pre-skinned vertices stay valid
+				if (model.preSkinned && updateInterval)
+				{
+					model.posedSolids.insert(solidName);
+				}
 			}
-			nextStartSolidIndex = index;
 		}
-	};
-
-	newModel.generalMeshBehaviour = [this, name](int meshIndex)
-	{
-		// Existence of the lambda implies existence of the model
-		auto& model = MSM[name];
 
-		size_t index = currentStartSolidIndex;
-		for (auto& [solidName, solid] : model.solids)
+		if (animationReleaseTime > 0.0f)
 		{
-			mainLGL->SetShaderUniformValue("meshVisibility", static_cast<int>(solid.GetModelMeshVisibility(meshIndex)));
-			mainLGL->SetShaderUniformValue("solidIndex", static_cast<int>(index));
-
-			++index;
+			animSystem->ReleaseUnusedAnimations(model.model.second, animationReleaseTime);
 		}
-	};
+	}
 
-	if (regenerateShader)
+	// Each solid owns its pose state and its range of final transforms, so solids need no synchronization.
+	// Solids sharing a pose go in the second pass, once poses they copy are evaluated
+	for (bool sharingPass : { false, true })
 	{
-		GenerateShader();
+		animWorkers->ParallelFor(animatedSolids.size(), [this, sharingPass](size_t index)
+		{
+			AnimatedSolid& animatedSolid = animatedSolids[index];
+			SolidSim& solid = *animatedSolid.solid;
+
+			bool sharesPose = animatedSolid.sharedPoseIndex != SIZE_MAX;
+
+			if (sharesPose != sharingPass)
+			{
+				return;
+			}
+
+			if (!animatedSolid.updateInterval)
+			{
+				animSystem->HoldPose(solid.GetModelStartingBoneIndex(), solid.GetModelPoseState());
+				return;
+			}
+
+			animatedSolid.evaluated = animSystem->ProcessAnimations(
+				animatedSolid.model->model.second,
+				animatedSolid.animationTime,
+				solid.GetModelAnimation(),
+				solid.GetModelStartingBoneIndex(),
+				solid.GetModelPoseState(),
+				animatedSolid.updateInterval,
+				sharesPose ? &animatedSolids[animatedSolid.sharedPoseIndex].solid->GetModelPoseState() : nullptr
+			);
+		});
 	}
 
-	mainLGL->CreateModel(name, newModel);
+	AnimationLODStats& stats = animationLOD.stats;
+	stats = AnimationLODStats();
+	stats.bakedSolids = bakedSolids;
 
-	fileLoader->modelLoader.FreeTextureData();
+	for (auto& animatedSolid : animatedSolids)
+	{
+		size_t boneAmount = animatedSolid.model->model.second.boneAmount;
 
-	return true;
-}
+		++stats.animatedSolids;
 
-bool EverettEngine::CreateSolid(const std::string& modelName, const std::string& solidName)
-{
-	return CreateSolidImpl(modelName, solidName, true);
+		if (animatedSolid.evaluated && animatedSolid.sharedPoseIndex == SIZE_MAX)
+		{
+			++stats.evaluatedSolids;
+			stats.evaluatedBones += boneAmount;
+		}
+		else if (animatedSolid.evaluated)
+		{
+			++stats.sharedPoses;
+			stats.skippedBones += boneAmount;
+		}
+		else
+		{
+			stats.skippedBones += boneAmount;
+		}
+	}
 }
 
-bool EverettEngine::CreateSolidImpl(const std::string& modelName, const std::string& solidName, bool regenerateShader)
+AnimSystem::BakedPlayback EverettEngine::GetBakedPlayback(ModelSolidInfo& model, SolidSim& solid)
 {
-	if (MSM[modelName].solids.find(solidName) != MSM[modelName].solids.end())
+	AnimSystem::ModelAnim& modelAnim = model.model.second;
+	size_t animIndex = solid.GetModelAnimation();
+
+	animSystem->BakeAnimation(modelAnim, animIndex, bakedAnimationRate);
+
+	if (animIndex >= modelAnim.bakedClips.size())
 	{
-		return true;
+		return AnimSystem::BakedPlayback();
 	}
 
-	SolidSim newSolid(camera->GetPositionVectorAddr() + camera->GetFrontVectorAddr());
-	newSolid.SetBackwardsModelAccess(MSM[modelName].model);
+	AnimSystem::BakedClip& bakedClip = modelAnim.bakedClips[animIndex];
 
-	for (auto& animInfo : MSM[modelName].model.second.animInfoVect)
+	if (bakedClip.frameAmount && bakedClip.startingBoneIndex == SIZE_MAX)
 	{
-		newSolid.AppendModelStartingBoneIndex(animSystem->GetTotalBoneAmount());
-		animSystem->IncrementTotalBoneAmount(MSM[modelName].model.second);
+		bakedClip.startingBoneIndex = bakedBones.size();
+		bakedBones.insert(bakedBones.end(), bakedClip.palettes.begin(), bakedClip.palettes.end());
+		bakedBonesOutdated = true;
+
+		// Uploaded palettes are kept by the engine only
+		std::vector<AnimSystem::Affine>().swap(bakedClip.palettes);
 	}
 
-	auto resPair = MSM[modelName].solids.emplace(solidName, std::move(newSolid));
+	return AnimSystem::GetBakedPlayback(bakedClip, modelAnim.boneAmount, solid.GetModelCurrentAnimationTime());
+}
 
-	if (resPair.second)
-	{
-		MSM[modelName].model.first.render = true;
+void EverettEngine::CompactBakedBones()
+{
+	std::vector<glm::mat3x4> compactedBones;
 
-		CheckAndAddToNameTracker(resPair.first->first);
+	for (auto& [modelName, model] : MSM)
+	{
+		AnimSystem::ModelAnim& modelAnim = model.model.second;
 
-		if (regenerateShader)
+		for (auto& bakedClip : modelAnim.bakedClips)
 		{
-			GenerateShader();
-		}
+			if (bakedClip.startingBoneIndex == SIZE_MAX)
+			{
+				continue;
+			}
 
-		return true;
+			auto paletteBegin = bakedBones.begin() + bakedClip.startingBoneIndex;
+
+			bakedClip.startingBoneIndex = compactedBones.size();
+			compactedBones.insert(compactedBones.end(), paletteBegin, paletteBegin + bakedClip.frameAmount * modelAnim.boneAmount);
+		}
 	}
 
-	return false;
+	// Playback of baked solids is computed every frame, so new starting indices are picked up by the next one
+	if (compactedBones.size() != bakedBones.size())
+	{
+		bakedBones.swap(compactedBones);
+		bakedBonesOutdated = true;
+	}
 }
 
-void EverettEngine::GenerateShader()
+void EverettEngine::UploadBones(const std::string& bufferName, const std::vector<glm::mat3x4>& bones)
 {
-	ShaderGenerator shaderGen;
-	size_t totalBoneAmount = animSystem->GetTotalBoneAmount();
-	size_t totalSolidAmount = GetCreatedSolidAmount();
+	// Buffer is created even without bones, so samplers of skinned shaders always point to a buffer
+	static const glm::mat3x4 identity(1.0f);
 
-	std::string filePath = FileLoader::GetCurrentDir() + '\\' + shaderPath + '\\' + defaultShaderProgram;
+	const glm::mat3x4* boneData = bones.empty() ? &identity : bones.data();
+	size_t boneAmount = std::max(bones.size(), size_t(1));
 
-	shaderGen.LoadPreSources(filePath);
-	if (totalBoneAmount > 1)
+	if (useDualQuatBones)
 	{
-		shaderGen.SetValueToDefine("BONE_AMOUNT", totalBoneAmount);
+		dualQuatBones.resize(boneAmount * 2);
+		AnimKernels::ToDualQuats(boneData, boneAmount, dualQuatBones.data());
+
+		mainLGL->UpdateTextureBuffer(bufferName, &dualQuatBones[0][0], dualQuatBones.size());
 	}
-	if (totalSolidAmount > 1)
+	else
 	{
-		shaderGen.SetValueToDefine("SOLID_AMOUNT", totalSolidAmount);
+		// Every row of affine transform is a texel
+		mainLGL->UpdateTextureBuffer(bufferName, &boneData[0][0][0], boneAmount * 3);
 	}
-	shaderGen.GenerateShaderFiles(filePath);
+}
+
+void EverettEngine::PreSkinSolids()
+{
+	for (auto& [modelName, model] : MSM)
+	{
+		if (!model.preSkinned)
+		{
+			continue;
+		}
+
+		size_t instanceIndex = 0;
+		for (auto& [solidName, solid] : model.solids)
+		{
+			// Solids which were not posed again keep their vertices from previous frames,
+			// ones which stopped being posed are skinned once more to return to bind pose
+			bool poseChanged = 
+				model.preSkinAllSolids ||
+				model.posedSolids.find(solidName) != model.posedSolids.end() ||
+				model.lastPosedSolids.find(solidName) != model.lastPosedSolids.end();
+
+			if (poseChanged)
+			{
+				mainLGL->PreSkinModelInstance(modelName, instanceIndex, preSkinShaderProgram, [this, &solid]() {
+					AnimSystem::BakedPlayback& bakedPlayback = solid.GetModelBakedPlayback();
+
+					mainLGL->SetShaderUniformValue(
+						"startingBoneIndex", static_cast<int>(solid.GetModelStartingBoneIndex())
+					);
+					mainLGL->SetShaderUniformValue("bakedFrames", bakedPlayback.frames);
+					mainLGL->SetShaderUniformValue("bakedFactor", bakedPlayback.factor);
+				});
+			}
+
+			++instanceIndex;
+		}
 
-	mainLGL->RecompileShader(defaultShaderProgram);
+		model.preSkinAllSolids = false;
+		std::swap(model.posedSolids, model.lastPosedSolids);
+		model.posedSolids.clear();
+	}
 }
 
 bool EverettEngine::CreateLight(const std::string& lightName, LightTypes lightType)
@@ -510,6 +1502,12 @@ bool EverettEngine::CreateLight(const std::string& lightName, LightTypes lightTy
 	{
 		CheckAndAddToNameTracker(resPair.first->first);
 
+		// Light types present in the scene are a part of shader permutation
+		if (lights[lightType].size() == 1)
+		{
+			shaderPermutationsOutdated = true;
+		}
+
 		return true;
 	}
 
@@ -550,22 +1548,42 @@ bool EverettEngine::DeleteModel(const std::string& modelName)
 
 	mainLGL->PauseRendering();
 
-	auto iter = MSM.find(modelName);
+	{
+		std::lock_guard<std::mutex> lock(pendingModelsMux);
+
+		auto pendingIter = pendingModels.find(modelName);
+
+		// Model can be created again right away, its import is left to finish in the background
+		if (pendingIter != pendingModels.end())
+		{
+			droppedPendingModels.insert(pendingModels.extract(pendingIter));
+			res = true;
+		}
+	}
 
-	if (iter != MSM.end())
+	if (DoesModelExist(modelName))
 	{
 		mainLGL->DeleteModel(modelName);
-		
-		for (auto currentSolidIter = iter->second.solids.begin(); 
-			 currentSolidIter != iter->second.solids.end(); 
-			 ++currentSolidIter
-		)
+
+		std::lock_guard<std::recursive_mutex> lock(modelsMux);
+
+		auto iter = MSM.find(modelName);
+
+		if (iter != MSM.end())
 		{
-			allNameTracker.erase(&currentSolidIter->first);
-		}
+			for (auto currentSolidIter = iter->second.solids.begin(); 
+				 currentSolidIter != iter->second.solids.end(); 
+				 ++currentSolidIter
+			)
+			{
+				allNameTracker.erase(&currentSolidIter->first);
+			}
+
+			allNameTracker.erase(&iter->first);
+			MSM.erase(iter);
 
-		allNameTracker.erase(&iter->first);
-		MSM.erase(modelName);
+			CompactBakedBones();
+		}
 
 		res = true;
 	}
@@ -582,18 +1600,38 @@ bool EverettEngine::DeleteSolid(const std::string& solidName)
 
 	mainLGL->PauseRendering();
 
-	for (auto& [modelName, modelInfo] : MSM)
+	std::vector<std::pair<std::string, size_t>> instanceAmounts;
 	{
-		auto iter = modelInfo.solids.find(solidName);
+		std::lock_guard<std::recursive_mutex> lock(modelsMux);
 
-		if (iter != modelInfo.solids.end())
+		for (auto& [modelName, modelInfo] : MSM)
 		{
-			allNameTracker.erase(&iter->first);
-			modelInfo.solids.erase(solidName);
+			auto iter = modelInfo.solids.find(solidName);
 
-			res = true;
+			if (iter != modelInfo.solids.end())
+			{
+				allNameTracker.erase(&iter->first);
+				modelInfo.solids.erase(iter);
+
+				modelInfo.preSkinAllSolids = true;
+				instanceAmounts.emplace_back(modelName, modelInfo.solids.size());
+
+				// Model without solids is not drawn, which makes it a candidate for eviction
+				if (modelInfo.solids.empty())
+				{
+					modelInfo.model.first.render = false;
+				}
+
+				res = true;
+			}
 		}
 	}
+
+	// Commands are executed in place while rendering is paused, which takes the context, so models are not held
+	for (auto& [modelName, instanceAmount] : instanceAmounts)
+	{
+		mainLGL->SetModelInstanceAmount(modelName, instanceAmount);
+	}
 	GenerateShader();
 
 	mainLGL->PauseRendering(false);
@@ -613,13 +1651,23 @@ bool EverettEngine::DeleteLight(const std::string& lightName)
 
 		if (iter != lightCollection.end())
 		{
-			allNameTracker.erase(&(*iter).first);
+			{
+				std::lock_guard<std::recursive_mutex> lock(modelsMux);
+
+				allNameTracker.erase(&(*iter).first);
+			}
+
 			lightCollection.erase(lightName);
 
 			res = true;
 		}
 	}
 
+	if (res)
+	{
+		shaderPermutationsOutdated = true;
+	}
+
 	mainLGL->PauseRendering(false);
 
 	return res;
@@ -635,7 +1683,12 @@ bool EverettEngine::DeleteSound(const std::string& soundName)
 
 	if (iter != sounds.end())
 	{
-		allNameTracker.erase(&(*iter).first);
+		{
+			std::lock_guard<std::recursive_mutex> lock(modelsMux);
+
+			allNameTracker.erase(&(*iter).first);
+		}
+
 		sounds.erase(soundName);
 
 		res = true;
@@ -698,58 +1751,91 @@ ICameraSim* EverettEngine::GetCameraInterface()
 
 void EverettEngine::LightUpdater()
 {
-	mainLGL->SetShaderUniformValue("proj", camera->GetProjectionMatrixAddr(), defaultShaderProgram);
-	mainLGL->SetShaderUniformValue("view", camera->GetViewMatrixAddr());
-
-	mainLGL->SetShaderUniformValue("dirLightAmount",   static_cast<int>(lights[LightTypes::Direction].size()));
-	mainLGL->SetShaderUniformValue("pointLightAmount", static_cast<int>(lights[LightTypes::Point].size()));
-	mainLGL->SetShaderUniformValue("spotLightAmount",  static_cast<int>(lights[LightTypes::Spot].size()));
-	mainLGL->SetShaderUniformValue("ambient", glm::vec3(0.4f, 0.4f, 0.4f));
-	
-	int index = 0;
-	for (auto& [lightName, light] : lights[LightTypes::Point])
+	// Each permutation is a separate program, so global values are set to every program in use
+	for (auto& [shaderProgram, features] : activeShaderPrograms)
 	{
-		LightSim::Attenuation atten = light.GetAttenuation();
+		if (features & ShaderGenerator::PreSkin)
+		{
+			continue;
+		}
 
-		LGLUtils::SetShaderUniformArrayAt(
-			*mainLGL,
-			lightShaderValueNames[1].first,
-			index++,
-			lightShaderValueNames[1].second,
-			light.GetPositionVectorAddr(), glm::vec3(0.4f, 0.4f, 0.4f),
-			glm::vec3(1.0f, 1.0f, 1.0f), 1.0f, atten.linear,
-			atten.quadratic
-		);
-	}
+		mainLGL->SetShaderUniformValue("proj", camera->GetProjectionMatrixAddr(), *shaderProgram);
+		mainLGL->SetShaderUniformValue("view", camera->GetViewMatrixAddr());
 
-	index = 0;
-	for (auto& [lightName, light] : lights[LightTypes::Spot])
-	{
-		LightSim::Attenuation atten = light.GetAttenuation();
+		if (!(features & ShaderGenerator::Textured))
+		{
+			continue;
+		}
 
-		LGLUtils::SetShaderUniformArrayAt(
-			*mainLGL,
-			lightShaderValueNames[2].first,
-			index++,
-			lightShaderValueNames[2].second,
-			light.GetPositionVectorAddr(), light.GetFrontVectorAddr(),
-			glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(1.0f, 1.0f, 1.0f), 1.0f,
-			atten.linear, atten.quadratic, glm::cos(glm::radians(12.5f)),
-			glm::cos(glm::radians(17.5f))
-		);
-	}
+		if (features & ShaderGenerator::DirLights)
+		{
+			mainLGL->SetShaderUniformValue("dirLightAmount", static_cast<int>(lights[LightTypes::Direction].size()));
+		}
+		if (features & ShaderGenerator::PointLights)
+		{
+			mainLGL->SetShaderUniformValue("pointLightAmount", static_cast<int>(lights[LightTypes::Point].size()));
+		}
+		if (features & ShaderGenerator::SpotLights)
+		{
+			mainLGL->SetShaderUniformValue("spotLightAmount", static_cast<int>(lights[LightTypes::Spot].size()));
+		}
+		mainLGL->SetShaderUniformValue("ambient", glm::vec3(0.4f, 0.4f, 0.4f));
 
+		if (features & ShaderGenerator::PointLights)
+		{
+			int index = 0;
+			for (auto& [lightName, light] : lights[LightTypes::Point])
+			{
+				LightSim::Attenuation atten = light.GetAttenuation();
+
+				LGLUtils::SetShaderUniformArrayAt(
+					*mainLGL,
+					lightShaderValueNames[1].first,
+					index++,
+					lightShaderValueNames[1].second,
+					light.GetPositionVectorAddr(), glm::vec3(0.4f, 0.4f, 0.4f),
+					glm::vec3(1.0f, 1.0f, 1.0f), 1.0f, atten.linear,
+					atten.quadratic
+				);
+			}
+		}
 
-	mainLGL->SetShaderUniformValue("viewPos", camera->GetPositionVectorAddr());
+		if (features & ShaderGenerator::SpotLights)
+		{
+			int index = 0;
+			for (auto& [lightName, light] : lights[LightTypes::Spot])
+			{
+				LightSim::Attenuation atten = light.GetAttenuation();
+
+				LGLUtils::SetShaderUniformArrayAt(
+					*mainLGL,
+					lightShaderValueNames[2].first,
+					index++,
+					lightShaderValueNames[2].second,
+					light.GetPositionVectorAddr(), light.GetFrontVectorAddr(),
+					glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(1.0f, 1.0f, 1.0f), 1.0f,
+					atten.linear, atten.quadratic, glm::cos(glm::radians(12.5f)),
+					glm::cos(glm::radians(17.5f))
+				);
+			}
+		}
 
-	LGLUtils::SetShaderUniformStruct(
-		*mainLGL,
-		lightShaderValueNames[0].first,
-		lightShaderValueNames[0].second,
-		0,
-		1,
-		0.5f
-	);
+		mainLGL->SetShaderUniformValue("viewPos", camera->GetPositionVectorAddr());
+
+		LGLUtils::SetShaderUniformStruct(
+			*mainLGL,
+			lightShaderValueNames[0].first,
+			lightShaderValueNames[0].second,
+			0,
+			1,
+			0.5f
+		);
+
+		if (features & ShaderGenerator::NormalMapped)
+		{
+			mainLGL->SetShaderUniformValue("material.normal", static_cast<int>(LGLStructs::Texture::TextureType::Normal));
+		}
+	}
 }
 
 void EverettEngine::SetScriptToObject(
@@ -1038,8 +2124,47 @@ void EverettEngine::ResetEngine()
 		fileLoader->dllLoader.FreeDllData();
 	}
 
+	std::multimap<std::string, PendingModel> droppedModels;
+	{
+		std::lock_guard<std::mutex> lock(pendingModelsMux);
+
+		droppedModels.swap(droppedPendingModels);
+
+		while (!pendingModels.empty())
+		{
+			droppedModels.insert(pendingModels.extract(pendingModels.begin()));
+		}
+
+		droppedModels.merge(existingPendingModels);
+	}
+
+	// Imports still write to their models, so they are waited for
+	for (auto& [modelName, pendingModel] : droppedModels)
+	{
+		if (pendingModel.import.valid())
+		{
+			pendingModel.import.wait();
+		}
+
+		pendingModel.ready.set_value(false);
+
+		for (auto& onReady : pendingModel.readyCallbacks)
+		{
+			onReady(false);
+		}
+
+		ReleaseLoadedTextures();
+	}
+
 	camera->ClearScriptFuncMap();
+
+	std::unique_lock<std::recursive_mutex> modelsLock(modelsMux);
+
 	MSM.clear();
+
+	// Buffer of baked palettes was deleted with the rest of LGL resources
+	bakedBones.clear();
+	bakedBonesOutdated = true;
 	lights.clear();
 
 	SoundSim::TriggerFreeDrWav();
@@ -1049,6 +2174,8 @@ void EverettEngine::ResetEngine()
 	keyScriptFuncMap.clear();
 	allNameTracker.clear();
 
+	modelsLock.unlock();
+
 	SetCustomStreamBuffers();
 	mainLGL->PauseRendering(false);
 }
@@ -1060,6 +2187,8 @@ bool EverettEngine::SaveDataToFile(const std::string& filePath)
 
 	file << SimSerializer::GetLatestVersionStr();
 
+	file << "Scene*DepthPrePass*" + SimSerializer::GetValueToSaveFrom(useDepthPrePass) + '\n';
+
 	SaveObjectsToFile<CameraSim>(file);
 	SaveObjectsToFile<SolidSim>(file);
 	SaveObjectsToFile<LightSim>(file);
@@ -1191,6 +2320,26 @@ void EverettEngine::LoadKeybindsFromLine(std::string_view& line)
 	}
 }
 
+void EverettEngine::LoadSceneSettingFromLine(std::string_view& line)
+{
+	line.remove_prefix(line.find('*') + 1);
+	std::string_view settingName = line.substr(0, line.find('*'));
+	line.remove_prefix(line.find('*') + 1);
+
+	if (settingName == "DepthPrePass")
+	{
+		bool value = false;
+		if (SimSerializer::SetValueToLoadFrom(line, value, 3))
+		{
+			EnableDepthPrePass(value);
+		}
+	}
+	else
+	{
+		ThrowExceptionWMessage("Unknown scene setting during world load");
+	}
+}
+
 bool EverettEngine::LoadDataFromFile(const std::string& filePath)
 {
 	std::string dllPathToUse = CheckIfRelativePathToUse(filePath, "worlds");
@@ -1215,6 +2364,10 @@ bool EverettEngine::LoadDataFromFile(const std::string& filePath)
 		{
 			LoadKeybindsFromLine(line);
 		}
+		else if (line.substr(0, line.find('*')) == "Scene")
+		{
+			LoadSceneSettingFromLine(line);
+		}
 		else if (!line.empty())
 		{
 			SimSerializer::GetObjectInfo(line, objectInfo);
@@ -1265,7 +2418,9 @@ void EverettEngine::GetPathsFromWorldFile(
 		std::getline(file, lineLoader);
 		line = lineLoader;
 
-		if (!(line.empty() || line.substr(0, line.find('*')) == "Keybind"))
+		std::string_view lineType = line.substr(0, line.find('*'));
+
+		if (!(line.empty() || lineType == "Keybind" || lineType == "Scene"))
 		{
 			SimSerializer::GetObjectInfo(line, objectInfo);
 
@@ -1525,6 +2680,8 @@ void EverettEngine::CloseWindow(const std::string& name)
 
 void EverettEngine::CheckAndAddToNameTracker(const std::string& name)
 {
+	std::lock_guard<std::recursive_mutex> lock(modelsMux);
+
 	int number;
 	std::string namePure = CommonStrEdits::RemoveDigitsFromStringEnd(name, number);
 
@@ -1560,6 +2717,8 @@ void EverettEngine::SetCustomStreamBuffers(bool value)
 
 std::string EverettEngine::GetAvailableObjectName(const std::string& name)
 {
+	std::lock_guard<std::recursive_mutex> lock(modelsMux);
+
 	if (allNameTracker.find(&name) != allNameTracker.end())
 	{
 		return (name + std::to_string(allNameTracker[&name]));
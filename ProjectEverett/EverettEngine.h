@@ -14,14 +14,18 @@
 #include <unordered_map>
 #include <string>
 #include <vector>
+#include <array>
 #include <memory>
 #include <thread>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
+#include <future>
+#include <atomic>
 #include <unordered_set>
 #include <chrono>
 #include <typeindex>
+#include <cstdint>
 
 #include "UnorderedPtrMap.h"
 
@@ -43,6 +47,8 @@ class WindowHandleHolder;
 class ScriptFuncStorage;
 class AnimSystem;
 class RenderLogger;
+class ShaderGenerator;
+class ThreadPool;
 
 struct HWND__;
 using HWND = HWND__*;
@@ -84,6 +90,19 @@ public:
 		_SIZE
 	};
 
+	// Collected during the last rendered frame
+	struct AnimationLODStats
+	{
+		size_t animatedSolids = 0;
+		size_t evaluatedSolids = 0;
+		// Solids which copied the pose of another solid in the same animation state
+		size_t sharedPoses = 0;
+		// Solids played back from baked animations, not counted as animated ones
+		size_t bakedSolids = 0;
+		size_t evaluatedBones = 0;
+		size_t skippedBones = 0;
+	};
+
 	EVERETT_API EverettEngine();
 	EVERETT_API ~EverettEngine();
 	EVERETT_API void CreateAndSetupMainWindow(
@@ -97,11 +116,55 @@ public:
 	EVERETT_API void SetShaderPath(const std::string& shaderPath);
 	EVERETT_API void SetFontPath(const std::string& fontPath);
 	EVERETT_API void SetDefaultWASDControls();
+	EVERETT_API void SetDynamicResolution(
+		bool enable,
+		float targetFrameTimeMs = 16.6f,
+		float minScale = 0.5f,
+		bool sharpenUpscale = false
+	);
+	EVERETT_API void SetFrameLimit(int targetFPS);
+	EVERETT_API void EnableAdaptiveVSync(bool value = true);
+	EVERETT_API void EnableFrameTimeReport(bool value = true);
+	EVERETT_API void EnableDepthPrePass(bool value = true);
+	// Animated solids are skinned once per frame into cached buffers, which all passes draw from
+	EVERETT_API void EnablePreSkinning(bool value = true);
+	// Models without visible solids are evicted from GPU memory once it exceeds the budget, 0 disables it
+	EVERETT_API void SetGPUMemoryBudget(size_t budgetMegabytes);
+	// Meshes and textures of asynchronously created models uploaded per frame, at least one mesh is uploaded each frame
+	EVERETT_API void SetModelUploadBudget(size_t budgetMegabytes);
+	// Solids further from the camera than given distances are posed at 1/2, 1/4 and 1/8 rate with interpolated
+	// poses in between, 0 disables a level. Solids outside of the view are posed at 1/8 rate or only advance time
+	EVERETT_API void SetAnimationLOD(
+		float halfRateDistance,
+		float quarterRateDistance,
+		float eighthRateDistance,
+		bool offscreenTimeOnly = true
+	);
+	EVERETT_API AnimationLODStats GetAnimationLODStats();
+	// Bones are sent to shaders as dual quaternions, 8 floats per bone instead of 12.
+	// Blending of dual quaternions preserves volume around joints, but scaling of bones is ignored
+	EVERETT_API void EnableDualQuaternionBones(bool value = true);
+	// Rate at which animations of solids flagged as baked are sampled, used for animations baked afterwards
+	EVERETT_API void SetBakedAnimationRate(float framesPerSecond);
+	// Animations are cooked on a worker when first played, solids stay in bind pose until it is done.
+	// Cooked animations which were not played for given time are released, 0 keeps them forever.
+	// Imported keys are freed once an animation is cooked, only animations of cached models can be released,
+	// as their keys are read again from the cache file
+	EVERETT_API void SetAnimationReleaseTime(float seconds);
 
 	EVERETT_API void RunRenderWindow();
 	EVERETT_API void StopRenderWindow();
 
 	EVERETT_API bool CreateModel(const std::string& path, const std::string& name);
+	// Model is imported on a worker and uploaded over following frames, so the caller is not blocked.
+	// Solids created for the model before it is ready appear once it is. Result tells whether the model
+	// was created, onReady is called with it on render thread, also if the model already exists
+	EVERETT_API std::shared_future<bool> CreateModelAsync(
+		const std::string& path,
+		const std::string& name,
+		std::function<void(bool)> onReady = nullptr
+	);
+	EVERETT_API bool IsModelPending(const std::string& modelName);
 	EVERETT_API bool CreateSolid(const std::string& modelName, const std::string& solidName);
 	EVERETT_API bool CreateLight(const std::string& lightName, LightTypes lightType);
 	EVERETT_API bool CreateSound(const std::string& path, const std::string& soundName);
@@ -206,13 +269,12 @@ private:
 
 	static inline const std::string saveFileType = ".esav";
 	std::string defaultShaderProgram;
+	// Shader programs used by models in the current frame, with their feature bits
+	std::vector<std::pair<const std::string*, uint32_t>> activeShaderPrograms;
 	std::string defaultRenderTextShaderProgram;
 	constexpr static inline char loggerFont[] = "consolab.ttf";
 	std::function<void(glm::vec4&&)> generalRenderTextBehaviour;
 
-	size_t currentStartSolidIndex;
-	size_t nextStartSolidIndex;
-
 	std::function<void(double, double)> cursorCaptureCallback;
 
 	struct ModelSolidInfo;
@@ -224,9 +286,38 @@ private:
 	using SoundCollection = std::map<std::string, SoundSim>;
 
 	bool CreateModelImpl(const std::string& path, const std::string& name, bool regenerateShader);
+	bool DoesModelExist(const std::string& modelName);
+	// Prepares imported model for rendering, before it is passed to LGL. Caller must hold models mutex
+	void SetupModel(const std::string& name);
+	// Moves imported models to MSM and creates their solids once uploaded, must be called on render thread
+	void UpdatePendingModels();
+	// Decoded textures of the model loader are kept while any model using them is being created
+	void AcquireLoadedTextures();
+	void ReleaseLoadedTextures();
 	bool CreateSolidImpl(const std::string& modelName, const std::string& solidName, bool regenerateShader);
 	void GenerateShader();
 
+	uint32_t GetModelShaderFeatures(const ModelSolidInfo& model);
+	bool IsModelPreSkinned(const ModelSolidInfo& model);
+	uint32_t GetLightShaderFeatures();
+	// Picks minimal shader permutation for the model, returns true if it differs from the current one
+	bool SelectShaderPermutation(const ModelSolidInfo& model, std::string& shaderProgram, std::string& depthShaderProgram);
+	// Must be called on render thread, so models switch programs between frames
+	void UpdateShaderPermutations();
+	void PreSkinSolids();
+	// Evaluates poses of all playing solids on animation workers, must be called on render thread
+	void AnimateSolids();
+	// Bakes and uploads the animation of the solid on the first use
+	AnimSystem::BakedPlayback GetBakedPlayback(ModelSolidInfo& model, SolidSim& solid);
+	// Moves palettes of remaining models together after a model is deleted, rendering must be paused
+	void CompactBakedBones();
+	// Bones are converted to dual quaternions if those are enabled
+	void UploadBones(const std::string& bufferName, const std::vector<glm::mat3x4>& bones);
+	// 0 means only animation time is advanced
+	size_t GetAnimationUpdateInterval(const ModelSolidInfo& model, SolidSim& solid, const glm::mat4& viewProj);
+	// Tests sphere around the animated bounds of the solid against the view frustum
+	bool IsSolidInView(const ModelSolidInfo& model, SolidSim& solid, const glm::mat4& viewProj);
+
 	size_t GetCreatedSolidAmount();
 
 	void LightUpdater();
@@ -274,6 +365,8 @@ private:
 	void LoadLightFromLine(std::string_view& line, const std::array<std::string, 4>& objectInfo);
 	void LoadSoundFromLine(std::string_view& line, const std::array<std::string, 4>& objectInfo);
 	void LoadKeybindsFromLine(std::string_view& line);
+	// Scene lines hold render settings saved with the world, worlds without them keep current settings
+	void LoadSceneSettingFromLine(std::string_view& line);
 
 	void SetCustomStreamBuffers(bool value = true);
 
@@ -284,9 +377,67 @@ private:
 	std::unique_ptr<FileLoader> fileLoader;
 	std::unique_ptr<CommandHandler> cmdHandler;
 	std::unique_ptr<AnimSystem> animSystem;
+	std::unique_ptr<ThreadPool> animWorkers;
+
+	struct AnimatedSolid
+	{
+		ModelSolidInfo* model;
+		SolidSim* solid;
+		size_t updateInterval;
+		double animationTime;
+		// Index of the solid which evaluates the same pose this frame, SIZE_MAX if there is none
+		size_t sharedPoseIndex;
+		bool evaluated;
+	};
+
+	// Reused between frames to avoid allocations
+	std::vector<AnimatedSolid> animatedSolids;
+
+	struct AnimationLODInfo
+	{
+		std::array<float, 3> distances = {};
+		bool offscreenTimeOnly = true;
+		AnimationLODStats stats;
+	};
+
+	AnimationLODInfo animationLOD;
+	std::mutex animationLODMux;
+	bool useDualQuatBones = false;
+	// Palette converted to dual quaternions, reused between frames
+	std::vector<glm::vec4> dualQuatBones;
+	// Palettes of every baked animation, uploaded whenever an animation is baked
+	std::vector<glm::mat3x4> bakedBones;
+	bool bakedBonesOutdated = true;
+	float bakedAnimationRate = 30.0f;
+	float animationReleaseTime = 30.0f;
 	std::unique_ptr<RenderLogger> logger;
+	std::unique_ptr<ShaderGenerator> shaderGen;
+	std::mutex shaderGenMux;
+	// Set from GUI threads, cleared by the render thread
+	std::atomic<bool> shaderPermutationsOutdated = false;
+	bool usePreSkinning = false;
+	// Saved with the world, so each scene decides on it
+	bool useDepthPrePass = false;
+	std::string preSkinShaderProgram;
 
 	ModelSolidsMap MSM;
+	// Guards MSM and name tracker against writers on render, GUI and script threads. It is only held for changes
+	// of the maps, never while waiting for render thread, which would deadlock with a frame waiting for the mutex
+	std::recursive_mutex modelsMux;
+
+	struct PendingModel;
+
+	std::mutex pendingModelsMux;
+	// Model loader is not reentrant
+	std::mutex modelLoaderMux;
+	std::mutex loadedTexturesMux;
+	size_t loadedTextureUsers = 0;
+	// Asynchronously created models until they are uploaded, their imports finish before the loader is destroyed
+	std::map<std::string, PendingModel> pendingModels;
+	// Pending models deleted before they were ready, kept until their imports are finished
+	std::multimap<std::string, PendingModel> droppedPendingModels;
+	// Requests of models which already existed, resolved on the next frame so callbacks run on render thread
+	std::multimap<std::string, PendingModel> existingPendingModels;
 	LightCollection lights;
 	SoundCollection sounds;
 
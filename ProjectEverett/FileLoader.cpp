@@ -8,6 +8,7 @@
 #endif
 
 #include <assimp/Importer.hpp>
+#include <assimp/DefaultIOSystem.h>
 #include "assimp/scene.h"
 #include "assimp/postprocess.h"
 #include "assimp/matrix4x4.h"
@@ -23,6 +24,36 @@
 
 #include "EverettException.h"
 
+#include <set>
+
+namespace
+{
+	// Default file access which remembers every file the importer opened, external files of the model among them
+	class RecordingIOSystem : public Assimp::DefaultIOSystem
+	{
+	public:
+		Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override
+		{
+			Assimp::IOStream* stream = Assimp::DefaultIOSystem::Open(pFile, pMode);
+
+			if (stream)
+			{
+				openedFiles.insert(pFile);
+			}
+
+			return stream;
+		}
+
+		const std::set<std::string>& GetOpenedFiles() const
+		{
+			return openedFiles;
+		}
+
+	private:
+		std::set<std::string> openedFiles;
+	};
+}
+
 void ConvertFromAssimpToGLM(const aiMatrix4x4& assimpMatrix, glm::mat4& glmMatrix)
 {
 	glmMatrix = {
@@ -112,7 +143,8 @@ bool FileLoader::ModelLoader::LoadTexture(
 	size_t dataSize
 )
 {
-	stbi_set_flip_vertically_on_load(data == nullptr);
+	// Textures are decoded by several workers at once, so the flag is set for the calling thread only
+	stbi_set_flip_vertically_on_load_thread(data == nullptr);
 
 	texture.data = data ? 
 		stbi_load_from_memory(data, static_cast<int>(dataSize), &texture.width, &texture.height, &texture.channelAmount, 0) :
@@ -128,6 +160,8 @@ bool FileLoader::ModelLoader::LoadTexture(
 		}
 
 		texture.name = textureName;
+
+		std::lock_guard<std::mutex> lock(texturesLoadedLock);
 		texturesLoaded[texture.name] = texture;
 
 		return true;
@@ -156,225 +190,306 @@ bool FileLoader::ModelLoader::GetTextureFilenames(const std::string& path)
 
 LGLStructs::Mesh FileLoader::ModelLoader::ProcessMesh(
 	const aiMesh* meshHandle, 
-	BoneMap& boneMap
+	const BoneMap& boneMap
 )
 {
-	auto GetVertexParam = [&meshHandle](LGLStructs::Vertex::BasicVertexData whichData)
-	{
-		using BasicVertexData = LGLStructs::Vertex::BasicVertexData;
+	using BasicVertex = LGLStructs::BasicVertex;
 
-		aiVector3D* tempVector = nullptr;
+	auto ProcessVerteces = [&meshHandle](LGLStructs::Mesh& mesh)
+	{
+		struct VertexAttribute
+		{
+			const aiVector3D* source;
+			glm::vec3 BasicVertex::* member;
+		};
 
-		switch (whichData)
+		const VertexAttribute vertexAttributes[] =
 		{
-		case BasicVertexData::Position:
-			tempVector = meshHandle->mVertices;
-			break;
-		case BasicVertexData::Normal:
-			tempVector = meshHandle->mNormals;
-			break;
-		case BasicVertexData::TexCoords:
-			tempVector = meshHandle->mTextureCoords[0];
-			break;
-		case BasicVertexData::Tangent:
-			tempVector = meshHandle->mTangents;
-			break;
-		case BasicVertexData::Bitangent:
-			tempVector = meshHandle->mBitangents;
-			break;
-		default:
-			ThrowExceptionWMessage("Vertex param does not exist");
-		}
+			{ meshHandle->mVertices,         &BasicVertex::Position  },
+			{ meshHandle->mNormals,          &BasicVertex::Normal    },
+			{ meshHandle->mTextureCoords[0], &BasicVertex::TexCoords },
+			{ meshHandle->mTangents,         &BasicVertex::Tangent   },
+			{ meshHandle->mBitangents,       &BasicVertex::Bitangent }
+		};
 
-		return tempVector;
-	};
+		mesh.vert.resize(meshHandle->mNumVertices);
 
-	auto ProcessVerteces = [&meshHandle, &GetVertexParam](LGLStructs::Mesh& mesh)
-	{
-		for (size_t i = 0; i < meshHandle->mNumVertices; ++i)
+		// Attributes are converted one after another, so every loop has a single source and no branches
+		for (auto& [source, member] : vertexAttributes)
 		{
-			LGLStructs::Vertex vert;
-			for (size_t vertData = 0; vertData < 5; ++vertData)
+			if (source)
 			{
-				glm::vec3 glmVect{ 0.0f, 0.0f, 0.0f };
-				aiVector3D* assimpVect = GetVertexParam(static_cast<LGLStructs::Vertex::BasicVertexData>(vertData));
-	
-				if (assimpVect)
+				for (size_t i = 0; i < mesh.vert.size(); ++i)
 				{
-					ConvertFromAssimpToGLM(*(assimpVect + i), glmVect);
+					mesh.vert[i].*member = glm::vec3(source[i].x, source[i].y, source[i].z);
+				}
+			}
+			else
+			{
+				for (auto& vert : mesh.vert)
+				{
+					vert.*member = glm::vec3(0.0f);
 				}
-				
-				vert[vertData] = glmVect;
 			}
-
-			mesh.vert.push_back(vert);
 		}
 	};
 
-	auto ProcessBones = [this, &meshHandle](LGLStructs::Mesh& mesh, BoneMap& boneMap)
+	auto ProcessBones = [&meshHandle](LGLStructs::Mesh& mesh, const BoneMap& boneMap)
 	{
 		for (size_t i = 0; i < meshHandle->mNumBones; ++i)
 		{
 			aiBone* bone = meshHandle->mBones[i];
 
-			std::string boneName = meshHandle->mBones[i]->mName.C_Str();
-
-			if (boneMap.find(boneName) == boneMap.end())
-			{
-				boneMap[boneName].id = static_cast<int>(boneMap.size());
-			}
+			int boneId = boneMap.find(bone->mName.C_Str())->second.id;
 
-			bool bonesSet = true;
 			for (size_t j = 0; j < bone->mNumWeights; ++j)
 			{
 				aiVertexWeight& vertWeight = bone->mWeights[j];
 
 				if (vertWeight.mWeight == 0.0f)
 				{
-					bonesSet = false;
 					break;
 				}
 				
-				mesh.vert[vertWeight.mVertexId].AddBoneData(boneMap[boneName].id, vertWeight.mWeight);
+				mesh.vert[vertWeight.mVertexId].AddBoneData(boneId, vertWeight.mWeight);
 			}
-
-			ConvertFromAssimpToGLM(bone->mOffsetMatrix, boneMap[boneName].offsetMatrix);
 		}
 	};
 
 	auto ProcessFaces = [&meshHandle](LGLStructs::Mesh& mesh)
 	{
+		size_t indexAmount = 0;
+
 		for (size_t i = 0; i < meshHandle->mNumFaces; ++i)
 		{
-			aiFace face = meshHandle->mFaces[i];
+			indexAmount += meshHandle->mFaces[i].mNumIndices;
+		}
 
-			for (size_t j = 0; j < face.mNumIndices; ++j)
-			{
-				mesh.indices.push_back(face.mIndices[j]);
-			}
+		mesh.indices.resize(indexAmount);
+
+		unsigned int* index = mesh.indices.data();
+
+		for (size_t i = 0; i < meshHandle->mNumFaces; ++i)
+		{
+			const aiFace& face = meshHandle->mFaces[i];
+
+			index = std::copy(face.mIndices, face.mIndices + face.mNumIndices, index);
 		}
 	};
 
-	auto ProcessTextures = [this, &meshHandle](LGLStructs::Mesh& mesh)
+	LGLStructs::Mesh mesh;
+
+	ProcessVerteces(mesh);
+	ProcessFaces(mesh);
+	ProcessBones(mesh, boneMap);
+
+	return mesh;
+}
+
+void FileLoader::ModelLoader::ProcessMeshTextures(
+	const aiMesh* meshHandle, 
+	std::vector<ModelCache::TextureRef>& meshTextureRefs
+)
+{
+	using TextureType = LGLStructs::Texture::TextureType;
+
+	struct TextureTypeInfo
+	{
+		TextureType lglTexType;
+		aiTextureType assimpTexType;
+		char filenameC;
+	};
+
+	static const std::vector<TextureTypeInfo> textureTypeInfo
 	{
-		using TextureType = LGLStructs::Texture::TextureType;
+		{TextureType::Diffuse,  aiTextureType_DIFFUSE,  'd'},
+		{TextureType::Specular, aiTextureType_SPECULAR, 's'},
+		{TextureType::Normal,   aiTextureType_NORMALS,  'n'},
+		{TextureType::Height,   aiTextureType_HEIGHT,   'h'}
+	};
 
-		struct TextureTypeInfo
-		{
-			TextureType lglTexType;
-			aiTextureType assimpTexType;
-			char filenameC;
-		};
+	const aiMaterial* material = modelHandle->mMaterials[meshHandle->mMaterialIndex];
 
-		static std::vector<TextureTypeInfo> textureTypeInfo
-		{
-			{TextureType::Diffuse,  aiTextureType_DIFFUSE,  'd'},
-			{TextureType::Specular, aiTextureType_SPECULAR, 's'},
-			{TextureType::Normal,   aiTextureType_NORMALS,  'n'},
-			{TextureType::Height,   aiTextureType_HEIGHT,   'h'}
-		};
+	for (size_t texTypeIndex = 0; texTypeIndex < LGLStructs::Texture::GetTextureTypeAmount(); ++texTypeIndex)
+	{
+		aiTextureType convertedType = textureTypeInfo[texTypeIndex].assimpTexType;
 
-		auto LoadTextureByMaterial = [this](LGLStructs::Mesh& mesh, aiMaterial* material, size_t texTypeIndex)
+		for (size_t i = 0; i < material->GetTextureCount(convertedType); ++i)
 		{
-			/*
-			auto CheckForAdditionalTextures = [this](LGLStructs::Mesh& mesh)
+			aiString str;
+			material->GetTexture(convertedType, static_cast<unsigned int>(i), &str);
+			std::string strWithoutPrefix = str.C_Str();
+
+			const aiTexture* embeddedTexture = modelHandle->GetEmbeddedTexture(strWithoutPrefix.c_str());
+
+			ModelCache::TextureRef& textureRef = meshTextureRefs.emplace_back();
+			textureRef.path = strWithoutPrefix;
+			textureRef.type = textureTypeInfo[texTypeIndex].lglTexType;
+
+			if (embeddedTexture)
 			{
-				std::vector<bool> foundTexTypes(LGLStructs::Texture::GetTextureTypeAmount(), false);
-				std::string name = mesh.textures.front().name;
+				unsigned char* embeddedData = reinterpret_cast<unsigned char*>(embeddedTexture->pcData);
+				textureRef.embeddedData.assign(embeddedData, embeddedData + embeddedTexture->mWidth);
+			}
+		}
+	}
+}
 
-				for (auto& tex : mesh.textures)
-				{
-					foundTexTypes[static_cast<int>(tex.type)] = true;
-				}
+bool FileLoader::ModelLoader::FindLoadedTexture(const std::string& textureName, LGLStructs::Texture& texture)
+{
+	std::lock_guard<std::mutex> lock(texturesLoadedLock);
 
-				for(size_t i = 0; i < LGLStructs::Texture::GetTextureTypeAmount(); ++i)
-				{
-					if (!foundTexTypes[i])
-					{
-						//if(name.find('.') !)
-						bool isUpper = std::isupper(name[name.find('.') - 1]);
-						name[name.find('.') - 1] = isUpper ? std::toupper(textureTypeInfo[i].filenameC) : textureTypeInfo[i].filenameC;
-						if (std::find(texturesFound.begin(), texturesFound.end(), name) != texturesFound.end())
-						{
-							mesh.textures.push_back({ name, static_cast<LGLStructs::Texture::TextureType>(i) });
-						}
-					}
-				}
-			};
-			*/
+	auto textureIter = texturesLoaded.find(textureName);
 
-			aiTextureType convertedType = textureTypeInfo[texTypeIndex].assimpTexType;
+	if (textureIter == texturesLoaded.end())
+	{
+		return false;
+	}
 
-			for (size_t i = 0; i < material->GetTextureCount(convertedType); ++i)
-			{
-				aiString str;
-				material->GetTexture(convertedType, static_cast<unsigned int>(i), &str);
-				std::string strWithoutPrefix = str.C_Str();
+	texture = textureIter->second;
 
-				LGLStructs::Texture newTexture;
+	return true;
+}
 
-				newTexture.name = nameToSet + '_' + strWithoutPrefix;
-				newTexture.type = textureTypeInfo[texTypeIndex].lglTexType;
+void FileLoader::ModelLoader::LoadTextureRefs(LGLStructs::ModelInfo& model, ModelCache::TextureRefs& meshTextureRefs)
+{
+	struct TextureJob
+	{
+		ModelCache::TextureRef* textureRef;
+		LGLStructs::Texture texture;
+	};
 
-				const aiTexture* embeddedTexture = modelHandle->GetEmbeddedTexture(strWithoutPrefix.c_str());
+	std::vector<TextureJob> jobs;
+	std::unordered_map<std::string, size_t> jobIndexByName;
 
-				if (texturesLoaded.find(newTexture.name) == texturesLoaded.end())
-				{
-					LoadTexture(
-						newTexture.name,
-						newTexture,
-						embeddedTexture ? reinterpret_cast<unsigned char*>(embeddedTexture->pcData) : nullptr,
-						embeddedTexture ? embeddedTexture->mWidth : -1
-					);
-				}
-				else
-				{
-					newTexture = texturesLoaded[newTexture.name];
-				}
+	// Every texture of the model not loaded before is decoded once, however many meshes refer to it
+	for (auto& textureRefs : meshTextureRefs)
+	{
+		for (auto& textureRef : textureRefs)
+		{
+			std::string textureName = nameToSet + '_' + textureRef.path;
+			LGLStructs::Texture loadedTexture;
 
-				if (newTexture.data)
-				{
-					mesh.textures.push_back(newTexture);
-				}
+			if (jobIndexByName.find(textureName) != jobIndexByName.end() || FindLoadedTexture(textureName, loadedTexture))
+			{
+				continue;
 			}
-		};
 
-		aiMaterial* material = modelHandle->mMaterials[meshHandle->mMaterialIndex];
+			jobIndexByName.emplace(textureName, jobs.size());
+
+			TextureJob& job = jobs.emplace_back();
+			job.textureRef = &textureRef;
+			job.texture.name = textureName;
+			job.texture.type = textureRef.type;
+		}
+	}
 
-		for (size_t i = 0; i < LGLStructs::Texture::GetTextureTypeAmount(); ++i)
+	if (!jobs.empty())
+	{
+		if (!loadWorkers)
 		{
-			LoadTextureByMaterial(mesh, material, i);
+			loadWorkers = std::make_unique<ThreadPool>();
 		}
-	};
 
-	LGLStructs::Mesh mesh;
+		loadWorkers->ParallelFor(jobs.size(), [this, &jobs](size_t jobIndex)
+		{
+			TextureJob& job = jobs[jobIndex];
+			std::vector<unsigned char>& embeddedData = job.textureRef->embeddedData;
 
-	ProcessVerteces(mesh);
-	ProcessFaces(mesh);
-	ProcessTextures(mesh);
-	ProcessBones(mesh, boneMap);
+			LoadTexture(job.texture.name, job.texture, embeddedData.empty() ? nullptr : embeddedData.data(), embeddedData.size());
+		});
+	}
 
-	return mesh;
+	for (size_t meshIndex = 0; meshIndex < model.meshes.size() && meshIndex < meshTextureRefs.size(); ++meshIndex)
+	{
+		for (auto& textureRef : meshTextureRefs[meshIndex])
+		{
+			std::string textureName = nameToSet + '_' + textureRef.path;
+			LGLStructs::Texture newTexture;
+
+			auto jobIter = jobIndexByName.find(textureName);
+
+			if (jobIter != jobIndexByName.end())
+			{
+				newTexture = jobs[jobIter->second].texture;
+			}
+			else
+			{
+				FindLoadedTexture(textureName, newTexture);
+			}
+
+			if (newTexture.data)
+			{
+				model.meshes[meshIndex].mesh.textures.push_back(newTexture);
+			}
+		}
+	}
 }
 
 void FileLoader::ModelLoader::ProcessNodeForModelInfo(
 	const aiNode* nodeHandle,
-	LGLStructs::ModelInfo& model,
-	BoneMap& boneMap
+	std::vector<const aiMesh*>& meshHandles
 )
 {
 	for (size_t i = 0; i < nodeHandle->mNumMeshes; ++i)
 	{
-		aiMesh* meshHandle = modelHandle->mMeshes[nodeHandle->mMeshes[i]];
-		model.AddMesh(ProcessMesh(meshHandle, boneMap), meshHandle->mName.C_Str());
+		meshHandles.push_back(modelHandle->mMeshes[nodeHandle->mMeshes[i]]);
 	}
 
 	for (size_t i = 0; i < nodeHandle->mNumChildren; ++i)
 	{
-		ProcessNodeForModelInfo(nodeHandle->mChildren[i], model, boneMap);
+		ProcessNodeForModelInfo(nodeHandle->mChildren[i], meshHandles);
 	}
 }
 
+void FileLoader::ModelLoader::ProcessMeshes(
+	const std::vector<const aiMesh*>& meshHandles,
+	LGLStructs::ModelInfo& model,
+	BoneMap& boneMap
+)
+{
+	// Bone ids are assigned in mesh order up front, so they do not depend on the order workers finish in
+	for (const aiMesh* meshHandle : meshHandles)
+	{
+		for (size_t i = 0; i < meshHandle->mNumBones; ++i)
+		{
+			aiBone* bone = meshHandle->mBones[i];
+
+			std::string boneName = bone->mName.C_Str();
+
+			if (boneMap.find(boneName) == boneMap.end())
+			{
+				boneMap[boneName].id = static_cast<int>(boneMap.size());
+			}
+
+			ConvertFromAssimpToGLM(bone->mOffsetMatrix, boneMap[boneName].offsetMatrix);
+		}
+	}
+
+	if (!loadWorkers)
+	{
+		loadWorkers = std::make_unique<ThreadPool>();
+	}
+
+	std::vector<LGLStructs::Mesh> meshes(meshHandles.size());
+	textureRefs.resize(meshHandles.size());
+
+	// Workers only read the bone map and each of them writes its own mesh and texture references
+	loadWorkers->ParallelFor(meshes.size(), [this, &meshHandles, &meshes, &boneMap](size_t meshIndex)
+	{
+		meshes[meshIndex] = ProcessMesh(meshHandles[meshIndex], boneMap);
+		ProcessMeshTextures(meshHandles[meshIndex], textureRefs[meshIndex]);
+	});
+
+	for (size_t meshIndex = 0; meshIndex < meshes.size(); ++meshIndex)
+	{
+		model.AddMesh(std::move(meshes[meshIndex]), meshHandles[meshIndex]->mName.C_Str());
+	}
+
+	// Textures referenced by all meshes are decoded together
+	LoadTextureRefs(model, textureRefs);
+}
+
 void FileLoader::ModelLoader::ProcessNodeForBoneTree(
 	const std::string& rootNodeName,
 	const aiNode* nodeHandle,
@@ -390,8 +505,7 @@ void FileLoader::ModelLoader::ProcessNodeForBoneTree(
 
 	if (nodeName != rootNodeName)
 	{
-		parentTreeNode->AddNode(nodeName, {});
-		currentNode = parentTreeNode->FindNodeBy(nodeName);
+		currentNode = parentTreeNode->AddNode(nodeName, {});
 		currentBoneInfo = &currentNode->GetValue();
 		ConvertFromAssimpToGLM(nodeHandle->mTransformation, currentBoneInfo->localTransform);
 		globalTransform = currentBoneInfo->globalTransform = parentTreeNode->GetValue().globalTransform * currentBoneInfo->localTransform;
@@ -451,7 +565,7 @@ void FileLoader::ModelLoader::SetGlobalInverseTransform(
 }
 
 void FileLoader::ModelLoader::LoadAnimations(
-	AnimSystem::AnimKeyMap& animKeyMap,
+	std::vector<AnimSystem::RawClip>& rawClips,
 	AnimSystem::AnimInfoVect& animInfoVect
 )
 {
@@ -465,6 +579,9 @@ void FileLoader::ModelLoader::LoadAnimations(
 		{
 			animInfoVect.push_back({ animHandle->mName.C_Str(), animHandle->mDuration , animHandle->mTicksPerSecond });
 
+			// Only nodes the animation has channels for get keys, those are cooked once the animation is used
+			auto& rawClip = rawClips.emplace_back();
+
 			for (size_t channelIndex = 0; channelIndex < animHandle->mNumChannels; ++channelIndex)
 			{
 				const aiNodeAnim* animNode = animHandle->mChannels[channelIndex];
@@ -475,13 +592,7 @@ void FileLoader::ModelLoader::LoadAnimations(
 				ParseAnimInfo(animNode->mRotationKeys, animNode->mNumRotationKeys, currentAnimInfo.rotationKeys);
 				ParseAnimInfo(animNode->mScalingKeys,  animNode->mNumScalingKeys,  currentAnimInfo.scalingKeys );
 
-				std::string nodeName = animNode->mNodeName.C_Str();
-				if (animKeyMap.find(nodeName) == animKeyMap.end())
-				{
-					animKeyMap[nodeName].resize(animAmount);
-				}
-
-				animKeyMap[nodeName][animIndex] = currentAnimInfo;
+				AnimSystem::AppendRawChannel(rawClip, animNode->mNodeName.C_Str(), currentAnimInfo);
 			}
 		}
 	}
@@ -490,6 +601,8 @@ void FileLoader::ModelLoader::LoadAnimations(
 
 void FileLoader::ModelLoader::FreeTextureData()
 {
+	std::lock_guard<std::mutex> lock(texturesLoadedLock);
+
 	for (auto& [textureName, texture] : texturesLoaded)
 	{
 		stbi_image_free(texture.data);
@@ -506,8 +619,37 @@ bool FileLoader::ModelLoader::LoadModel(
 	AnimSystem::ModelAnim& modelAnim
 )
 {
+	// Tangent space is needed by normal mapped shader permutation
+	constexpr unsigned int importFlags =
+		aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_LimitBoneWeights | aiProcess_CalcTangentSpace;
+
+	std::string cachePath = ModelCache::GetCachePath(file);
+	ModelCache::CacheKey cacheKey;
+	bool cacheKeyValid = ModelCache::GetCacheKey(file, importFlags, cacheKey);
+
+	textureRefs.clear();
+
+	if (cacheKeyValid && ModelCache::Load(cachePath, cacheKey, model, modelAnim, textureRefs))
+	{
+		nameToSet = name;
+		if (file.substr(file.find('.')) == ".obj")
+		{
+			GetTextureFilenames(file);
+		}
+
+		LoadTextureRefs(model, textureRefs);
+		model.RecheckIfTextureless();
+		AnimSystem::CompileSkeleton(modelAnim);
+
+		return true;
+	}
+
+	// Importer takes ownership of the IO system
+	RecordingIOSystem* ioSystem = new RecordingIOSystem();
+
 	Assimp::Importer importer;
-	modelHandle = importer.ReadFile(file, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_LimitBoneWeights);
+	importer.SetIOHandler(ioSystem);
+	modelHandle = importer.ReadFile(file, importFlags);
 
 	if (!modelHandle || modelHandle->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !modelHandle->mRootNode)
 	{
@@ -522,8 +664,10 @@ bool FileLoader::ModelLoader::LoadModel(
 	}
 
 	BoneMap boneMap;
+	std::vector<const aiMesh*> meshHandles;
 
-	ProcessNodeForModelInfo(modelHandle->mRootNode, model, boneMap);
+	ProcessNodeForModelInfo(modelHandle->mRootNode, meshHandles);
+	ProcessMeshes(meshHandles, model, boneMap);
 	model.RecheckIfTextureless();
 	model.NormalizeAllEmptyWeights();
 
@@ -531,10 +675,31 @@ bool FileLoader::ModelLoader::LoadModel(
 
 	glm::mat4 globalTransform = glm::mat4(1.0f);
 	std::string rootNodeName = modelHandle->mRootNode->mName.C_Str();
-	modelAnim.boneTree.AddRootNode(rootNodeName, {});
-	ProcessNodeForBoneTree(rootNodeName, modelHandle->mRootNode, boneMap, modelAnim.boneTree.FindNodeBy(rootNodeName), globalTransform);
+	AnimSystem::BoneTree::TreeManagerNode* rootNode = modelAnim.boneTree.AddRootNode(rootNodeName, {});
+	ProcessNodeForBoneTree(rootNodeName, modelHandle->mRootNode, boneMap, rootNode, globalTransform);
 	SetGlobalInverseTransform(rootNodeName, modelAnim);
-	LoadAnimations(modelAnim.animKeyMap, modelAnim.animInfoVect);
+	LoadAnimations(modelAnim.rawClips, modelAnim.animInfoVect);
+
+	// Files other than the source which the importer read, their changes have to invalidate the cache too
+	std::vector<std::string> dependencyPaths;
+
+	for (auto& openedFile : ioSystem->GetOpenedFiles())
+	{
+		std::error_code error;
+
+		if (!std::filesystem::equivalent(openedFile, file, error))
+		{
+			dependencyPaths.push_back(openedFile);
+		}
+	}
+
+	// Raw clips still hold node names until the skeleton is compiled, so the cache is written before it
+	if (cacheKeyValid && !ModelCache::Save(cachePath, cacheKey, dependencyPaths, model, modelAnim, textureRefs))
+	{
+		std::cerr << "Model cache could not be written to " << cachePath << '\n';
+	}
+
+	AnimSystem::CompileSkeleton(modelAnim);
 	
 	return true;
 }
@@ -7,10 +7,13 @@
 #include <string>
 #include <functional>
 #include <mutex>
+#include <memory>
 
 #include "interfaces/ISolidSim.h"
 #include "ScriptFuncStorage.h"
 #include "AnimSystem.h"
+#include "ModelCache.h"
+#include "ThreadPool.h"
 
 // Assimp forward declarations
 struct aiScene;
@@ -40,12 +43,23 @@ class FileLoader
 		const aiScene* modelHandle;
 		std::vector<std::string> extraTextureName;
 		std::map<std::string, LGLStructs::Texture> texturesLoaded;
+		// Textures are decoded and added by workers
+		std::mutex texturesLoadedLock;
 		std::string nameToSet;
+		// Per processed mesh, references of textures added to it, written to the model cache
+		ModelCache::TextureRefs textureRefs;
+		// Created on the first load
+		std::unique_ptr<ThreadPool> loadWorkers;
 
 		using BoneMap = std::unordered_map<std::string, AnimSystem::BoneInfo>;
 
+		// Gathers meshes of the node and its children, in the order they are added to the model
 		void ProcessNodeForModelInfo(
 			const aiNode* nodeHandle,
+			std::vector<const aiMesh*>& meshHandles
+		);
+		void ProcessMeshes(
+			const std::vector<const aiMesh*>& meshHandles,
 			LGLStructs::ModelInfo& model,
 			BoneMap& boneMap
 		);
@@ -61,12 +75,18 @@ class FileLoader
 			AnimSystem::ModelAnim& modelAnim
 		);
 		void LoadAnimations(
-			AnimSystem::AnimKeyMap& animKeyMap,
+			std::vector<AnimSystem::RawClip>& rawClips,
 			AnimSystem::AnimInfoVect& animInfo
 		);
 
 		bool GetTextureFilenames(const std::string& path);
-		LGLStructs::Mesh ProcessMesh(const aiMesh* meshHandle, BoneMap& boneMap);
+		// Converts geometry and bone weights, bones must already be in the map. Safe to call from several threads
+		LGLStructs::Mesh ProcessMesh(const aiMesh* meshHandle, const BoneMap& boneMap);
+		// Only gathers references, textures are decoded later for the whole model. Safe to call from several threads
+		void ProcessMeshTextures(const aiMesh* meshHandle, std::vector<ModelCache::TextureRef>& meshTextureRefs);
+		bool FindLoadedTexture(const std::string& textureName, LGLStructs::Texture& texture);
+		// Decodes textures not loaded yet on workers, then adds all referenced ones to their meshes
+		void LoadTextureRefs(LGLStructs::ModelInfo& model, ModelCache::TextureRefs& meshTextureRefs);
 	public:
 		bool LoadModel(
 			const std::string& file,
@@ -0,0 +1,686 @@
+#include "ModelCache.h"
+
+#include <Windows.h>
+
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <type_traits>
+
+namespace
+{
+	constexpr uint64_t fnvOffset = 0xcbf29ce484222325ull;
+	constexpr uint64_t fnvPrime = 0x100000001b3ull;
+
+	// Read only view of a whole file, holds no data if the file can not be mapped
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::string& path)
+		{
+			fileHandle = CreateFileA(
+				path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+			);
+
+			if (fileHandle == INVALID_HANDLE_VALUE)
+			{
+				return;
+			}
+
+			LARGE_INTEGER fileSize;
+
+			if (!GetFileSizeEx(fileHandle, &fileSize) || !fileSize.QuadPart)
+			{
+				return;
+			}
+
+			mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+			if (!mappingHandle)
+			{
+				return;
+			}
+
+			data = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+			if (data)
+			{
+				size = static_cast<size_t>(fileSize.QuadPart);
+			}
+		}
+
+		~MappedFile()
+		{
+			if (data)
+			{
+				UnmapViewOfFile(data);
+			}
+
+			if (mappingHandle)
+			{
+				CloseHandle(mappingHandle);
+			}
+
+			if (fileHandle != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(fileHandle);
+			}
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const char* GetData() const { return data; }
+		size_t GetSize() const { return size; }
+
+	private:
+		HANDLE fileHandle = INVALID_HANDLE_VALUE;
+		HANDLE mappingHandle = nullptr;
+		const char* data = nullptr;
+		size_t size = 0;
+	};
+
+	// Every read checks the remaining size, so a damaged file fails to load instead of being read past its end
+	class BlobReader
+	{
+	public:
+		BlobReader(const char* data, size_t size) : begin(data), cursor(data), end(data + size) {}
+
+		template<typename Type>
+		bool Read(Type& value)
+		{
+			static_assert(std::is_trivially_copyable_v<Type>, "Only trivially copyable types can be read as blobs");
+
+			if (static_cast<size_t>(end - cursor) < sizeof(Type))
+			{
+				return false;
+			}
+
+			std::memcpy(&value, cursor, sizeof(Type));
+			cursor += sizeof(Type);
+
+			return true;
+		}
+
+		template<typename Type>
+		bool ReadVector(std::vector<Type>& values)
+		{
+			static_assert(std::is_trivially_copyable_v<Type>, "Only trivially copyable types can be read as blobs");
+
+			uint64_t amount;
+
+			if (!Read(amount) || amount > static_cast<size_t>(end - cursor) / sizeof(Type))
+			{
+				return false;
+			}
+
+			values.resize(static_cast<size_t>(amount));
+
+			if (amount)
+			{
+				std::memcpy(values.data(), cursor, values.size() * sizeof(Type));
+				cursor += values.size() * sizeof(Type);
+			}
+
+			return true;
+		}
+
+		bool ReadString(std::string& str)
+		{
+			uint32_t length;
+
+			if (!Read(length) || length > static_cast<size_t>(end - cursor))
+			{
+				return false;
+			}
+
+			str.assign(cursor, length);
+			cursor += length;
+
+			return true;
+		}
+
+		// Every stored element takes at least a byte, so larger amounts can only come from a damaged file
+		bool CanHold(uint32_t amount) const
+		{
+			return amount <= static_cast<size_t>(end - cursor);
+		}
+
+		uint64_t GetOffset() const
+		{
+			return static_cast<uint64_t>(cursor - begin);
+		}
+
+		bool Seek(uint64_t offset)
+		{
+			if (offset > static_cast<uint64_t>(end - begin))
+			{
+				return false;
+			}
+
+			cursor = begin + offset;
+
+			return true;
+		}
+
+	private:
+		const char* begin;
+		const char* cursor;
+		const char* end;
+	};
+
+	class BlobWriter
+	{
+	public:
+		template<typename Type>
+		void Write(const Type& value)
+		{
+			static_assert(std::is_trivially_copyable_v<Type>, "Only trivially copyable types can be written as blobs");
+
+			const char* bytes = reinterpret_cast<const char*>(&value);
+			buffer.insert(buffer.end(), bytes, bytes + sizeof(Type));
+		}
+
+		template<typename Type>
+		void WriteVector(const std::vector<Type>& values)
+		{
+			static_assert(std::is_trivially_copyable_v<Type>, "Only trivially copyable types can be written as blobs");
+
+			Write(static_cast<uint64_t>(values.size()));
+
+			const char* bytes = reinterpret_cast<const char*>(values.data());
+			buffer.insert(buffer.end(), bytes, bytes + values.size() * sizeof(Type));
+		}
+
+		void WriteString(const std::string& str)
+		{
+			Write(static_cast<uint32_t>(str.size()));
+			buffer.insert(buffer.end(), str.begin(), str.end());
+		}
+
+		const std::vector<char>& GetBuffer() const
+		{
+			return buffer;
+		}
+
+	private:
+		std::vector<char> buffer;
+	};
+
+	// FNV-1a over 8 byte words, then over the remaining bytes
+	bool HashFile(const std::string& path, uint64_t& hash, uint64_t& size)
+	{
+		MappedFile file(path);
+
+		if (!file.GetData())
+		{
+			return false;
+		}
+
+		const char* data = file.GetData();
+		size = file.GetSize();
+		size_t wordAmount = size / sizeof(uint64_t);
+
+		hash = fnvOffset;
+
+		for (size_t wordIndex = 0; wordIndex < wordAmount; ++wordIndex)
+		{
+			uint64_t word;
+			std::memcpy(&word, data + wordIndex * sizeof(uint64_t), sizeof(uint64_t));
+
+			hash = (hash ^ word) * fnvPrime;
+		}
+
+		for (size_t byteIndex = wordAmount * sizeof(uint64_t); byteIndex < size; ++byteIndex)
+		{
+			hash = (hash ^ static_cast<unsigned char>(data[byteIndex])) * fnvPrime;
+		}
+
+		return true;
+	}
+
+	uint64_t CombineDependencyHash(uint64_t dependencyHash, uint64_t fileHash, uint64_t fileSize)
+	{
+		return (((dependencyHash ^ fileHash) * fnvPrime) ^ fileSize) * fnvPrime;
+	}
+
+	// Dependency hash is not compared, it is only read into fileKey
+	bool ReadMatchingHeader(
+		BlobReader& reader,
+		uint32_t magic,
+		uint32_t version,
+		const ModelCache::CacheKey& cacheKey,
+		ModelCache::CacheKey& fileKey
+	)
+	{
+		uint32_t fileMagic;
+		uint32_t fileVersion;
+		uint32_t vertexSize;
+
+		return
+			reader.Read(fileMagic) && fileMagic == magic &&
+			reader.Read(fileVersion) && fileVersion == version &&
+			reader.Read(vertexSize) && vertexSize == sizeof(LGLStructs::Vertex) &&
+			reader.Read(fileKey.sourceHash) && fileKey.sourceHash == cacheKey.sourceHash &&
+			reader.Read(fileKey.sourceSize) && fileKey.sourceSize == cacheKey.sourceSize &&
+			reader.Read(fileKey.importFlags) && fileKey.importFlags == cacheKey.importFlags &&
+			reader.Read(fileKey.dependencyHash);
+	}
+
+	// Every dependency is hashed again, so a changed or missing one makes the cache stale
+	bool ReadMatchingDependencies(BlobReader& reader, uint64_t dependencyHash)
+	{
+		uint32_t dependencyAmount;
+
+		if (!reader.Read(dependencyAmount) || !reader.CanHold(dependencyAmount))
+		{
+			return false;
+		}
+
+		uint64_t currentDependencyHash = fnvOffset;
+
+		for (uint32_t dependencyIndex = 0; dependencyIndex < dependencyAmount; ++dependencyIndex)
+		{
+			std::string path;
+			uint64_t fileHash;
+			uint64_t fileSize;
+			uint64_t currentFileHash;
+			uint64_t currentFileSize;
+
+			if (!reader.ReadString(path) || !reader.Read(fileHash) || !reader.Read(fileSize) ||
+				!HashFile(path, currentFileHash, currentFileSize) ||
+				currentFileHash != fileHash || currentFileSize != fileSize)
+			{
+				return false;
+			}
+
+			currentDependencyHash = CombineDependencyHash(currentDependencyHash, fileHash, fileSize);
+		}
+
+		return currentDependencyHash == dependencyHash;
+	}
+}
+
+std::string ModelCache::GetCachePath(const std::string& sourcePath)
+{
+	return sourcePath + ".evcooked";
+}
+
+bool ModelCache::GetCacheKey(const std::string& sourcePath, uint32_t importFlags, CacheKey& cacheKey)
+{
+	if (!HashFile(sourcePath, cacheKey.sourceHash, cacheKey.sourceSize))
+	{
+		return false;
+	}
+
+	cacheKey.importFlags = importFlags;
+
+	return true;
+}
+
+bool ModelCache::Load(
+	const std::string& cachePath,
+	const CacheKey& cacheKey,
+	LGLStructs::ModelInfo& model,
+	AnimSystem::ModelAnim& modelAnim,
+	TextureRefs& textureRefs
+)
+{
+	MappedFile cacheFile(cachePath);
+
+	if (!cacheFile.GetData())
+	{
+		return false;
+	}
+
+	BlobReader reader(cacheFile.GetData(), cacheFile.GetSize());
+
+	CacheKey fileKey;
+
+	if (!ReadMatchingHeader(reader, magic, version, cacheKey, fileKey) || !ReadMatchingDependencies(reader, fileKey.dependencyHash))
+	{
+		return false;
+	}
+
+	size_t firstMeshIndex = model.meshes.size();
+	TextureRefs loadedTextureRefs;
+	AnimSystem::BoneTree boneTree;
+	uint64_t boneAmount;
+	glm::mat4 globalInverseTransform;
+	AnimSystem::AnimInfoVect animInfoVect;
+	std::vector<AnimSystem::RawClip> rawClips;
+	std::vector<uint64_t> keysOffsets;
+
+	auto LoadImpl = [&]()
+	{
+		uint32_t meshAmount;
+
+		if (!reader.Read(meshAmount) || !reader.CanHold(meshAmount))
+		{
+			return false;
+		}
+
+		for (uint32_t meshIndex = 0; meshIndex < meshAmount; ++meshIndex)
+		{
+			std::string meshName;
+
+			if (!reader.ReadString(meshName))
+			{
+				return false;
+			}
+
+			// Mesh is added empty and read into in place, so vertices are copied only once
+			model.AddMesh(LGLStructs::Mesh(), meshName);
+			LGLStructs::Mesh& mesh = model.meshes.back().mesh;
+
+			uint32_t textureAmount;
+
+			if (!reader.ReadVector(mesh.vert) || !reader.ReadVector(mesh.indices) || !reader.Read(textureAmount) || !reader.CanHold(textureAmount))
+			{
+				return false;
+			}
+
+			auto& meshTextureRefs = loadedTextureRefs.emplace_back(textureAmount);
+
+			for (auto& textureRef : meshTextureRefs)
+			{
+				if (!reader.ReadString(textureRef.path) || !reader.Read(textureRef.type) ||
+					!reader.ReadVector(textureRef.embeddedData))
+				{
+					return false;
+				}
+			}
+		}
+
+		uint32_t nodeAmount;
+
+		if (!reader.Read(nodeAmount) || !reader.CanHold(nodeAmount))
+		{
+			return false;
+		}
+
+		// Nodes are stored parents first, with index of the parent or -1 for roots
+		std::vector<AnimSystem::BoneTree::TreeManagerNode*> nodes;
+		nodes.reserve(nodeAmount);
+
+		for (uint32_t nodeIndex = 0; nodeIndex < nodeAmount; ++nodeIndex)
+		{
+			std::string key;
+			int32_t parentIndex;
+			AnimSystem::BoneInfo boneInfo;
+
+			if (!reader.ReadString(key) || !reader.Read(parentIndex) || !reader.Read(boneInfo) ||
+				parentIndex >= static_cast<int32_t>(nodeIndex))
+			{
+				return false;
+			}
+
+			nodes.push_back(parentIndex < 0 ? boneTree.AddRootNode(key, boneInfo) : nodes[parentIndex]->AddNode(key, boneInfo));
+		}
+
+		uint32_t animAmount;
+
+		if (!reader.Read(boneAmount) || !reader.Read(globalInverseTransform) || !reader.Read(animAmount) || !reader.CanHold(animAmount))
+		{
+			return false;
+		}
+
+		rawClips.resize(animAmount);
+
+		for (auto& rawClip : rawClips)
+		{
+			std::string animName;
+			double animDuration;
+			double ticksPerSecond;
+			uint32_t channelAmount;
+
+			if (!reader.ReadString(animName) || !reader.Read(animDuration) || !reader.Read(ticksPerSecond) ||
+				!reader.Read(channelAmount) || !reader.CanHold(channelAmount))
+			{
+				return false;
+			}
+
+			animInfoVect.push_back({ animName, animDuration, ticksPerSecond });
+			rawClip.nodeNames.resize(channelAmount);
+
+			for (auto& nodeName : rawClip.nodeNames)
+			{
+				if (!reader.ReadString(nodeName))
+				{
+					return false;
+				}
+			}
+
+			if (!reader.ReadVector(rawClip.keyAmounts) || rawClip.keyAmounts.size() != static_cast<size_t>(channelAmount) * 3)
+			{
+				return false;
+			}
+
+			keysOffsets.push_back(reader.GetOffset());
+
+			if (!reader.ReadVector(rawClip.keys))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	};
+
+	if (!LoadImpl())
+	{
+		model.meshes.erase(model.meshes.begin() + firstMeshIndex, model.meshes.end());
+
+		return false;
+	}
+
+	textureRefs.insert(textureRefs.end(), loadedTextureRefs.begin(), loadedTextureRefs.end());
+
+	modelAnim.boneTree = std::move(boneTree);
+	modelAnim.boneAmount = static_cast<size_t>(boneAmount);
+	modelAnim.globalInverseTransform = globalInverseTransform;
+	modelAnim.animInfoVect = std::move(animInfoVect);
+	modelAnim.rawClips = std::move(rawClips);
+
+	SetKeyReloaders(cachePath, fileKey, keysOffsets, modelAnim.rawClips);
+
+	return true;
+}
+
+bool ModelCache::Save(
+	const std::string& cachePath,
+	const CacheKey& cacheKey,
+	const std::vector<std::string>& dependencyPaths,
+	const LGLStructs::ModelInfo& model,
+	AnimSystem::ModelAnim& modelAnim,
+	const TextureRefs& textureRefs
+)
+{
+	if (textureRefs.size() != model.meshes.size() || modelAnim.rawClips.size() != modelAnim.animInfoVect.size())
+	{
+		return false;
+	}
+
+	CacheKey fileKey = cacheKey;
+	fileKey.dependencyHash = fnvOffset;
+
+	std::vector<std::pair<uint64_t, uint64_t>> dependencyHashes;
+
+	for (auto& dependencyPath : dependencyPaths)
+	{
+		auto& [fileHash, fileSize] = dependencyHashes.emplace_back();
+
+		if (!HashFile(dependencyPath, fileHash, fileSize))
+		{
+			return false;
+		}
+
+		fileKey.dependencyHash = CombineDependencyHash(fileKey.dependencyHash, fileHash, fileSize);
+	}
+
+	BlobWriter writer;
+
+	writer.Write(magic);
+	writer.Write(version);
+	writer.Write(static_cast<uint32_t>(sizeof(LGLStructs::Vertex)));
+	writer.Write(fileKey.sourceHash);
+	writer.Write(fileKey.sourceSize);
+	writer.Write(fileKey.importFlags);
+	writer.Write(fileKey.dependencyHash);
+
+	writer.Write(static_cast<uint32_t>(dependencyPaths.size()));
+
+	for (size_t dependencyIndex = 0; dependencyIndex < dependencyPaths.size(); ++dependencyIndex)
+	{
+		writer.WriteString(dependencyPaths[dependencyIndex]);
+		writer.Write(dependencyHashes[dependencyIndex].first);
+		writer.Write(dependencyHashes[dependencyIndex].second);
+	}
+
+	writer.Write(static_cast<uint32_t>(model.meshes.size()));
+
+	for (size_t meshIndex = 0; meshIndex < model.meshes.size(); ++meshIndex)
+	{
+		const LGLStructs::MeshInfo& meshInfo = model.meshes[meshIndex];
+
+		writer.WriteString(meshInfo.meshName);
+		writer.WriteVector(meshInfo.mesh.vert);
+		writer.WriteVector(meshInfo.mesh.indices);
+		writer.Write(static_cast<uint32_t>(textureRefs[meshIndex].size()));
+
+		for (auto& textureRef : textureRefs[meshIndex])
+		{
+			writer.WriteString(textureRef.path);
+			writer.Write(textureRef.type);
+			writer.WriteVector(textureRef.embeddedData);
+		}
+	}
+
+	// Bone tree is written depth first, so every parent precedes its children
+	std::vector<std::pair<AnimSystem::BoneTree::TreeManagerNode*, int32_t>> nodesToVisit;
+	std::vector<std::pair<AnimSystem::BoneTree::TreeManagerNode*, int32_t>> nodes;
+
+	for (auto& rootNode : modelAnim.boneTree.GetChildren())
+	{
+		nodesToVisit.emplace_back(&rootNode, -1);
+	}
+
+	while (!nodesToVisit.empty())
+	{
+		auto [node, parentIndex] = nodesToVisit.back();
+		nodesToVisit.pop_back();
+
+		int32_t nodeIndex = static_cast<int32_t>(nodes.size());
+		nodes.emplace_back(node, parentIndex);
+
+		for (auto& childNode : node->GetChildren())
+		{
+			nodesToVisit.emplace_back(&childNode, nodeIndex);
+		}
+	}
+
+	writer.Write(static_cast<uint32_t>(nodes.size()));
+
+	for (auto& [node, parentIndex] : nodes)
+	{
+		writer.WriteString(node->GetKey());
+		writer.Write(parentIndex);
+		writer.Write(node->GetValue());
+	}
+
+	writer.Write(static_cast<uint64_t>(modelAnim.boneAmount));
+	writer.Write(modelAnim.globalInverseTransform);
+	writer.Write(static_cast<uint32_t>(modelAnim.animInfoVect.size()));
+
+	std::vector<uint64_t> keysOffsets;
+
+	for (size_t animIndex = 0; animIndex < modelAnim.animInfoVect.size(); ++animIndex)
+	{
+		const AnimSystem::AnimInfo& animInfo = modelAnim.animInfoVect[animIndex];
+		const AnimSystem::RawClip& rawClip = modelAnim.rawClips[animIndex];
+
+		if (rawClip.nodeNames.size() * 3 != rawClip.keyAmounts.size())
+		{
+			return false;
+		}
+
+		writer.WriteString(animInfo.animName);
+		writer.Write(animInfo.animDuration);
+		writer.Write(animInfo.ticksPerSecond);
+		writer.Write(static_cast<uint32_t>(rawClip.nodeNames.size()));
+
+		for (auto& nodeName : rawClip.nodeNames)
+		{
+			writer.WriteString(nodeName);
+		}
+
+		writer.WriteVector(rawClip.keyAmounts);
+
+		keysOffsets.push_back(writer.GetBuffer().size());
+		writer.WriteVector(rawClip.keys);
+	}
+
+	// Written under a temporary name first, so a cache file is never left half written
+	std::string tempPath = cachePath + ".tmp";
+
+	{
+		std::ofstream tempFile(tempPath, std::ios::binary | std::ios::trunc);
+
+		if (!tempFile)
+		{
+			return false;
+		}
+
+		const std::vector<char>& buffer = writer.GetBuffer();
+		tempFile.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+		if (!tempFile)
+		{
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, cachePath, error);
+
+	if (error)
+	{
+		std::filesystem::remove(tempPath, error);
+
+		return false;
+	}
+
+	SetKeyReloaders(cachePath, fileKey, keysOffsets, modelAnim.rawClips);
+
+	return true;
+}
+
+void ModelCache::SetKeyReloaders(
+	const std::string& cachePath,
+	const CacheKey& cacheKey,
+	const std::vector<uint64_t>& keysOffsets,
+	std::vector<AnimSystem::RawClip>& rawClips
+)
+{
+	for (size_t animIndex = 0; animIndex < rawClips.size(); ++animIndex)
+	{
+		rawClips[animIndex].reloadKeys =
+			[cachePath, cacheKey, keysOffset = keysOffsets[animIndex], keyAmount = rawClips[animIndex].keys.size()](std::vector<float>& keys)
+			{
+				MappedFile cacheFile(cachePath);
+
+				if (!cacheFile.GetData())
+				{
+					return false;
+				}
+
+				BlobReader reader(cacheFile.GetData(), cacheFile.GetSize());
+				CacheKey fileKey;
+
+				// Cache may have been cooked again from a changed source since the keys were loaded
+				return
+					ReadMatchingHeader(reader, magic, version, cacheKey, fileKey) && fileKey.dependencyHash == cacheKey.dependencyHash &&
+					reader.Seek(keysOffset) && reader.ReadVector(keys) && keys.size() == keyAmount;
+			};
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "LGLStructs.h"
+#include "AnimSystem.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+
+// Imported models cooked into a binary file next to their source, so later loads skip the importer.
+// Cooked file is memory mapped and its blobs are copied straight into vertex and index arrays in their final layout.
+// It is only used if the source file, external files the importer read with it and importer settings match
+// the ones it was cooked from
+class ModelCache
+{
+public:
+	struct CacheKey
+	{
+		uint64_t sourceHash = 0;
+		uint64_t sourceSize = 0;
+		uint32_t importFlags = 0;
+		// Combined hash of external files, like buffers of .gltf or materials of .obj.
+		// Paths of those are stored in the cache, so it is only known once the cache is read or written
+		uint64_t dependencyHash = 0;
+	};
+
+	// Textures are stored as references and decoded on load, embedded ones keep their encoded data
+	struct TextureRef
+	{
+		std::string path;
+		LGLStructs::Texture::TextureType type = LGLStructs::Texture::TextureType::Diffuse;
+		std::vector<unsigned char> embeddedData;
+	};
+
+	// Per mesh
+	using TextureRefs = std::vector<std::vector<TextureRef>>;
+
+	static std::string GetCachePath(const std::string& sourcePath);
+	// Hashes the whole source file, returns false if it can not be read
+	static bool GetCacheKey(const std::string& sourcePath, uint32_t importFlags, CacheKey& cacheKey);
+
+	// Meshes are added without textures, those are returned as references. Bone tree, animation infos and raw clips
+	// of modelAnim are filled, the skeleton is left to be compiled. Nothing is added if the cache is stale or damaged.
+	// Keys of raw clips can be reloaded from the cache file, as long as it is not cooked again from a changed source
+	static bool Load(
+		const std::string& cachePath,
+		const CacheKey& cacheKey,
+		LGLStructs::ModelInfo& model,
+		AnimSystem::ModelAnim& modelAnim,
+		TextureRefs& textureRefs
+	);
+	// Raw clips must still hold node names, so it has to be called before the skeleton is compiled.
+	// Dependencies are external files the importer read, they are hashed and checked on every load.
+	// Once saved, keys of raw clips can be reloaded from the cache file
+	static bool Save(
+		const std::string& cachePath,
+		const CacheKey& cacheKey,
+		const std::vector<std::string>& dependencyPaths,
+		const LGLStructs::ModelInfo& model,
+		AnimSystem::ModelAnim& modelAnim,
+		const TextureRefs& textureRefs
+	);
+private:
+	// Reloaders read keys of each clip from given offset, after checking the cache still matches the key
+	static void SetKeyReloaders(
+		const std::string& cachePath,
+		const CacheKey& cacheKey,
+		const std::vector<uint64_t>& keysOffsets,
+		std::vector<AnimSystem::RawClip>& rawClips
+	);
+
+	// "EVMC"
+	constexpr static uint32_t magic = 0x434d5645;
+	constexpr static uint32_t version = 2;
+};
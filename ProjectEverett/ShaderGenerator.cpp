@@ -4,6 +4,17 @@
 
 std::vector<std::string> ShaderGenerator::fileTypes { "evert", "efrag" };
 std::vector<std::pair<std::string, std::string>> ShaderGenerator::customKeywords{ {"#genDefine", "#define"} };
+std::vector<std::pair<ShaderGenerator::Feature, std::string>> ShaderGenerator::featureDefines
+{
+	{Feature::Skinned,      "SKINNED"},
+	{Feature::Textured,     "TEXTURED"},
+	{Feature::NormalMapped, "NORMAL_MAPPED"},
+	{Feature::DirLights,    "DIR_LIGHTS"},
+	{Feature::PointLights,  "POINT_LIGHTS"},
+	{Feature::SpotLights,   "SPOT_LIGHTS"},
+	{Feature::DepthOnly,    "DEPTH_ONLY"},
+	{Feature::PreSkin,      "PRE_SKIN"}
+};
 
 ShaderGenerator::~ShaderGenerator()
 {
@@ -123,5 +134,54 @@ void ShaderGenerator::GenerateShaderFiles(const std::string& path)
 
 			newShaderFile << buffer << '\n';
 		}
+
+		// Rewinds pre sources, so several variants can be generated from one load
+		preSourceFiles[fileIndex].clear();
+		preSourceFiles[fileIndex].seekg(0);
+	}
+}
+
+std::string ShaderGenerator::GetPermutationName(const std::string& baseName, FeatureBits features)
+{
+	return baseName + "_p" + std::to_string(features);
+}
+
+void ShaderGenerator::SetFeatureDefines(FeatureBits features)
+{
+	for (auto& [feature, defineName] : featureDefines)
+	{
+		SetValueToDefine(defineName, static_cast<int>((features & feature) != 0));
 	}
+}
+
+std::string ShaderGenerator::GeneratePermutation(FeatureBits features)
+{
+	std::string permutationPath = GetPermutationName(preSourcePath, features);
+
+	if (generatedPermutations.find(features) == generatedPermutations.end())
+	{
+		SetFeatureDefines(features);
+		GenerateShaderFiles(permutationPath);
+
+		generatedPermutations.insert(features);
+	}
+
+	return permutationPath.substr(permutationPath.rfind('\\') + 1);
+}
+
+std::vector<std::string> ShaderGenerator::RegeneratePermutations()
+{
+	std::vector<std::string> res;
+
+	for (FeatureBits features : generatedPermutations)
+	{
+		std::string permutationPath = GetPermutationName(preSourcePath, features);
+
+		SetFeatureDefines(features);
+		GenerateShaderFiles(permutationPath);
+
+		res.push_back(permutationPath.substr(permutationPath.rfind('\\') + 1));
+	}
+
+	return res;
 }
\ No newline at end of file
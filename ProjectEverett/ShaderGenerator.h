@@ -3,12 +3,29 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <memory>
 #include <fstream>
+#include <cstdint>
 
 class ShaderGenerator
 {
 public:
+	// Each feature is mapped to a #genDefine of pre sources, set to 1 or 0 in a permutation
+	enum Feature : uint32_t
+	{
+		Skinned      = 1 << 0,
+		Textured     = 1 << 1,
+		NormalMapped = 1 << 2,
+		DirLights    = 1 << 3,
+		PointLights  = 1 << 4,
+		SpotLights   = 1 << 5,
+		DepthOnly    = 1 << 6,
+		PreSkin      = 1 << 7
+	};
+
+	using FeatureBits = uint32_t;
+
 	~ShaderGenerator();
 
 	void LoadPreSources(const std::string& path);
@@ -18,11 +35,20 @@ public:
 	void SetValueToDefine(const std::string& valueName, Type&& value);
 
 	void GenerateShaderFiles(const std::string& path);
+
+	static std::string GetPermutationName(const std::string& baseName, FeatureBits features);
+
+	// Shader files of a permutation are generated next to pre sources only once, on the first request.
+	// Returns permutation name, which is also the name of its shader files
+	std::string GeneratePermutation(FeatureBits features);
+	// Used after values to define were changed, returns names of all regenerated permutations
+	std::vector<std::string> RegeneratePermutations();
 private:
 	void InitializeFileObjects(const std::string& path, int flag);
 	void DeinitializeFileObjects();
 	void InitializeLineMap();
 	void ProcessPreSources();
+	void SetFeatureDefines(FeatureBits features);
 
 	struct LineToSubstInfo
 	{
@@ -34,8 +60,10 @@ private:
 	std::string preSourcePath;
 	std::vector<std::fstream> preSourceFiles;
 	std::vector<std::map<size_t, LineToSubstInfo>> lineToSubstMap;
+	std::set<FeatureBits> generatedPermutations;
 
 	static std::vector<std::string> fileTypes;
+	static std::vector<std::pair<Feature, std::string>> featureDefines;
 	static std::vector<std::pair<std::string, std::string>> customKeywords;
 };
 
@@ -283,17 +283,60 @@ bool SolidSim::IsModelAnimationLooped()
 	return STMM.IsAnimationLooped();
 }
 
+void SolidSim::SetModelAnimationTimeQuantization(double seconds)
+{
+	STMM.SetAnimationTimeQuantization(seconds);
+}
+
+double SolidSim::GetModelAnimationTimeQuantization()
+{
+	return STMM.GetAnimationTimeQuantization();
+}
+
+void SolidSim::SetModelAnimationBaked(bool value)
+{
+	STMM.SetAnimationBaked(value);
+}
+
+bool SolidSim::IsModelAnimationBaked()
+{
+	return STMM.IsAnimationBaked();
+}
+
+void SolidSim::GetModelAnimatedBounds(glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+	AnimSystem::Bounds& bounds = STMM.GetAnimatedBounds();
+
+	boundsMin = bounds.min;
+	boundsMax = bounds.max;
+}
+
 double SolidSim::GetModelCurrentAnimationTime()
 {
 	return STMM.GetCurrentAnimationTime();
 }
 
-void SolidSim::AppendModelStartingBoneIndex(size_t startingBoneIndex)
+void SolidSim::SetModelStartingBoneIndex(size_t startingBoneIndex)
+{
+	STMM.SetStartingBoneIndex(startingBoneIndex);
+}
+
+size_t SolidSim::GetModelStartingBoneIndex()
+{
+	return STMM.GetStartingBoneIndex();
+}
+
+AnimSystem::PoseState& SolidSim::GetModelPoseState()
+{
+	return STMM.GetPoseState();
+}
+
+AnimSystem::BakedPlayback& SolidSim::GetModelBakedPlayback()
 {
-	STMM.AppendStartingBoneIndex(startingBoneIndex);
+	return STMM.GetBakedPlayback();
 }
 
-size_t SolidSim::GetModelCurrentStartingBoneIndex()
+AnimSystem::Bounds& SolidSim::GetModelAnimatedBoundsAddr()
 {
-	return STMM.GetCurrentStartingBoneIndex();
+	return STMM.GetAnimatedBounds();
 }
\ No newline at end of file
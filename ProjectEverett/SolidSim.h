@@ -69,11 +69,19 @@ public:
 	bool IsModelAnimationPlaying() override;
 	bool IsModelAnimationPaused() override;
 	bool IsModelAnimationLooped() override;
+	void SetModelAnimationTimeQuantization(double seconds) override;
+	double GetModelAnimationTimeQuantization() override;
+	void SetModelAnimationBaked(bool value) override;
+	bool IsModelAnimationBaked() override;
+	void GetModelAnimatedBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) override;
 
 	// Animation access; engine only
 	double GetModelCurrentAnimationTime();
-	void AppendModelStartingBoneIndex(size_t startingBoneIndex);
-	size_t GetModelCurrentStartingBoneIndex();
+	void SetModelStartingBoneIndex(size_t startingBoneIndex);
+	size_t GetModelStartingBoneIndex();
+	AnimSystem::PoseState& GetModelPoseState();
+	AnimSystem::BakedPlayback& GetModelBakedPlayback();
+	AnimSystem::Bounds& GetModelAnimatedBoundsAddr();
 	
 	static bool CheckForCollision(const SolidSim& solid1, const SolidSim& solid2);
 	bool CheckForCollision(const ISolidSim& solid1, const ISolidSim& solid2) override;
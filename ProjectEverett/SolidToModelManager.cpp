@@ -2,7 +2,7 @@
 #include "EverettException.h"
 
 SolidToModelManager::SolidToModelManager() 
-	: initialized(false) {}
+	: initialized(false), animationTimeQuantization(0.0), animationBaked(false), startingBoneIndex(0) {}
 
 void SolidToModelManager::InitializeSTMM(FullModelInfo& fullModelInfoRef)
 {
@@ -12,6 +12,9 @@ void SolidToModelManager::InitializeSTMM(FullModelInfo& fullModelInfoRef)
 	currentAnimationIndex = 0;
 	lastAnimationTime = 0.0;
 	animationSpeed = 1.0;
+	animationTimeQuantization = 0.0;
+	animationBaked = false;
+	animatedBounds = fullModelInfoP->second.bindBounds;
 
 	initialized = true;
 
@@ -220,6 +223,26 @@ bool SolidToModelManager::IsAnimationLooped()
 	return animStates.looped;
 }
 
+void SolidToModelManager::SetAnimationTimeQuantization(double seconds)
+{
+	animationTimeQuantization = std::max(seconds, 0.0);
+}
+
+double SolidToModelManager::GetAnimationTimeQuantization()
+{
+	return animationTimeQuantization;
+}
+
+void SolidToModelManager::SetAnimationBaked(bool value)
+{
+	animationBaked = value;
+}
+
+bool SolidToModelManager::IsAnimationBaked()
+{
+	return animationBaked;
+}
+
 double SolidToModelManager::GetAnimationTimeTicks(double currentTime)
 {
 	double animDuration = fullModelInfoP->second.animInfoVect[currentAnimationIndex].animDuration;
@@ -238,6 +261,12 @@ double SolidToModelManager::GetAnimationTimeTicks(double currentTime)
 
 	lastAnimationTime = animationTime;
 
+	if (animationTimeQuantization > 0.0)
+	{
+		double quantizationStep = animationTimeQuantization * fullModelInfoP->second.animInfoVect[currentAnimationIndex].ticksPerSecond;
+		animationTime = std::floor(animationTime / quantizationStep) * quantizationStep;
+	}
+
 	return animationTime;
 }
 
@@ -253,18 +282,39 @@ double SolidToModelManager::GetCurrentAnimationTime()
 	return GetAnimationTimeTicks(std::chrono::duration<double>(currentAnimationTime - startAnimationTime).count());
 }
 
-void SolidToModelManager::AppendStartingBoneIndex(size_t staringBoneIndex)
+void SolidToModelManager::SetStartingBoneIndex(size_t startingBoneIndex)
+{
+	CheckIfInitialized();
+
+	this->startingBoneIndex = startingBoneIndex;
+}
+
+size_t SolidToModelManager::GetStartingBoneIndex()
+{
+	CheckIfInitialized();
+
+	return startingBoneIndex;
+}
+
+AnimSystem::PoseState& SolidToModelManager::GetPoseState()
+{
+	CheckIfInitialized();
+
+	return poseState;
+}
+
+AnimSystem::BakedPlayback& SolidToModelManager::GetBakedPlayback()
 {
 	CheckIfInitialized();
 
-	startingBoneIndexes.push_back(staringBoneIndex);
+	return bakedPlayback;
 }
 
-size_t SolidToModelManager::GetCurrentStartingBoneIndex()
+AnimSystem::Bounds& SolidToModelManager::GetAnimatedBounds()
 {
 	CheckIfInitialized();
 
-	return startingBoneIndexes[currentAnimationIndex];
+	return animatedBounds;
 }
 
 void SolidToModelManager::CheckIfInitialized()
@@ -41,10 +41,19 @@ public:
 	bool IsAnimationPlaying();
 	bool IsAnimationPaused();
 	bool IsAnimationLooped();
+	void SetAnimationTimeQuantization(double seconds);
+	double GetAnimationTimeQuantization();
+	void SetAnimationBaked(bool value);
+	bool IsAnimationBaked();
 
 	double GetCurrentAnimationTime();
-	void AppendStartingBoneIndex(size_t startingBoneIndex);
-	size_t GetCurrentStartingBoneIndex();
+	// Assigned every frame to instances which are animated in it
+	void SetStartingBoneIndex(size_t startingBoneIndex);
+	size_t GetStartingBoneIndex();
+	AnimSystem::PoseState& GetPoseState();
+	AnimSystem::BakedPlayback& GetBakedPlayback();
+	// Model space bounds of the current pose, updated every frame
+	AnimSystem::Bounds& GetAnimatedBounds();
 private:
 	friend class SolidSim;
 
@@ -59,12 +68,17 @@ private:
 	bool initialized;
 
 	double animationSpeed;
+	double animationTimeQuantization;
+	bool animationBaked;
 	double lastAnimationTime;
 	size_t currentAnimationIndex;
-	std::vector<size_t> startingBoneIndexes;
+	size_t startingBoneIndex;
 	PlayerStates animStates;
 	std::chrono::system_clock::time_point startAnimationTime;
 	std::chrono::system_clock::time_point currentAnimationTime;
+	AnimSystem::PoseState poseState;
+	AnimSystem::BakedPlayback bakedPlayback;
+	AnimSystem::Bounds animatedBounds;
 
 	std::vector<bool> meshVisibility;
 	
@@ -19,18 +19,18 @@ uniform mat4 proj;
 uniform mat4 inv;
 
 #define MAX_BONES 1000
-uniform mat4 Bones[MAX_BONES];
+uniform mat3x4 Bones[MAX_BONES];
 
 
 void main()
 {
     // Bone skinning
-    mat4 BoneTransform = Bones[aBoneIDs[0]] * aWeights[0];
-    BoneTransform     += Bones[aBoneIDs[1]] * aWeights[1];
-    BoneTransform     += Bones[aBoneIDs[2]] * aWeights[2];
-    BoneTransform     += Bones[aBoneIDs[3]] * aWeights[3];
+    mat3x4 BoneTransform = Bones[aBoneIDs[0]] * aWeights[0];
+    BoneTransform       += Bones[aBoneIDs[1]] * aWeights[1];
+    BoneTransform       += Bones[aBoneIDs[2]] * aWeights[2];
+    BoneTransform       += Bones[aBoneIDs[3]] * aWeights[3];
 
-    vec4 skinnedPos = BoneTransform * vec4(aPos, 1.0);
+    vec4 skinnedPos = vec4(vec4(aPos, 1.0) * BoneTransform, 1.0);
 
     // Final transforms
     vec4 worldPos = model * skinnedPos;
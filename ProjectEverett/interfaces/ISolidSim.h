@@ -41,6 +41,17 @@ public:
 	virtual bool IsModelAnimationPlaying() = 0;
 	virtual bool IsModelAnimationPaused() = 0;
 	virtual bool IsModelAnimationLooped() = 0;
+	// Animation time is rounded down to multiples of the step in seconds, so solids playing the same animation
+	// can share evaluated poses. 0 disables it
+	virtual void SetModelAnimationTimeQuantization(double seconds) = 0;
+	virtual double GetModelAnimationTimeQuantization() = 0;
+	// Baked animations are sampled once into a texture and played back entirely by shaders.
+	// Meant for crowds, as there is no per frame evaluation, poses of baked animations are not shared or interpolated
+	virtual void SetModelAnimationBaked(bool value) = 0;
+	virtual bool IsModelAnimationBaked() = 0;
+	// Model space box enclosing the current pose for the whole time segment of the animation it is in.
+	// Bind pose box if no animation is playing
+	virtual void GetModelAnimatedBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) = 0;
 
 	virtual bool CheckForCollision(const ISolidSim& solid1, const ISolidSim& solid2) = 0;
 };
\ No newline at end of file